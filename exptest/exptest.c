@@ -5,276 +5,111 @@ Test implementation of exponential function.
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 #include <mpfr.h>
-#include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <math.h>
 
-#define MAX_SERIES_STEPS 10
+#include "fastfun.h"
 
-mpz_t _exp_x;
-mpz_t _exp_t;
-mpz_t _exp_one;
-mpz_t _exp_a;
-mpz_t _exp_s0;
-mpz_t _exp_s1;
-mpz_t _exp_x2;
-
-mpz_t _exp_pows[MAX_SERIES_STEPS];
-mpz_t _exp_sums[MAX_SERIES_STEPS];
-
-double timing()
+/* ffl_exp as a bench_sweep kernel */
+static int exp_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    double v;
-    struct timeval t;
-    gettimeofday(&t, NULL);
-    v = (double) t.tv_usec;
-    v = v + 1e6 * (double) t.tv_sec;
-    return v;
+    (void) param;
+    return ffl_exp(ctx, y, x, prec);
 }
 
-void fix_init_data()
+/* ffl_exp(-x) as a bench_sweep kernel, and the matching reference */
+static int exp_neg_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    int i;
-    mpz_init(_exp_x);
-    mpz_init(_exp_x2);
-    mpz_init(_exp_one);
-    mpz_init(_exp_t);
-    mpz_init(_exp_a);
-    mpz_init(_exp_s0);
-    mpz_init(_exp_s1);
-    for (i=0; i<MAX_SERIES_STEPS; i++)
-    {
-        mpz_init(_exp_pows[i]);
-        mpz_init(_exp_sums[i]);
-    }
+    (void) param;
+    mpz_neg(x, x);
+    return ffl_exp(ctx, y, x, prec);
 }
 
-void fix_clear_data()
+static int mpfr_exp_neg(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd)
 {
-    int i;
-    mpz_clear(_exp_x);
-    mpz_clear(_exp_x2);
-    mpz_clear(_exp_one);
-    mpz_clear(_exp_t);
-    mpz_clear(_exp_a);
-    mpz_clear(_exp_s0);
-    mpz_clear(_exp_s1);
-    for (i=0; i<MAX_SERIES_STEPS; i++)
-    {
-        mpz_clear(_exp_pows[i]);
-        mpz_clear(_exp_sums[i]);
-    }
+    mpfr_neg(y, x, rnd);
+    return mpfr_exp(y, y, rnd);
 }
 
-void mpz_fixed_one(mpz_t x, int prec)
+/* exp_series_lut with the (r, J, lut) in param[0..2] as a bench_sweep kernel */
+static int exp_series_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    //mpz_set_ui(x, 1);
-    //mpz_mul_2exp(x, x, prec);
-    mpz_set_ui(x, 0);
-    mpz_setbit(x, prec);
+    int *rJL = (int *) param;
+    exp_series_lut(ctx, y, x, prec, rJL[0], rJL[1], rJL[2]);
+    return 0;
 }
 
-/*
-First version -- uses Taylor series for exp(x) directly,
-broken into two pieces
-
-Note: this version is currently not used in the benchmark below
-*/
-void fix_exp(mpz_t z, mpz_t x, int prec)
+/* exp_series_mpn with the (r, J) in param[0..1] as a bench_sweep kernel */
+static int exp_series_mpn_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    int k;
-    int r = 8;
-    //prec += 20;
-    //mpz_set(_exp_x, x);
-    //mpz_tdiv_q_2exp(_exp_x, _exp_x, r);
-    mpz_tdiv_q_2exp(_exp_x, x, r);
-    mpz_set_ui(_exp_s0, 1);
-    mpz_mul_2exp(_exp_s0, _exp_s0, prec);
-    mpz_set(_exp_s1, _exp_s0);
-    mpz_mul(_exp_x2, _exp_x, _exp_x);
-    mpz_tdiv_q_2exp(_exp_x2,_exp_x2,prec);
-    mpz_set(_exp_a, _exp_x2);
-    k = 2;
-    while(1)
-    {
-        mpz_tdiv_q_ui(_exp_a, _exp_a, k);
-        if (mpz_sgn(_exp_a) == 0)
-            break;
-        mpz_add(_exp_s0, _exp_s0, _exp_a);
-        k += 1;
-        mpz_tdiv_q_ui(_exp_a, _exp_a, k);
-        if (mpz_sgn(_exp_a) == 0)
-            break;
-        mpz_add(_exp_s1, _exp_s1, _exp_a);
-        k += 1;
-        mpz_mul(_exp_a, _exp_a, _exp_x2);
-        mpz_tdiv_q_2exp(_exp_a,_exp_a,prec);
-        if (mpz_sgn(_exp_a) == 0)
-            break;
-    }
-    mpz_mul(_exp_s1, _exp_s1, _exp_x);
-    mpz_tdiv_q_2exp(_exp_s1,_exp_s1,prec);
-    mpz_add(_exp_s0, _exp_s0, _exp_s1);
-    for(k=0; k<r; k++)
-    {
-        mpz_mul(_exp_s0, _exp_s0, _exp_s0);
-        mpz_tdiv_q_2exp(_exp_s0,_exp_s0,prec);
-    }
-    //mpz_tdiv_q_ui(z, _exp_s0, 20);
-    mpz_set(z, _exp_s0);
+    int *rJ = (int *) param;
+    exp_series_mpn(ctx, y, x, prec, rJ[0], rJ[1]);
+    return 0;
 }
 
+#ifdef FFL_FAST128
+/* exp_fast128 as a bench_sweep kernel */
+static int exp_fast128_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
+{
+    (void) param;
+    exp_fast128(ctx, y, x, prec);
+    return 0;
+}
 
+/* exp_fast128(-x) as a bench_sweep kernel */
+static int exp_fast128_neg_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
+{
+    (void) param;
+    mpz_neg(x, x);
+    exp_fast128(ctx, y, x, prec);
+    return 0;
+}
+#endif
 
 /*
-Computes the exponential / trigonometric series
-
-  alt = 0  -- c = cosh(x), s = sinh(x)
-  alt = 1  -- c = cos(x), s = sin(x)
-  alt = 2  -- c = exp(x), s = n/a
-
-using the cosh/sinh series. Parameters:
-
-  prec -- 
-  r    -- number of argument reductions
-  J    -- number of partitions of the series
-
+exp_series with (r, J, alt) in param[0..2] as a bench_sweep kernel,
+returning s (sinh, sin) for alt 0, 1 and c (exp) for alt 2
 */
-void exp_series(mpz_t c, mpz_t s, mpz_t x, int prec, int r, int J, int alt)
+static int exp_series_alt_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    int i, k, wp;
-
-    wp = prec + 2*r + 10;
-
-    mpz_fixed_one(_exp_one, wp);
-
-    /*   x / 2^r, adjusted to wp   */
-    mpz_mul_2exp(_exp_x, x, wp-prec);
-    mpz_tdiv_q_2exp(_exp_x, _exp_x, r);
-
-    if (J < 1)
-        J = 1;
-    
-    for (i=0; i<J; i++)
-    {
-        if (i == 0)
-        {
-            mpz_set(_exp_pows[i], _exp_one);
-        }
-        else if (i == 1)
-        {
-            mpz_mul(_exp_pows[i], _exp_x, _exp_x);
-            mpz_tdiv_q_2exp(_exp_pows[i], _exp_pows[i], wp);
-        }
-        else
-        {
-            mpz_mul(_exp_pows[i], _exp_pows[i-1], _exp_pows[1]);
-            mpz_tdiv_q_2exp(_exp_pows[i], _exp_pows[i], wp);
-        }
-        mpz_set_ui(_exp_sums[i], 0);
-    }
-
-    if (J == 1)
-    {
-        mpz_mul(_exp_x, _exp_x, _exp_x);
-        mpz_tdiv_q_2exp(_exp_x, _exp_x, wp);
-        mpz_set(_exp_a, _exp_x);
-    }
-    else
-    {
-        mpz_mul(_exp_x, _exp_pows[J-1], _exp_pows[1]);
-        mpz_tdiv_q_2exp(_exp_x, _exp_x, wp);
-        mpz_set(_exp_a, _exp_pows[1]);
-    }
-
-    k = 2;
-    while (mpz_sgn(_exp_a) != 0)
-    {
-        for (i=0; i<J; i++)
-        {
-            mpz_tdiv_q_ui(_exp_a, _exp_a, (k-1)*k);
-            if ((alt == 1) && (k & 2))
-            {
-                mpz_sub(_exp_sums[i], _exp_sums[i], _exp_a);
-            }
-            else
-            {
-                mpz_add(_exp_sums[i], _exp_sums[i], _exp_a);
-            }
-            k += 2;
-        }
-        mpz_mul(_exp_a, _exp_a, _exp_x);
-        mpz_tdiv_q_2exp(_exp_a, _exp_a, wp);
-    }
-
-    for (i=1; i<J; i++)
-    {
-        mpz_mul(_exp_sums[i], _exp_sums[i], _exp_pows[i]);
-        mpz_tdiv_q_2exp(_exp_sums[i], _exp_sums[i], wp);
-    }
-
-    mpz_set(c, _exp_one);
-    for (i=0; i<J; i++)
-    {
-        mpz_add(c, c, _exp_sums[i]);
-    }
-
-    /*
-    Repeatedly apply the duplication formula
-
-      cosh(2*x) = 2*cosh(x)^2 - 1
-      cos(2*x) = 2*cos(x)^2 - 1
-      exp(2*x) = exp(x)^2
-    */
-
-    if (alt == 2)
-    {
-        /* s = sqrt(|1-c^2|) */
-        mpz_mul_2exp(_exp_one, _exp_one, wp);
-        mpz_mul(s, c, c);
-        mpz_sub(s, _exp_one, s);
-        mpz_abs(s, s);
-        mpz_sqrt(s, s);
-        mpz_add(c, c, s);
-        for (i=0; i<r; i++)
-        {
-            mpz_mul(c, c, c);
-            mpz_tdiv_q_2exp(c, c, wp);
-        }
-    }
+    int *rJa = (int *) param;
+    if ((rJa[2] & ~EXP_SERIES_DIRECT) == 2)
+        exp_series(ctx, y, ctx->exp.t, x, prec, rJa[0], rJa[1], rJa[2]);
     else
-    {
-        for (i=0; i<r; i++)
-        {
-            mpz_mul(c, c, c);
-            mpz_tdiv_q_2exp(c, c, wp-1);
-            mpz_sub(c, c, _exp_one);
-        }
-        /* s = sqrt(|1-c^2|) */
-        mpz_mul_2exp(_exp_one, _exp_one, wp);
-        mpz_mul(s, c, c);
-        mpz_sub(s, _exp_one, s);
-        mpz_abs(s, s);
-        mpz_sqrt(s, s);
-    }
-
-    mpz_tdiv_q_2exp(c, c, wp-prec);
-    mpz_tdiv_q_2exp(s, s, wp-prec);
-
+        exp_series(ctx, ctx->exp.t, y, x, prec, rJa[0], rJa[1], rJa[2]);
+    return 0;
 }
 
-void benchmark_optimize_exp()
+/*
+The fastest (r, J, lut) for exp_series_lut(0.37) per precision, with
+and without the lookup tables, written to tune_file. A candidate is
+only accepted if, on TUNE_SWEEP_N random arguments (the same for every
+candidate), its maximum error is within TUNE_MAX_ERR bits of that of
+the default parameters; err is that error for the winner and rej the
+number of faster candidates rejected.
+*/
+void benchmark_optimize_exp(ffl_ctx_t ctx, const char *tune_file)
 {
     int REPS;
     int prec;
-    int i, k, r, J, best_r, best_J;
-    double best_time, best_here;
+    int i, k, r, J, lut, best_r, best_J, best_lut, rejected;
+    double best_time, best_here, best_err, ref_err;
     double t1, t2, elapsed;
     double mpfr_time;
     int accuracy, min_accuracy;
+    int tune_prec[TUNE_SIZE], tune_r[TUNE_SIZE], tune_J[TUNE_SIZE], tune_lut[TUNE_SIZE];
+    int ntune = 0;
+    int rJL[3];
 
     mpz_t x, y, dummy;
     mpfr_t mx, my;
+    gmp_randstate_t state;
+    bench_sweep_result sweep;
 
     mpfr_init(mx);
     mpfr_init(my);
@@ -282,8 +117,9 @@ void benchmark_optimize_exp()
     mpz_init(x);
     mpz_init(y);
     mpz_init(dummy);
+    gmp_randinit_default(state);
 
-    printf(" prec   acc   J   r     mpfr     this   faster\n");
+    printf(" prec   acc   J   r lut     mpfr     this   faster    err  rej\n");
 
     for (prec=53; prec<30000; prec+=prec/4)
     {
@@ -304,6 +140,15 @@ void benchmark_optimize_exp()
         best_time = 1e100;
         best_r = 0;
         best_J = 0;
+        best_lut = 0;
+        best_err = 0;
+        rejected = 0;
+
+        exp_default_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&sweep, ctx, exp_series_sweep_kernel, rJL, mpfr_exp,
+            EXP_SWEEP_LO, EXP_SWEEP_HI, 1, TUNE_SWEEP_N, prec, state);
+        ref_err = sweep.max_err;
 
         mpfr_set_prec(mx, prec);
         mpfr_set_prec(my, prec);
@@ -323,39 +168,61 @@ void benchmark_optimize_exp()
                 mpfr_time = elapsed;
         }
 
-        for (J=1; J<MAX_SERIES_STEPS; J++)
+        for (lut=0; lut<=EXP_LUT_LEVELS; lut++)
         {
-            for (r=0; r*r<prec+30; r++)
+            for (J=1; J<MAX_SERIES_STEPS; J++)
             {
-                for (i=0; i<3; i++)
+                for (r=0; r*r<prec+30; r++)
                 {
-                    t1 = timing();
-                    for (k=0; k<REPS; k++)
+                    best_here = 1e100;
+                    for (i=0; i<3; i++)
                     {
-                        exp_series(y, dummy, x, prec, r, J, 2);
+                        t1 = timing();
+                        for (k=0; k<REPS; k++)
+                        {
+                            exp_series_lut(ctx, y, x, prec, r, J, lut);
+                        }
+                        t2 = timing();
+                        elapsed = (t2-t1) / REPS;
+
+                        if (elapsed < best_here)
+                            best_here = elapsed;
                     }
-                    t2 = timing();
-                    elapsed = (t2-t1) / REPS;
 
-                    if (elapsed < best_time)
+                    if (best_here < best_time)
                     {
-                        best_time = elapsed;
-                        best_r = r;
-                        best_J = J;
+                        rJL[0] = r;
+                        rJL[1] = J;
+                        rJL[2] = lut;
+                        gmp_randseed_ui(state, prec);
+                        bench_sweep(&sweep, ctx, exp_series_sweep_kernel, rJL, mpfr_exp,
+                            EXP_SWEEP_LO, EXP_SWEEP_HI, 1, TUNE_SWEEP_N, prec, state);
+                        if (sweep.max_err <= ref_err + TUNE_MAX_ERR)
+                        {
+                            best_time = best_here;
+                            best_r = r;
+                            best_J = J;
+                            best_lut = lut;
+                            best_err = sweep.max_err;
+                        }
+                        else
+                        {
+                            rejected++;
+                        }
                     }
-                }
 
-                mpfr_set_z(mx, y, GMP_RNDN);
-                mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
-                //mpfr_printf("Value:  %Rf\n", mx);
-                mpfr_sub(mx, mx, my, GMP_RNDN);
-                mpfr_abs(mx, mx, GMP_RNDN);
-                if (!mpfr_zero_p(mx))
-                {
-                    accuracy = -(int)mpfr_get_exp(mx)+1;
-                    if (accuracy < min_accuracy)
+                    mpfr_set_z(mx, y, GMP_RNDN);
+                    mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
+                    //mpfr_printf("Value:  %Rf\n", mx);
+                    mpfr_sub(mx, mx, my, GMP_RNDN);
+                    mpfr_abs(mx, mx, GMP_RNDN);
+                    if (!mpfr_zero_p(mx))
                     {
-                        min_accuracy = accuracy;
+                        accuracy = -(int)mpfr_get_exp(mx)+1;
+                        if (accuracy < min_accuracy)
+                        {
+                            min_accuracy = accuracy;
+                        }
                     }
                 }
             }
@@ -364,9 +231,198 @@ void benchmark_optimize_exp()
         mpfr_time *= 1000;
         best_time *= 1000;
 
-        printf("%5d %5d %3d %3d %8d %8d   %.3f\n", prec, min_accuracy, best_J, best_r,
-            (int)mpfr_time, (int)best_time, mpfr_time/best_time);
+        printf("%5d %5d %3d %3d %3d %8d %8d   %.3f %6.2f %4d\n", prec, min_accuracy, best_J, best_r,
+            best_lut, (int)mpfr_time, (int)best_time, mpfr_time/best_time, best_err, rejected);
+
+        tune_prec[ntune] = prec;
+        tune_r[ntune] = best_r;
+        tune_J[ntune] = best_J;
+        tune_lut[ntune] = best_lut;
+        ntune++;
+    }
+
+    if (tune_file != NULL)
+    {
+        if (save_exp_tuning(tune_file, tune_prec, tune_r, tune_J, tune_lut, ntune) == 0)
+            printf("wrote %s\n", tune_file);
+        else
+            printf("could not write %s\n", tune_file);
+    }
+
+    mpfr_clear(mx);
+    mpfr_clear(my);
+
+    mpz_clear(x);
+    mpz_clear(y);
+    mpz_clear(dummy);
+    gmp_randclear(state);
+}
+
+/*
+exp_series_lut with the default and with the tuned (r, J, lut),
+against mpfr_exp. Times in nanoseconds.
+*/
+void benchmark_tuned_exp(ffl_ctx_t ctx)
+{
+    int REPS;
+    int prec, i, k, r, J, lut, dr, dJ, dlut;
+    double t1, t2, elapsed;
+    double mpfr_time, default_time, tuned_time;
+
+    mpz_t x, y;
+    mpfr_t mx, my;
+
+    mpfr_init(mx);
+    mpfr_init(my);
+
+    mpz_init(x);
+    mpz_init(y);
+
+    printf(" prec  dr dJ dl  tr tJ tl     mpfr  default    tuned  default/tuned  mpfr/tuned\n");
+
+    for (prec=53; prec<30000; prec+=prec/4)
+    {
+        REPS = 200000 / (prec + 100);
+        if (REPS < 2)
+            REPS = 2;
+
+        mpz_set_ui(x, 37);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        mpfr_set_prec(mx, prec);
+        mpfr_set_prec(my, prec);
+        mpfr_set_str(mx, "0.37", 10, GMP_RNDN);
+
+        exp_default_params(prec, &dr, &dJ, &dlut);
+        exp_tuned_params(prec, &r, &J, &lut);
+
+        mpfr_time = default_time = tuned_time = 1e100;
+        for (i=0; i<5; i++)
+        {
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                mpfr_exp(my, mx, GMP_RNDN);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < mpfr_time)
+                mpfr_time = elapsed;
+
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                exp_series_lut(ctx, y, x, prec, dr, dJ, dlut);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < default_time)
+                default_time = elapsed;
+
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                exp_series_lut(ctx, y, x, prec, r, J, lut);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < tuned_time)
+                tuned_time = elapsed;
+        }
+
+        mpfr_time *= 1000;
+        default_time *= 1000;
+        tuned_time *= 1000;
+
+        printf("%5d %3d %2d %2d %3d %2d %2d %8d %8d %8d %14.3f %11.3f\n", prec, dr, dJ, dlut, r, J, lut,
+            (int)mpfr_time, (int)default_time, (int)tuned_time,
+            default_time/tuned_time, mpfr_time/tuned_time);
+    }
+
+    mpfr_clear(mx);
+    mpfr_clear(my);
+
+    mpz_clear(x);
+    mpz_clear(y);
+}
+
+/*
+exp(0.37) with exp_series (default r and J), exp_bitburst
+and mpfr_exp from 1000 bits up to 10^6 bits, to locate the crossover
+EXP_BITBURST_PREC. Times in microseconds.
+*/
+void benchmark_bitburst_exp(ffl_ctx_t ctx)
+{
+    int REPS;
+    int prec, i, k, r, J;
+    double t1, t2, elapsed;
+    double mpfr_time, series_time, burst_time;
+    int acc_series, acc_burst;
+
+    mpz_t x, y, dummy;
+    mpfr_t mx, my;
+
+    mpfr_init(mx);
+    mpfr_init(my);
+
+    mpz_init(x);
+    mpz_init(y);
+    mpz_init(dummy);
+
+    printf("    prec  acc_s  acc_b         mpfr       series     bitburst  series/burst  mpfr/burst\n");
+
+    for (prec=1000; prec<=1100000; prec*=2)
+    {
+        if (prec < 10000)
+            REPS = 20;
+        else if (prec < 100000)
+            REPS = 3;
+        else
+            REPS = 1;
+
+        mpz_set_ui(x, 37);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        mpfr_set_prec(mx, prec);
+        mpfr_set_prec(my, prec);
+        mpfr_set_str(mx, "0.37", 10, GMP_RNDN);
+
+        r = (int) sqrt(prec / 4.0);
+        J = 4;
+
+        mpfr_time = series_time = burst_time = 1e100;
+        for (i=0; i<3; i++)
+        {
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                mpfr_exp(my, mx, GMP_RNDN);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < mpfr_time)
+                mpfr_time = elapsed;
+
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                exp_series(ctx, y, dummy, x, prec, r, J, 2);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < series_time)
+                series_time = elapsed;
+        }
+        acc_series = fix_accuracy(y, prec, my);
+
+        for (i=0; i<3; i++)
+        {
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                exp_bitburst(ctx, y, x, prec);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < burst_time)
+                burst_time = elapsed;
+        }
+        acc_burst = fix_accuracy(y, prec, my);
 
+        printf("%8d %6d %6d %12.0f %12.0f %12.0f  %12.3f %11.3f\n", prec,
+            acc_series, acc_burst, mpfr_time, series_time, burst_time,
+            series_time/burst_time, mpfr_time/burst_time);
+        fflush(stdout);
     }
 
     mpfr_clear(mx);
@@ -375,17 +431,859 @@ void benchmark_optimize_exp()
     mpz_clear(x);
     mpz_clear(y);
     mpz_clear(dummy);
+}
+
+/*
+Each thread owns its context and output variables and evaluates
+the same argument REPS times. Only x is shared, and it is read-only.
+*/
+typedef struct
+{
+    mpz_srcptr x;
+    mpz_srcptr ref;
+    int prec;
+    int r;
+    int J;
+    int reps;
+    int mismatch;
+} exp_thread_arg;
+
+void *exp_thread_worker(void *arg)
+{
+    exp_thread_arg *a = (exp_thread_arg *) arg;
+    ffl_ctx_t ctx;
+    mpz_t y, dummy;
+    int k;
+
+    ffl_init(ctx);
+    mpz_init(y);
+    mpz_init(dummy);
+
+    for (k=0; k<a->reps; k++)
+    {
+        exp_series(ctx, y, dummy, (mpz_ptr) a->x, a->prec, a->r, a->J, 2);
+    }
+
+    a->mismatch = (mpz_cmp(y, a->ref) != 0);
 
+    mpz_clear(y);
+    mpz_clear(dummy);
+    ffl_clear(ctx);
+    return NULL;
 }
 
+/*
+Throughput of exp_series with 1..N threads, N = number of online cores
+unless given explicitly. Every thread does the same amount of work,
+so with perfect scaling the wall time stays constant and evals/s
+grows linearly.
+*/
+void benchmark_threads_exp(int ncpu)
+{
+    static const int precs[] = {53, 333, 1000, 3333, 10000};
+    exp_thread_arg args[64];
+    pthread_t threads[64];
+    ffl_ctx_t ctx;
+    mpz_t x, ref, dummy;
+    int nthreads, i, j, prec, r, J, REPS, mismatch;
+    double t1, t2, rate, base_rate;
+
+    if (ncpu < 1)
+        ncpu = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1)
+        ncpu = 1;
+    if (ncpu > 64)
+        ncpu = 64;
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(ref);
+    mpz_init(dummy);
+
+    printf(" prec threads     evals/s  speedup  efficiency  ok\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        r = 1;
+        while (r*r < prec/4)
+            r++;
+        J = 4;
+        REPS = 2000000 / (prec + 100);
+        if (REPS < 4)
+            REPS = 4;
+
+        mpz_set_ui(x, 37);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        exp_series(ctx, ref, dummy, x, prec, r, J, 2);
+
+        base_rate = 0;
+        for (nthreads=1; nthreads<=ncpu; nthreads++)
+        {
+            t1 = timing();
+            for (i=0; i<nthreads; i++)
+            {
+                args[i].x = x;
+                args[i].ref = ref;
+                args[i].prec = prec;
+                args[i].r = r;
+                args[i].J = J;
+                args[i].reps = REPS;
+                pthread_create(&threads[i], NULL, exp_thread_worker, &args[i]);
+            }
+            mismatch = 0;
+            for (i=0; i<nthreads; i++)
+            {
+                pthread_join(threads[i], NULL);
+                mismatch |= args[i].mismatch;
+            }
+            t2 = timing();
+
+            rate = 1e6 * nthreads * REPS / (t2-t1);
+            if (nthreads == 1)
+                base_rate = rate;
+
+            printf("%5d %7d %11.0f %8.2f %11.2f  %s\n", prec, nthreads, rate,
+                rate/base_rate, rate/base_rate/nthreads, mismatch ? "NO" : "yes");
+        }
+    }
 
+    mpz_clear(x);
+    mpz_clear(ref);
+    mpz_clear(dummy);
+    ffl_clear(ctx);
+}
 
-int main()
+/*
+Per-element cost of a batch of N arguments in [0, 0.37): a loop of
+single exp_series calls against exp_series_batch and, if more than
+one thread is requested, exp_series_batch_mt. "alias" checks an
+untimed batch of the negated arguments evaluated in place.
+*/
+void benchmark_batch_exp(int nthreads)
 {
-    fix_init_data();
+    static const int precs[] = {53, 113, 333, 1000, 3333};
+    const int N = 1000;
+    ffl_ctx_t *ctxs;
+    mpz_t *in, *out, *ref;
+    mpz_t dummy;
+    int i, j, k, prec, r, J, REPS, mismatch, alias_mismatch;
+    double t1, t2, single_time, batch_time, mt_time;
+
+    if (nthreads < 1)
+        nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+
+    ctxs = malloc(nthreads * sizeof(ffl_ctx_t));
+    for (i=0; i<nthreads; i++)
+    {
+        ffl_init(ctxs[i]);
+    }
+
+    in = malloc(N * sizeof(mpz_t));
+    out = malloc(N * sizeof(mpz_t));
+    ref = malloc(N * sizeof(mpz_t));
+    for (i=0; i<N; i++)
+    {
+        mpz_init(in[i]);
+        mpz_init(out[i]);
+        mpz_init(ref[i]);
+    }
+    mpz_init(dummy);
+
+    printf("batch of %d, %d thread(s), times in ns per element\n", N, nthreads);
+    printf(" prec      single       batch    batch_mt   speedup  mt_speedup  ok  alias\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        r = 1;
+        while (r*r < prec/4)
+            r++;
+        J = 4;
+        REPS = 20000 / (prec + 100);
+        if (REPS < 1)
+            REPS = 1;
+
+        for (i=0; i<N; i++)
+        {
+            mpz_set_ui(in[i], 37*i);
+            mpz_mul_2exp(in[i], in[i], prec);
+            mpz_div_ui(in[i], in[i], 100*N);
+        }
+
+        single_time = batch_time = mt_time = 1e100;
+        for (k=0; k<3; k++)
+        {
+            t1 = timing();
+            for (i=0; i<N*REPS; i++)
+            {
+                exp_series(ctxs[0], ref[i%N], dummy, in[i%N], prec, r, J, 2);
+            }
+            t2 = timing();
+            if (t2-t1 < single_time)
+                single_time = t2-t1;
+
+            t1 = timing();
+            for (i=0; i<REPS; i++)
+            {
+                exp_series_batch(ctxs[0], out, in, N, prec, r, J);
+            }
+            t2 = timing();
+            if (t2-t1 < batch_time)
+                batch_time = t2-t1;
+
+            t1 = timing();
+            for (i=0; i<REPS; i++)
+            {
+                exp_series_batch_mt(ctxs, out, in, N, prec, r, J, nthreads);
+            }
+            t2 = timing();
+            if (t2-t1 < mt_time)
+                mt_time = t2-t1;
+        }
+
+        mismatch = 0;
+        for (i=0; i<N; i++)
+        {
+            mismatch |= (mpz_cmp(out[i], ref[i]) != 0);
+        }
+
+        /* out[i] = exp(-in[i]) in place */
+        for (i=0; i<N; i++)
+        {
+            mpz_neg(out[i], in[i]);
+        }
+        exp_series_batch(ctxs[0], out, out, N, prec, r, J);
+
+        alias_mismatch = 0;
+        for (i=0; i<N; i++)
+        {
+            mpz_neg(in[i], in[i]);
+            exp_series(ctxs[0], ref[i], dummy, in[i], prec, r, J, 2);
+            mpz_neg(in[i], in[i]);
+            alias_mismatch |= (mpz_cmp(out[i], ref[i]) != 0);
+        }
+
+        single_time *= 1000.0 / (N*REPS);
+        batch_time *= 1000.0 / (N*REPS);
+        mt_time *= 1000.0 / (N*REPS);
+
+        printf("%5d %11.0f %11.0f %11.0f %9.3f %11.3f  %s  %s\n", prec, single_time,
+            batch_time, mt_time, single_time/batch_time, single_time/mt_time,
+            mismatch ? "NO" : "yes", alias_mismatch ? "NO" : "yes");
+    }
+
+    for (i=0; i<N; i++)
+    {
+        mpz_clear(in[i]);
+        mpz_clear(out[i]);
+        mpz_clear(ref[i]);
+    }
+    for (i=0; i<nthreads; i++)
+    {
+        ffl_clear(ctxs[i]);
+    }
+    free(ctxs);
+    free(in);
+    free(out);
+    free(ref);
+    mpz_clear(dummy);
+}
+
+typedef struct
+{
+    ffl_ctx_struct *ctx;
+    mpz_ptr y;
+    mpz_ptr x;
+    int prec;
+} exp_bench_arg;
+
+static void exp_bench_call(void *arg)
+{
+    exp_bench_arg *a = (exp_bench_arg *) arg;
+    ffl_exp(a->ctx, a->y, a->x, a->prec);
+}
+
+/*
+ffl_exp(0.37) through the benchmark harness, one line per precision
+in the given format (BENCH_TEXT, BENCH_CSV or BENCH_JSON), with the
+hardware and operation counts per call. Runs on cpu if cpu >= 0.
+Times in nanoseconds.
+*/
+void benchmark_suite_exp(int format, int cpu)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333, 10000, 33333};
+    ffl_ctx_t ctx;
+    mpz_t x, y;
+    exp_bench_arg arg;
+    bench_result res;
+    char params[64];
+    int j, prec, r, J, lut;
+
+    if (bench_pin_cpu(cpu) != 0)
+        fprintf(stderr, "could not pin to cpu %d\n", cpu);
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+
+    bench_report_header(format, 1);
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+
+        mpz_set_ui(x, 37);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        exp_tuned_params(prec, &r, &J, &lut);
+        snprintf(params, sizeof(params), "x=0.37 r=%d J=%d lut=%d", r, J, lut);
+
+        arg.ctx = ctx;
+        arg.y = y;
+        arg.x = x;
+        arg.prec = prec;
+        bench_run(&res, exp_bench_call, &arg, BENCH_SAMPLES, BENCH_SAMPLE_NS);
+        bench_count(&res, exp_bench_call, &arg, ctx);
+        bench_report(format, "exp", prec, params, &res);
+    }
+
+    mpz_clear(x);
+    mpz_clear(y);
+    ffl_clear(ctx);
+}
+
+typedef struct
+{
+    ffl_ctx_struct *ctx;
+    mpz_ptr y;
+    mpz_ptr x;
+    int prec;
+    int r;
+    int J;
+} exp_series_bench_arg;
+
+static void exp_series_bench_call(void *arg)
+{
+    exp_series_bench_arg *a = (exp_series_bench_arg *) arg;
+    exp_series(a->ctx, a->y, a->ctx->exp.t, a->x, a->prec, a->r, a->J, 2);
+}
+
+/*
+exp_series(0.37) at prec bits over a grid of (r, J), with the counts
+per call, to show why the fastest pair wins: fewer terms against more
+squarings (r), and fewer full multiplications in the series against
+more powers (J). The operation counts need a library built with
+STATS=1. Times in nanoseconds.
+*/
+void benchmark_counters_exp(int prec, int format)
+{
+    ffl_ctx_t ctx;
+    mpz_t x, y;
+    exp_series_bench_arg arg;
+    bench_result res;
+    char params[64];
+    int r, J, rstep, best_r, best_J;
+    double best_time;
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+
+    mpz_set_ui(x, 37);
+    mpz_mul_2exp(x, x, prec);
+    mpz_div_ui(x, x, 100);
+
+    rstep = (int) sqrt(prec + 30.0) / 12;
+    if (rstep < 1)
+        rstep = 1;
+
+    best_time = 1e100;
+    best_r = best_J = 0;
+
+    bench_report_header(format, 1);
+
+    for (J=1; J<MAX_SERIES_STEPS; J++)
+    {
+        for (r=0; r*r<prec+30; r+=rstep)
+        {
+            arg.ctx = ctx;
+            arg.y = y;
+            arg.x = x;
+            arg.prec = prec;
+            arg.r = r;
+            arg.J = J;
+            bench_run(&res, exp_series_bench_call, &arg, 5, BENCH_SAMPLE_NS / 2);
+            bench_count(&res, exp_series_bench_call, &arg, ctx);
+            snprintf(params, sizeof(params), "r=%d J=%d", r, J);
+            bench_report(format, "exp_series", prec, params, &res);
+
+            if (res.median < best_time)
+            {
+                best_time = res.median;
+                best_r = r;
+                best_J = J;
+            }
+        }
+    }
+
+    if (format == BENCH_TEXT)
+        printf("fastest: r=%d J=%d, %.0f ns\n", best_r, best_J, best_time);
+
+    mpz_clear(x);
+    mpz_clear(y);
+    ffl_clear(ctx);
+}
+
+/*
+ffl_exp and exp_series_lut with the default (r, J, lut) on n random
+arguments
+per precision (fewer above 1000 bits), log-uniform in [EXP_SWEEP_LO,
+EXP_SWEEP_HI) to cover small arguments too, against mpfr_exp; ffl_exp
+also on +-[EXP_SWEEP_LO, EXP_SWEEP_FULL_HI). Errors in bits (log2 of
+the error in ulps of y), times in nanoseconds.
+*/
+void benchmark_sweep_exp(int n)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333, 10000};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result res;
+    int j, prec, count, rJL[3];
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    printf(" prec  kernel            r  J lut      n  max_err  mean_err          worst_x      ns/call\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        exp_tuned_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+        bench_sweep(&res, ctx, exp_sweep_kernel, NULL, mpfr_exp, EXP_SWEEP_LO, EXP_SWEEP_HI, 1, count, prec, state);
+        printf("%5d  %-14s %3d %2d %3d %6d %8.2f %9.3f %16.12f %12.0f\n", prec, "ffl_exp",
+            rJL[0], rJL[1], rJL[2], res.n, res.max_err, res.mean_err, res.worst_x, res.ns);
+
+        bench_sweep(&res, ctx, exp_sweep_kernel, NULL, mpfr_exp, EXP_SWEEP_LO, EXP_SWEEP_FULL_HI, 1, count, prec, state);
+        printf("%5d  %-14s %3d %2d %3d %6d %8.2f %9.3f %16.10f %12.0f\n", prec, "ffl_exp full",
+            rJL[0], rJL[1], rJL[2], res.n, res.max_err, res.mean_err, res.worst_x, res.ns);
+
+        bench_sweep(&res, ctx, exp_neg_sweep_kernel, NULL, mpfr_exp_neg, EXP_SWEEP_LO, EXP_SWEEP_FULL_HI, 1, count, prec, state);
+        printf("%5d  %-14s %3d %2d %3d %6d %8.2f %9.3f %16.10f %12.0f\n", prec, "ffl_exp(-x)",
+            rJL[0], rJL[1], rJL[2], res.n, res.max_err, res.mean_err, res.worst_x, res.ns);
+
+        exp_default_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+        bench_sweep(&res, ctx, exp_series_sweep_kernel, rJL, mpfr_exp, EXP_SWEEP_LO, EXP_SWEEP_HI, 1, count, prec, state);
+        printf("%5d  %-14s %3d %2d %3d %6d %8.2f %9.3f %16.12f %12.0f\n", prec, "exp_series_lut",
+            rJL[0], rJL[1], rJL[2], res.n, res.max_err, res.mean_err, res.worst_x, res.ns);
+        fflush(stdout);
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+
+/*
+ffl_mpfr_exp against mpfr_exp on n random arguments per precision
+(fewer above 1000 bits), log-uniform in +-[EXP_SWEEP_LO,
+EXP_SWEEP_FULL_HI), in all rounding modes (see bench_mpfr_compare).
+Counts the results that differ from MPFR, which should be none, and
+times both end to end, conversions included, in nanoseconds.
+*/
+void benchmark_mpfr_exp(int n)
+{
+    static const int precs[] = {24, 53, 113, 333, 1000, 3333, 10000};
+    gmp_randstate_t state;
+    bench_mpfr_result res;
+    int j, prec, count;
+
+    gmp_randinit_default(state);
+
+    printf(" prec      n  wrong  ternary       ffl_ns      mpfr_ns  mpfr/ffl\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        bench_mpfr_compare(&res, ffl_mpfr_exp, mpfr_exp, EXP_SWEEP_LO, EXP_SWEEP_FULL_HI, 1, 1, count, prec, state);
+        printf("%5d %6d %6d %8d %12.0f %12.0f %9.2f\n", prec, res.n, res.wrong,
+            res.wrong_ternary, res.ns, res.ref_ns, res.ref_ns / res.ns);
+        fflush(stdout);
+    }
+
+    gmp_randclear(state);
+    ffl_mpfr_clear();
+}
+
+#ifdef FFL_FAST128
+/*
+exp_fast128 against exp_series_lut with the tuned (r, J, lut) on n
+random arguments per precision, log-uniform in +-[EXP_SWEEP_LO, 1/2)
+(the range exp_fast128 takes), against mpfr_exp. Both see the same
+arguments, after an untimed pass that fills the lookup table entries
+they hit. Errors in bits, times in nanoseconds.
+*/
+void benchmark_fast128_exp(int n)
+{
+    static const int precs[] = {24, 53, 64, 80, 100, 113, FAST128_PREC};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result fast, ser, fneg;
+    int j, prec, rJL[3];
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    printf(" prec      n  fast_err  series_err      fast_ns    series_ns  series/fast\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        exp_tuned_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&fast, ctx, exp_fast128_sweep_kernel, NULL, mpfr_exp,
+            EXP_SWEEP_LO, 0.5, 1, n, prec, state);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&fast, ctx, exp_fast128_sweep_kernel, NULL, mpfr_exp,
+            EXP_SWEEP_LO, 0.5, 1, n, prec, state);
+        bench_sweep(&fneg, ctx, exp_fast128_neg_sweep_kernel, NULL, mpfr_exp_neg,
+            EXP_SWEEP_LO, 0.5, 1, n, prec, state);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&ser, ctx, exp_series_sweep_kernel, rJL, mpfr_exp,
+            EXP_SWEEP_LO, 0.5, 1, n, prec, state);
+
+        printf("%5d %6d %9.2f %11.2f %12.0f %12.0f %12.2f\n", prec, n,
+            (fast.max_err > fneg.max_err) ? fast.max_err : fneg.max_err,
+            ser.max_err, fast.ns, ser.ns, ser.ns / fast.ns);
+        fflush(stdout);
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+#endif
+
+/*
+exp_series_mpn against exp_series with EXP_SERIES_DIRECT, the mpz_t
+kernel it replaces, on n random arguments per precision (fewer above
+1000 bits) with the same (r, J), against mpfr_exp. Row "lut" has the
+tuned (r, J) of exp_series_lut and arguments log-uniform in
+[2^-40, 2^-32), what is left after the tables; row "plain" has the
+(r, J) of benchmark_direct_exp and arguments log-uniform in
+[EXP_SWEEP_LO, 2^-EXP_DIRECT_BITS). Errors in bits, times in
+nanoseconds.
+*/
+void benchmark_mpn_exp(int n)
+{
+    static const int precs[] = {192, 333, 500, 1000, 2000, 3333, 4000, 8000};
+    static const char *names[] = {"lut", "plain"};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result mpn, ser;
+    double lo, hi;
+    int i, j, prec, count, lut, rJa[3];
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    printf(" prec  args     r  J limbs      n   mpn_err  mpz_err       mpn_ns       mpz_ns  mpz/mpn\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        for (i=0; i<2; i++)
+        {
+            if (i == 0)
+            {
+                exp_tuned_params(prec, &rJa[0], &rJa[1], &lut);
+                lo = ldexp(1.0, -40);
+                hi = ldexp(1.0, -32);
+            }
+            else
+            {
+                rJa[0] = (int) sqrt(prec / 4.0);
+                rJa[1] = (prec < 300) ? 2 : 4;
+                lo = EXP_SWEEP_LO;
+                hi = ldexp(1.0, -EXP_DIRECT_BITS);
+            }
+            rJa[2] = 2 | EXP_SERIES_DIRECT;
+
+            gmp_randseed_ui(state, prec);
+            bench_sweep(&mpn, ctx, exp_series_mpn_sweep_kernel, rJa, mpfr_exp,
+                lo, hi, 1, count, prec, state);
+
+            gmp_randseed_ui(state, prec);
+            bench_sweep(&ser, ctx, exp_series_alt_sweep_kernel, rJa, mpfr_exp,
+                lo, hi, 1, count, prec, state);
+
+            printf("%5d  %-5s %3d %2d %5d %6d %9.2f %8.2f %12.0f %12.0f %8.2f\n", prec, names[i],
+                rJa[0], rJa[1], series_mpn_limbs(prec + 2*rJa[0] + 10), count,
+                mpn.max_err, ser.max_err, mpn.ns, ser.ns, ser.ns / mpn.ns);
+            fflush(stdout);
+        }
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+
+/*
+exp_series with s recovered by a square root against the direct odd
+series (EXP_SERIES_DIRECT), for sinh, sin and exp with the usual
+(r, J) without lookup tables, on n random arguments per precision,
+log-uniform in [EXP_SWEEP_LO, EXP_SWEEP_HI). Errors in bits of s (of
+c for exp), times in nanoseconds.
+*/
+void benchmark_direct_exp(int n)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333, 10000, 30000};
+    static const char *names[] = {"sinh", "sin", "exp"};
+    static const bench_mpfr_fn refs[] = {mpfr_sinh, mpfr_sin, mpfr_exp};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result sq, di;
+    int j, alt, prec, count, rJa[3];
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    printf(" prec  fn      r  J      n  sqrt_err  direct_err      sqrt_ns    direct_ns  sqrt/direct\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        /* (r, J) for exp_series without the lookup tables */
+        rJa[0] = (int) sqrt(prec / 4.0);
+        rJa[1] = (prec < 300) ? 2 : 4;
+
+        for (alt=0; alt<3; alt++)
+        {
+            /* the same arguments for both */
+            gmp_randseed_ui(state, prec);
+            rJa[2] = alt;
+            bench_sweep(&sq, ctx, exp_series_alt_sweep_kernel, rJa, refs[alt],
+                EXP_SWEEP_LO, EXP_SWEEP_HI, 1, count, prec, state);
+
+            gmp_randseed_ui(state, prec);
+            rJa[2] = alt | EXP_SERIES_DIRECT;
+            bench_sweep(&di, ctx, exp_series_alt_sweep_kernel, rJa, refs[alt],
+                EXP_SWEEP_LO, EXP_SWEEP_HI, 1, count, prec, state);
+
+            printf("%5d  %-5s %3d %2d %6d %9.2f %11.2f %12.0f %12.0f %12.3f\n", prec, names[alt],
+                rJa[0], rJa[1], count, sq.max_err, di.max_err, sq.ns, di.ns, sq.ns / di.ns);
+            fflush(stdout);
+        }
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+
+typedef struct
+{
+    mpfr_ptr y;
+    mpfr_ptr x;
+} mpfr_exp_bench_arg;
+
+static void mpfr_exp_bench_call(void *arg)
+{
+    mpfr_exp_bench_arg *a = (mpfr_exp_bench_arg *) arg;
+    mpfr_exp(a->y, a->x, MPFR_RNDN);
+}
+
+/*
+ffl_exp against mpfr_exp over argument magnitudes from 0.0037 to 3700,
+both signs, to check that the argument reduction keeps the cost flat.
+Median times in nanoseconds.
+*/
+void benchmark_range_exp(void)
+{
+    static const int precs[] = {53, 333, 3333};
+    static const double xs[] = {0.0037, 0.37, 3.7, 37, 370, 3700};
+    ffl_ctx_t ctx;
+    mpz_t x, y;
+    mpfr_t mx, my;
+    exp_bench_arg arg;
+    mpfr_exp_bench_arg marg;
+    bench_result res, mres;
+    int i, j, sign, n, prec;
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+    mpfr_init(mx);
+    mpfr_init(my);
+
+    printf(" prec          x      n      ffl_exp     mpfr_exp   mpfr/ffl\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        mpfr_set_prec(mx, prec + 16);
+        mpfr_set_prec(my, prec);
+
+        for (i=0; i<(int)(sizeof(xs)/sizeof(xs[0])); i++)
+        {
+            for (sign=1; sign>=-1; sign-=2)
+            {
+                /* x = sign * xs[i] to prec fractional bits, mx = x */
+                mpfr_set_d(mx, sign * xs[i], MPFR_RNDN);
+                mpfr_mul_2ui(mx, mx, prec, MPFR_RNDN);
+                mpfr_get_z(x, mx, MPFR_RNDZ);
+                mpfr_set_z_2exp(mx, x, -prec, MPFR_RNDN);
+
+                arg.ctx = ctx;
+                arg.y = y;
+                arg.x = x;
+                arg.prec = prec;
+                bench_run(&res, exp_bench_call, &arg, BENCH_SAMPLES, BENCH_SAMPLE_NS);
+
+                marg.y = my;
+                marg.x = mx;
+                bench_run(&mres, mpfr_exp_bench_call, &marg, BENCH_SAMPLES, BENCH_SAMPLE_NS);
+
+                n = ffl_exp(ctx, y, x, prec);
+                printf("%5d %10.4f %6d %12.0f %12.0f %10.3f\n", prec, sign * xs[i], n,
+                    res.median, mres.median, mres.median / res.median);
+                fflush(stdout);
+            }
+        }
+    }
+
+    mpfr_clear(mx);
+    mpfr_clear(my);
+    mpz_clear(x);
+    mpz_clear(y);
+    ffl_clear(ctx);
+}
+
+int main(int argc, char *argv[])
+{
+    ffl_ctx_t ctx;
+
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+    {
+        /* exptest bench [text|csv|json] [cpu] */
+        int format = argc > 2 ? bench_parse_format(argv[2]) : BENCH_TEXT;
+        if (format < 0)
+        {
+            printf("usage: exptest bench [text|csv|json] [cpu]\n");
+            return 1;
+        }
+        benchmark_suite_exp(format, argc > 3 ? atoi(argv[3]) : -1);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "counters"))
+    {
+        /* exptest counters [prec [text|csv|json]] */
+        int format = argc > 3 ? bench_parse_format(argv[3]) : BENCH_TEXT;
+        if (format < 0)
+        {
+            printf("usage: exptest counters [prec [text|csv|json]]\n");
+            return 1;
+        }
+        benchmark_counters_exp(argc > 2 ? atoi(argv[2]) : 1000, format);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "sweep"))
+    {
+        benchmark_sweep_exp(argc > 2 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "mpfr"))
+    {
+        benchmark_mpfr_exp(argc > 2 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "mpn"))
+    {
+        benchmark_mpn_exp(argc > 2 ? atoi(argv[2]) : 1000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "fast128"))
+    {
+#ifdef FFL_FAST128
+        benchmark_fast128_exp(argc > 2 ? atoi(argv[2]) : 2000);
+#else
+        printf("built without FFL_FAST128\n");
+#endif
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "range"))
+    {
+        benchmark_range_exp();
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "direct"))
+    {
+        benchmark_direct_exp(argc > 2 ? atoi(argv[2]) : 1000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "threads"))
+    {
+        benchmark_threads_exp(argc > 2 ? atoi(argv[2]) : 0);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "bitburst"))
+    {
+        ffl_init(ctx);
+        benchmark_bitburst_exp(ctx);
+        ffl_clear(ctx);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "batch"))
+    {
+        benchmark_batch_exp(argc > 2 ? atoi(argv[2]) : 0);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "tuned"))
+    {
+        if (load_exp_tuning(argc > 2 ? argv[2] : EXP_TUNE_FILE) <= 0)
+            printf("no tuning data, using defaults\n");
+        ffl_init(ctx);
+        benchmark_tuned_exp(ctx);
+        ffl_clear(ctx);
+        return 0;
+    }
+
+    ffl_init(ctx);
 
-    benchmark_optimize_exp();
+    benchmark_optimize_exp(ctx, argc > 1 ? argv[1] : EXP_TUNE_FILE);
 
-    fix_clear_data();
+    ffl_clear(ctx);
 }
 
@@ -0,0 +1,541 @@
+/*
+Benchmark harness shared by the test programs.
+
+bench_run times a kernel call on the monotonic clock: it warms up,
+picks the number of calls per sample so that a sample lasts at least
+the requested time (well above the clock resolution), and keeps every
+sample so that the median, the percentiles and a confidence interval
+for the median can be reported instead of a single best time.
+bench_count adds the hardware counters (through perf_event_open) and
+the operation counts of the context per call, to show where the time
+goes. bench_report prints one result per line as text, CSV or JSON, so
+runs of two builds can be compared with diff or a script.
+
+bench_sweep checks a kernel on random arguments against MPFR, since a
+single argument says little about the error elsewhere in the domain.
+*/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <gmp.h>
+#include <mpfr.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "fastfun.h"
+
+/* Nanoseconds on the monotonic clock */
+double bench_clock()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return 1e9 * (double) t.tv_sec + (double) t.tv_nsec;
+}
+
+/*
+Binds the calling thread to cpu, or does nothing for cpu < 0.
+Returns 0 on success, -1 on failure.
+*/
+int bench_pin_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0)
+        return -1;
+
+    return 0;
+}
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Sample at fraction q of the sorted t[0..n-1], interpolating linearly */
+static double bench_quantile(const double *t, int n, double q)
+{
+    double pos = q * (n - 1);
+    int i = (int) pos;
+
+    if (i >= n - 1)
+        return t[n-1];
+
+    return t[i] + (pos - i) * (t[i+1] - t[i]);
+}
+
+/*
+Times fn(arg) and fills res with the statistics of the time per call,
+in nanoseconds. Calls are made in batches of res->reps, and samples
+(at most BENCH_MAX_SAMPLES) batches are timed after a warmup. reps is
+doubled until a batch lasts at least sample_ns. Nothing is allocated,
+so fn may be timed from several threads at once.
+*/
+void bench_run(bench_result *res, bench_fn fn, void *arg, int samples, double sample_ns)
+{
+    double t[BENCH_MAX_SAMPLES];
+    double t1, t2, h;
+    int reps, i, k, lo, hi;
+
+    if (samples < 1)
+        samples = 1;
+    if (samples > BENCH_MAX_SAMPLES)
+        samples = BENCH_MAX_SAMPLES;
+
+    /* Warmup, which also finds the batch size */
+    reps = 1;
+    for (;;)
+    {
+        t1 = bench_clock();
+        for (k=0; k<reps; k++)
+            fn(arg);
+        t2 = bench_clock();
+        if (t2 - t1 >= sample_ns || reps >= (1 << 30))
+            break;
+        reps *= 2;
+    }
+
+    for (i=0; i<samples; i++)
+    {
+        t1 = bench_clock();
+        for (k=0; k<reps; k++)
+            fn(arg);
+        t2 = bench_clock();
+        t[i] = (t2 - t1) / reps;
+    }
+
+    qsort(t, samples, sizeof(double), bench_cmp_double);
+
+    res->reps = reps;
+    res->samples = samples;
+    res->counted = 0;
+    res->min = t[0];
+    res->median = bench_quantile(t, samples, 0.5);
+    res->p10 = bench_quantile(t, samples, 0.1);
+    res->p90 = bench_quantile(t, samples, 0.9);
+
+    /*
+    95% confidence interval of the median from the order statistics:
+    the number of samples below the median is binomial(samples, 1/2).
+    */
+    h = 0.98 * sqrt((double) samples);
+    lo = (int) floor(0.5 * samples - h);
+    hi = (int) ceil(0.5 * samples + h);
+    if (lo < 0)
+        lo = 0;
+    if (hi > samples - 1)
+        hi = samples - 1;
+    res->ci_lo = t[lo];
+    res->ci_hi = t[hi];
+}
+
+/*
+Opens the hardware counter BENCH_CYCLES etc. for the calling thread,
+user space only and disabled. Returns the file descriptor, or -1 if
+the counter is not available (no PMU, as in many virtual machines, or
+perf_event_paranoid too high).
+*/
+static int bench_perf_open(int counter)
+{
+#ifdef __linux__
+    static const unsigned long long config[BENCH_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config[counter];
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void) counter;
+    return -1;
+#endif
+}
+
+/*
+Runs fn(arg) res->reps times (as found by bench_run) and sets the
+hardware counters and the operation counts of ctx per call. Call it
+after bench_run, so the counters stay out of the timings.
+*/
+void bench_count(bench_result *res, bench_fn fn, void *arg, ffl_ctx_t ctx)
+{
+    int fd[BENCH_COUNTERS];
+    long long v;
+    ffl_stats_struct before;
+    int i, k, reps;
+
+    reps = res->reps > 0 ? res->reps : 1;
+
+    for (i=0; i<BENCH_COUNTERS; i++)
+        fd[i] = bench_perf_open(i);
+
+    before = ctx->stats;
+
+#ifdef __linux__
+    for (i=0; i<BENCH_COUNTERS; i++)
+    {
+        if (fd[i] >= 0)
+        {
+            ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+
+    for (k=0; k<reps; k++)
+        fn(arg);
+
+    for (i=0; i<BENCH_COUNTERS; i++)
+    {
+        res->hw[i] = -1;
+        if (fd[i] < 0)
+            continue;
+#ifdef __linux__
+        ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd[i], &v, sizeof(v)) == sizeof(v))
+            res->hw[i] = (double) v / reps;
+#endif
+        close(fd[i]);
+    }
+
+    if (ffl_stats_enabled())
+    {
+        res->muls = (double) (ctx->stats.muls - before.muls) / reps;
+        res->divs = (double) (ctx->stats.divs - before.divs) / reps;
+        res->divs_ui = (double) (ctx->stats.divs_ui - before.divs_ui) / reps;
+        res->sqrts = (double) (ctx->stats.sqrts - before.sqrts) / reps;
+        res->terms = (double) (ctx->stats.terms - before.terms) / reps;
+    }
+    else
+    {
+        res->muls = res->divs = res->divs_ui = res->sqrts = res->terms = -1;
+    }
+
+    res->counted = 1;
+}
+
+/*
+Evaluates f at n random arguments in [lo, hi) with prec bits (uniform,
+or uniform in log(x) if logscale is set), and compares each result
+with ref evaluated 32 bits more precisely. Only the kernel calls are
+timed, after a first untimed pass over the same arguments, so that
+the lazy tables, constants and coefficients f needs are already
+built and the times are those of the steady state.
+*/
+void bench_sweep(bench_sweep_result *res, ffl_ctx_t ctx, bench_kernel f, void *param,
+    bench_mpfr_fn ref, double lo, double hi, int logscale, int n, int prec, gmp_randstate_t state)
+{
+    mpfr_t u, r, t;
+    mpz_t *x;
+    mpz_t xt, y;
+    long e;
+    double m, err, sum, t1, t2, time;
+    int i, k;
+
+    mpfr_init2(u, prec + 64);
+    mpfr_init2(r, prec + 32);
+    mpfr_init2(t, prec + 32);
+    mpz_init(xt);
+    mpz_init(y);
+
+    x = malloc(n * sizeof(mpz_t));
+    for (i=0; i<n; i++)
+    {
+        mpfr_urandomb(u, state);
+        if (logscale)
+        {
+            mpfr_mul_d(u, u, log(hi / lo), MPFR_RNDN);
+            mpfr_exp(u, u, MPFR_RNDN);
+            mpfr_mul_d(u, u, lo, MPFR_RNDN);
+        }
+        else
+        {
+            mpfr_mul_d(u, u, hi - lo, MPFR_RNDN);
+            mpfr_add_d(u, u, lo, MPFR_RNDN);
+        }
+        mpfr_mul_2ui(u, u, prec, MPFR_RNDN);
+        mpz_init(x[i]);
+        mpfr_get_z(x[i], u, MPFR_RNDZ);
+    }
+
+    /* f gets a copy, since some kernels negate x in place */
+    for (i=0; i<n; i++)
+    {
+        mpz_set(xt, x[i]);
+        f(ctx, y, xt, prec, param);
+    }
+
+    res->n = n;
+    res->max_err = 0;
+    res->worst_x = lo;
+    sum = 0;
+    time = 0;
+
+    for (i=0; i<n; i++)
+    {
+        mpz_set(xt, x[i]);
+        t1 = bench_clock();
+        k = f(ctx, y, xt, prec, param);
+        t2 = bench_clock();
+        time += t2 - t1;
+
+        /* u = x exactly */
+        mpfr_set_z_2exp(u, x[i], -prec, MPFR_RNDN);
+        ref(r, u, MPFR_RNDN);
+
+        /* error in units of 2^(k-prec) */
+        mpfr_set_prec(t, mpz_sizeinbase(y, 2) + 1);
+        mpfr_set_z_2exp(t, y, k - prec, MPFR_RNDN);
+        mpfr_sub(t, t, r, MPFR_RNDN);
+        err = 0;
+        if (!mpfr_zero_p(t))
+        {
+            m = mpfr_get_d_2exp(&e, t, MPFR_RNDN);
+            err = log2(fabs(m)) + e + prec - k;
+            if (err < 0)
+                err = 0;
+        }
+
+        sum += err;
+        if (err > res->max_err)
+        {
+            res->max_err = err;
+            res->worst_x = mpfr_get_d(u, MPFR_RNDN);
+        }
+    }
+
+    res->mean_err = sum / n;
+    res->ns = time / n;
+
+    for (i=0; i<n; i++)
+        mpz_clear(x[i]);
+    free(x);
+
+    mpfr_clear(u);
+    mpfr_clear(r);
+    mpfr_clear(t);
+    mpz_clear(xt);
+    mpz_clear(y);
+}
+
+/*
+Compares f, a correctly rounded replacement such as ffl_mpfr_exp, with
+the MPFR function ref on n random arguments with prec bits drawn as in
+bench_sweep (every other one negated if signs is set), cycling through
+the rounding modes. Counts the results and the signs of the ternary
+values that differ. Both are timed per call, conversions included,
+after a first untimed pass over the same arguments, so that the lazy
+tables and caches they need on either side are already filled and the
+times are those of the steady state.
+*/
+void bench_mpfr_compare(bench_mpfr_result *res, bench_mpfr_fn f, bench_mpfr_fn ref,
+    double lo, double hi, int logscale, int signs, int n, int prec, gmp_randstate_t state)
+{
+    static const mpfr_rnd_t rnds[] = {MPFR_RNDN, MPFR_RNDZ, MPFR_RNDU, MPFR_RNDD, MPFR_RNDA};
+    mpfr_t *u;
+    mpfr_t y, r;
+    mpfr_rnd_t rnd;
+    double t1, t2, t3;
+    int i, a, b;
+
+    u = malloc(n * sizeof(mpfr_t));
+    for (i=0; i<n; i++)
+    {
+        mpfr_init2(u[i], prec);
+        mpfr_urandomb(u[i], state);
+        if (logscale)
+        {
+            mpfr_mul_d(u[i], u[i], log(hi / lo), MPFR_RNDN);
+            mpfr_exp(u[i], u[i], MPFR_RNDN);
+            mpfr_mul_d(u[i], u[i], lo, MPFR_RNDN);
+        }
+        else
+        {
+            mpfr_mul_d(u[i], u[i], hi - lo, MPFR_RNDN);
+            mpfr_add_d(u[i], u[i], lo, MPFR_RNDN);
+        }
+        if (signs && i % 2)
+            mpfr_neg(u[i], u[i], MPFR_RNDN);
+    }
+    mpfr_init2(y, prec);
+    mpfr_init2(r, prec);
+
+    res->n = n;
+    res->wrong = 0;
+    res->wrong_ternary = 0;
+    res->worst_x = lo;
+    res->ns = 0;
+    res->ref_ns = 0;
+
+    /* the first pass only warms up */
+    for (i=0; i<n; i++)
+    {
+        f(y, u[i], rnds[i % 5]);
+        ref(r, u[i], rnds[i % 5]);
+    }
+
+    for (i=0; i<n; i++)
+    {
+        rnd = rnds[i % 5];
+
+        t1 = bench_clock();
+        a = f(y, u[i], rnd);
+        t2 = bench_clock();
+        b = ref(r, u[i], rnd);
+        t3 = bench_clock();
+
+        res->ns += t2 - t1;
+        res->ref_ns += t3 - t2;
+        if (!mpfr_equal_p(y, r))
+        {
+            res->wrong++;
+            res->worst_x = mpfr_get_d(u[i], MPFR_RNDN);
+        }
+        if ((a > 0) != (b > 0) || (a < 0) != (b < 0))
+            res->wrong_ternary++;
+    }
+
+    res->ns /= n;
+    res->ref_ns /= n;
+
+    for (i=0; i<n; i++)
+        mpfr_clear(u[i]);
+    free(u);
+    mpfr_clear(y);
+    mpfr_clear(r);
+}
+
+/* BENCH_TEXT, BENCH_CSV or BENCH_JSON for "text", "csv" or "json", else -1 */
+int bench_parse_format(const char *s)
+{
+    if (!strcmp(s, "text"))
+        return BENCH_TEXT;
+    if (!strcmp(s, "csv"))
+        return BENCH_CSV;
+    if (!strcmp(s, "json"))
+        return BENCH_JSON;
+    return -1;
+}
+
+/*
+Column names of the counters in bench_report, in the order of
+BENCH_CYCLES etc. followed by the operation counts.
+*/
+static const char *bench_count_names[BENCH_COUNTERS+5] = {
+    "cycles", "instructions", "cache_misses", "branch_misses",
+    "muls", "divs", "divs_ui", "sqrts", "terms"};
+
+void bench_report_header(int format, int counters)
+{
+    int i;
+
+    if (format == BENCH_TEXT)
+    {
+        printf("%-10s %6s  %-22s %6s %2s %10s %10s %10s %10s %10s %10s", "kernel", "prec",
+            "params", "reps", "n", "median", "ci_low", "ci_high", "p10", "p90", "min");
+        if (counters)
+        {
+            printf(" %12s %12s %8s %8s", "cycles", "insns", "cmiss", "bmiss");
+            printf(" %7s %7s %7s %7s %7s", "muls", "divs", "div_ui", "sqrts", "terms");
+        }
+        printf("\n");
+    }
+    else if (format == BENCH_CSV)
+    {
+        printf("kernel,prec,params,reps,samples,median_ns,ci_low_ns,ci_high_ns,p10_ns,p90_ns,min_ns");
+        if (counters)
+        {
+            for (i=0; i<BENCH_COUNTERS+5; i++)
+                printf(",%s", bench_count_names[i]);
+        }
+        printf("\n");
+    }
+}
+
+/*
+One line for kernel at prec bits; params describes the remaining
+arguments (no commas or quotes). JSON output is one object per line.
+Counts that are not available are printed as -, empty or null.
+*/
+void bench_report(int format, const char *kernel, int prec, const char *params, const bench_result *res)
+{
+    double c[BENCH_COUNTERS+5];
+    int i;
+
+    for (i=0; i<BENCH_COUNTERS; i++)
+        c[i] = res->hw[i];
+    c[BENCH_COUNTERS] = res->muls;
+    c[BENCH_COUNTERS+1] = res->divs;
+    c[BENCH_COUNTERS+2] = res->divs_ui;
+    c[BENCH_COUNTERS+3] = res->sqrts;
+    c[BENCH_COUNTERS+4] = res->terms;
+
+    if (format == BENCH_CSV)
+    {
+        printf("%s,%d,%s,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f", kernel, prec,
+            params, res->reps, res->samples, res->median, res->ci_lo, res->ci_hi,
+            res->p10, res->p90, res->min);
+        for (i=0; res->counted && i<BENCH_COUNTERS+5; i++)
+        {
+            if (c[i] < 0)
+                printf(",");
+            else
+                printf(",%.1f", c[i]);
+        }
+        printf("\n");
+    }
+    else if (format == BENCH_JSON)
+    {
+        printf("{\"kernel\": \"%s\", \"prec\": %d, \"params\": \"%s\", \"reps\": %d, "
+            "\"samples\": %d, \"median_ns\": %.1f, \"ci_low_ns\": %.1f, \"ci_high_ns\": %.1f, "
+            "\"p10_ns\": %.1f, \"p90_ns\": %.1f, \"min_ns\": %.1f", kernel, prec,
+            params, res->reps, res->samples, res->median, res->ci_lo, res->ci_hi,
+            res->p10, res->p90, res->min);
+        for (i=0; res->counted && i<BENCH_COUNTERS+5; i++)
+        {
+            if (c[i] < 0)
+                printf(", \"%s\": null", bench_count_names[i]);
+            else
+                printf(", \"%s\": %.1f", bench_count_names[i], c[i]);
+        }
+        printf("}\n");
+    }
+    else
+    {
+        printf("%-10s %6d  %-22s %6d %2d %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f",
+            kernel, prec, params, res->reps, res->samples, res->median, res->ci_lo,
+            res->ci_hi, res->p10, res->p90, res->min);
+        for (i=0; res->counted && i<BENCH_COUNTERS+5; i++)
+        {
+            if (c[i] < 0)
+                printf(" %*s", i < 2 ? 12 : i < BENCH_COUNTERS ? 8 : 7, "-");
+            else
+                printf(" %*.0f", i < 2 ? 12 : i < BENCH_COUNTERS ? 8 : 7, c[i]);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,502 @@
+/*
+Mathematical constants.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "fastfun.h"
+
+/*
+Cached constants, shared by all threads and published like the lazy
+exp tables: a slot points to the most precise node computed so far,
+installed with a single compare-and-swap, and a node it replaces stays
+reachable through next until clear_constants. A request for fewer bits
+than the cache holds is served by a shift; a request for more
+recomputes the constant by binary splitting with at least
+CONST_GROWTH times the bits of the cached node, so that a slowly
+rising precision only recomputes O(log(prec)) times.
+*/
+typedef struct const_node
+{
+    mpz_t value;
+    int prec;
+    struct const_node *next;
+} const_node;
+
+static const_node *_Atomic const_cache[CONST_COUNT];
+
+/*
+Binary splitting for the Chudnovsky series over [a, b):
+
+  T/Q = sum_{k=a}^{b-1} prod_{j=a}^{k} p(j)/q(j) * (13591409 + 545140134 k)
+
+with p(j) = -(6j-5)(2j-1)(6j-1), q(j) = j^3 640320^3/24 for j > 0
+and p(0) = q(0) = 1, P = prod p(j). P is left untouched when want_P
+is zero.
+*/
+static void const_pi_bsplit(mpz_t P, mpz_t Q, mpz_t T, int a, int b, int want_P)
+{
+    int m;
+    mpz_t P2, Q2, T2;
+
+    if (b - a == 1)
+    {
+        if (a == 0)
+        {
+            mpz_set_ui(P, 1);
+            mpz_set_ui(Q, 1);
+        }
+        else
+        {
+            mpz_set_ui(P, 6*a-5);
+            mpz_mul_ui(P, P, 2*a-1);
+            mpz_mul_ui(P, P, 6*a-1);
+            mpz_set_ui(Q, a);
+            mpz_mul_ui(Q, Q, a);
+            mpz_mul_ui(Q, Q, a);
+            mpz_mul_ui(Q, Q, 10939058860032000UL);
+            mpz_neg(P, P);
+        }
+        mpz_mul_ui(T, P, 545140134UL);
+        mpz_mul_ui(T, T, a);
+        mpz_addmul_ui(T, P, 13591409UL);
+        return;
+    }
+
+    m = a + (b - a) / 2;
+
+    mpz_init(P2);
+    mpz_init(Q2);
+    mpz_init(T2);
+
+    const_pi_bsplit(P, Q, T, a, m, 1);
+    const_pi_bsplit(P2, Q2, T2, m, b, want_P);
+
+    /* T = T1*Q2 + P1*T2 */
+    mpz_mul(T, T, Q2);
+    mpz_mul(T2, T2, P);
+    mpz_add(T, T, T2);
+
+    mpz_mul(Q, Q, Q2);
+    if (want_P)
+        mpz_mul(P, P, P2);
+
+    mpz_clear(P2);
+    mpz_clear(Q2);
+    mpz_clear(T2);
+}
+
+/*
+y = pi with wp bits by the Chudnovsky formula
+
+  pi = 426880 sqrt(10005) / sum_k (-1)^k (6k)! (13591409 + 545140134 k)
+                                   / ((3k)! k!^3 640320^(3k)),
+
+each term adding about 47.1 bits.
+*/
+static void const_pi_eval(mpz_t y, int wp)
+{
+    mpz_t P, Q, T;
+    int N;
+
+    N = wp / 47 + 2;
+
+    mpz_init(P);
+    mpz_init(Q);
+    mpz_init(T);
+
+    const_pi_bsplit(P, Q, T, 0, N, 0);
+
+    /* y = 426880 sqrt(10005) Q / T */
+    mpz_set_ui(P, 10005);
+    mpz_mul_2exp(P, P, 2*wp);
+    mpz_sqrt(P, P);
+    mpz_mul(P, P, Q);
+    mpz_mul_ui(P, P, 426880);
+    mpz_tdiv_q(y, P, T);
+
+    mpz_clear(P);
+    mpz_clear(Q);
+    mpz_clear(T);
+}
+
+/*
+Binary splitting for atanh(1/q) over [a, b):
+
+  T/(B*Q) = sum_{k=a}^{b-1} 1/((2k+1) q(a) ... q(k)),
+
+with q(0) = q and q(k) = q^2 for k > 0, B = prod (2k+1).
+*/
+static void const_atanh_bsplit(mpz_t Q, mpz_t B, mpz_t T, unsigned long q, int a, int b)
+{
+    int m;
+    mpz_t Q2, B2, T2;
+
+    if (b - a == 1)
+    {
+        mpz_set_ui(Q, q);
+        if (a != 0)
+            mpz_mul_ui(Q, Q, q);
+        mpz_set_ui(B, 2*a+1);
+        mpz_set_ui(T, 1);
+        return;
+    }
+
+    m = a + (b - a) / 2;
+
+    mpz_init(Q2);
+    mpz_init(B2);
+    mpz_init(T2);
+
+    const_atanh_bsplit(Q, B, T, q, a, m);
+    const_atanh_bsplit(Q2, B2, T2, q, m, b);
+
+    /* T = T1*B2*Q2 + B1*T2 */
+    mpz_mul(T, T, B2);
+    mpz_mul(T, T, Q2);
+    mpz_mul(T2, T2, B);
+    mpz_add(T, T, T2);
+
+    mpz_mul(Q, Q, Q2);
+    mpz_mul(B, B, B2);
+
+    mpz_clear(Q2);
+    mpz_clear(B2);
+    mpz_clear(T2);
+}
+
+/* y = atanh(1/q) with wp bits, for q >= 2 */
+static void const_atanh_inv(mpz_t y, unsigned long q, int wp)
+{
+    mpz_t Q, B, T;
+    int N;
+
+    /* term k is below q^-(2k+1) */
+    N = (int) ((wp + 2) / (2 * log2((double) q))) + 1;
+
+    mpz_init(Q);
+    mpz_init(B);
+    mpz_init(T);
+
+    const_atanh_bsplit(Q, B, T, q, 0, N);
+    mpz_mul(Q, Q, B);
+    mpz_mul_2exp(T, T, wp);
+    mpz_tdiv_q(y, T, Q);
+
+    mpz_clear(Q);
+    mpz_clear(B);
+    mpz_clear(T);
+}
+
+/*
+y = log(2) with wp bits from
+
+  log(2) = 18 atanh(1/26) - 2 atanh(1/4801) + 8 atanh(1/8749),
+
+the series together adding about 9.4 bits per term of the first.
+*/
+static void const_ln2_eval(mpz_t y, int wp)
+{
+    mpz_t t;
+
+    mpz_init(t);
+
+    const_atanh_inv(t, 26, wp);
+    mpz_mul_ui(y, t, 18);
+    const_atanh_inv(t, 4801, wp);
+    mpz_submul_ui(y, t, 2);
+    const_atanh_inv(t, 8749, wp);
+    mpz_addmul_ui(y, t, 8);
+
+    mpz_clear(t);
+}
+
+/*
+y = Euler's constant with prec bits, by the Brent-McMillan formula
+
+  gamma = U/V - log(n) + O(exp(-4n)),
+  U = sum_k (n^k/k!)^2 (H_k - log(n)),  V = sum_k (n^k/k!)^2,
+
+with n a power of two so that log(n) is a multiple of log(2), summed
+term by term. This is O(prec^2), but beats the binary splitting in
+const_euler_eval below CONST_EULER_BSPLIT_PREC.
+*/
+void const_euler_direct(mpz_t y, int prec)
+{
+    mpz_t a, b, u, v;
+    unsigned long n;
+    int wp, j, k;
+
+    wp = prec + 30;
+
+    for (j=0, n=1; 5*n < (unsigned long) wp + 2; j++)
+        n *= 2;
+
+    mpz_init(a);
+    mpz_init(b);
+    mpz_init(u);
+    mpz_init(v);
+
+    const_ln2(a, wp);
+    mpz_mul_si(a, a, -j);
+    mpz_fixed_one(b, wp);
+    mpz_set(u, a);
+    mpz_set(v, b);
+
+    /* A_k = (A_{k-1} n^2/k + B_k)/k, B_k = B_{k-1} n^2/k^2 */
+    for (k=1; ; k++)
+    {
+        mpz_mul_ui(b, b, n);
+        mpz_mul_ui(b, b, n);
+        mpz_tdiv_q_ui(b, b, k);
+        mpz_tdiv_q_ui(b, b, k);
+        mpz_mul_ui(a, a, n);
+        mpz_mul_ui(a, a, n);
+        mpz_tdiv_q_ui(a, a, k);
+        mpz_add(a, a, b);
+        mpz_tdiv_q_ui(a, a, k);
+        if ((unsigned long) k > n && mpz_sgn(a) == 0 && mpz_sgn(b) == 0)
+            break;
+        mpz_add(u, u, a);
+        mpz_add(v, v, b);
+    }
+
+    mpz_mul_2exp(u, u, wp);
+    mpz_tdiv_q(y, u, v);
+    mpz_tdiv_q_2exp(y, y, wp-prec);
+
+    mpz_clear(a);
+    mpz_clear(b);
+    mpz_clear(u);
+    mpz_clear(v);
+}
+
+/*
+Binary splitting for the Brent-McMillan sums over k in [a, b), with
+t_k = prod_{j=a}^{k} n^2/j^2 and h_k = sum_{j=a}^{k} 1/j for n = 2^e:
+
+  T/Q = sum t_k,  V/(D*Q) = sum t_k h_k,  C/D = h_(b-1),
+
+with Q = prod j^2, D = prod j. The products of n^2 are shifts.
+*/
+static void const_euler_bsplit(mpz_t Q, mpz_t D, mpz_t C, mpz_t T, mpz_t V,
+    int e, int a, int b)
+{
+    int m;
+    mpz_t Q2, D2, C2, T2, V2;
+
+    if (b - a == 1)
+    {
+        mpz_set_ui(Q, a);
+        mpz_mul_ui(Q, Q, a);
+        mpz_set_ui(D, a);
+        mpz_set_ui(C, 1);
+        mpz_set_ui(T, 1);
+        mpz_mul_2exp(T, T, 2*e);
+        mpz_set(V, T);
+        return;
+    }
+
+    m = a + (b - a) / 2;
+
+    mpz_init(Q2);
+    mpz_init(D2);
+    mpz_init(C2);
+    mpz_init(T2);
+    mpz_init(V2);
+
+    const_euler_bsplit(Q, D, C, T, V, e, a, m);
+    const_euler_bsplit(Q2, D2, C2, T2, V2, e, m, b);
+
+    /* V = V1*D2*Q2 + n^(2(m-a))*(C1*D2*T2 + D1*V2), C = C1*D2 + D1*C2 */
+    mpz_mul(V, V, D2);
+    mpz_mul(V, V, Q2);
+    mpz_mul(C, C, D2);
+    mpz_mul(V2, V2, D);
+    mpz_addmul(V2, C, T2);
+    mpz_mul_2exp(V2, V2, (mp_bitcnt_t) 2 * e * (m - a));
+    mpz_add(V, V, V2);
+    mpz_addmul(C, C2, D);
+
+    /* T = T1*Q2 + n^(2(m-a))*T2 */
+    mpz_mul(T, T, Q2);
+    mpz_mul_2exp(T2, T2, (mp_bitcnt_t) 2 * e * (m - a));
+    mpz_add(T, T, T2);
+
+    mpz_mul(Q, Q, Q2);
+    mpz_mul(D, D, D2);
+
+    mpz_clear(Q2);
+    mpz_clear(D2);
+    mpz_clear(C2);
+    mpz_clear(T2);
+    mpz_clear(V2);
+}
+
+/*
+y = Euler's constant with wp bits by the same formula as
+const_euler_direct, with both sums by binary splitting:
+
+  gamma = U/V - log(n),  V = sum_k t_k,  U = sum_k t_k H_k,
+
+t_k = (n^k/k!)^2. The integers grow to O(wp log(wp)) bits, so below
+CONST_EULER_BSPLIT_PREC this uses const_euler_direct instead.
+*/
+static void const_euler_eval(mpz_t y, int wp)
+{
+    mpz_t Q, D, C, T, V;
+    unsigned long n;
+    double lt;
+    int j, K;
+
+    if (wp < CONST_EULER_BSPLIT_PREC)
+    {
+        const_euler_direct(y, wp);
+        return;
+    }
+
+    for (j=0, n=1; 5*n < (unsigned long) wp + 2; j++)
+        n *= 2;
+
+    /* t_K H_K < 2^-(wp+10) past the peak at k = n */
+    lt = 0;
+    for (K=1; ; K++)
+    {
+        lt += 2 * log2((double) n / K);
+        if ((unsigned long) K > n && lt + log2(log((double) K) + 1) < -(wp + 10))
+            break;
+    }
+
+    mpz_init(Q);
+    mpz_init(D);
+    mpz_init(C);
+    mpz_init(T);
+    mpz_init(V);
+
+    const_euler_bsplit(Q, D, C, T, V, j, 1, K+1);
+
+    /* y = V/(D*(Q+T)) - j log(2) */
+    mpz_add(T, T, Q);
+    mpz_mul(T, T, D);
+    mpz_mul_2exp(V, V, wp);
+    mpz_tdiv_q(y, V, T);
+    const_ln2(T, wp);
+    mpz_submul_ui(y, T, j);
+
+    mpz_clear(Q);
+    mpz_clear(D);
+    mpz_clear(C);
+    mpz_clear(T);
+    mpz_clear(V);
+}
+
+/*
+Returns the cached node for constant c with at least wp bits,
+computing and publishing it first if needed. The *_eval routines are
+called with CONST_GUARD extra bits, and the result is truncated so
+that the node is accurate to its own last place.
+*/
+static const_node *const_get(int c, int wp)
+{
+    _Atomic(const_node *) *slot = &const_cache[c];
+    const_node *node, *expected;
+    int prec;
+
+    node = atomic_load_explicit(slot, memory_order_acquire);
+    if (node != NULL && node->prec >= wp)
+        return node;
+
+    prec = wp + CONST_EXTRA;
+    if (node != NULL && prec < node->prec * CONST_GROWTH)
+        prec = (int) (node->prec * CONST_GROWTH);
+
+    node = malloc(sizeof(const_node));
+    mpz_init(node->value);
+    if (c == CONST_PI)
+        const_pi_eval(node->value, prec + CONST_GUARD);
+    else if (c == CONST_LN2)
+        const_ln2_eval(node->value, prec + CONST_GUARD);
+    else
+        const_euler_eval(node->value, prec + CONST_GUARD);
+    mpz_tdiv_q_2exp(node->value, node->value, CONST_GUARD);
+    node->prec = prec;
+
+    expected = atomic_load_explicit(slot, memory_order_acquire);
+    do
+    {
+        if (expected != NULL && expected->prec >= wp)
+        {
+            mpz_clear(node->value);
+            free(node);
+            return expected;
+        }
+        node->next = expected;
+    }
+    while (!atomic_compare_exchange_weak_explicit(slot, &expected, node,
+        memory_order_acq_rel, memory_order_acquire));
+
+    return node;
+}
+
+/*
+y = constant c (CONST_PI, CONST_LN2 or CONST_EULER) as a fixed-point
+number with prec bits, truncated from the cache, so that y is within
+one unit of the last place.
+*/
+void ffl_const(mpz_t y, int c, int prec)
+{
+    const_node *node;
+
+    node = const_get(c, prec);
+    mpz_tdiv_q_2exp(y, node->value, node->prec - prec);
+}
+
+void const_pi(mpz_t y, int prec)
+{
+    ffl_const(y, CONST_PI, prec);
+}
+
+void const_ln2(mpz_t y, int prec)
+{
+    ffl_const(y, CONST_LN2, prec);
+}
+
+void const_euler(mpz_t y, int prec)
+{
+    ffl_const(y, CONST_EULER, prec);
+}
+
+/* Bits of constant c in the cache, 0 if it has not been computed */
+int const_cached_prec(int c)
+{
+    const_node *node;
+
+    node = atomic_load_explicit(&const_cache[c], memory_order_acquire);
+    return node != NULL ? node->prec : 0;
+}
+
+/*
+Frees the cached constants. Not thread-safe: no other thread may be
+evaluating.
+*/
+void clear_constants()
+{
+    const_node *node, *next;
+    int c;
+
+    for (c=0; c<CONST_COUNT; c++)
+    {
+        node = atomic_exchange_explicit(&const_cache[c], NULL, memory_order_acq_rel);
+        while (node != NULL)
+        {
+            next = node->next;
+            mpz_clear(node->value);
+            free(node);
+            node = next;
+        }
+    }
+}
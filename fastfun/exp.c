@@ -0,0 +1,1041 @@
+/*
+Exponential and trigonometric functions.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include <pthread.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "fastfun.h"
+
+/*
+Tuned (r, J, lut) for exp_series_lut, indexed by precision in steps of
+TUNE_PREC_STEP bits, filled by load_exp_tuning. A zero J means
+untuned.
+*/
+unsigned char exp_tune_r[TUNE_SIZE];
+unsigned char exp_tune_J[TUNE_SIZE];
+unsigned char exp_tune_lut[TUNE_SIZE];
+
+/*
+Lookup tables for exp_series_lut, filled lazily and shared by all
+threads. They are published like the log tables in log.c: a slot
+points to the most precise node computed so far, installed with a
+single compare-and-swap, and a node it replaces stays reachable
+through next. Nodes are only freed by clear_exp_lut.
+*/
+typedef struct exp_lut_node
+{
+    mpz_t value;
+    int prec;
+    struct exp_lut_node *next;
+} exp_lut_node;
+
+static exp_lut_node *_Atomic exp_lut_lazy[EXP_LUT_SLOTS];
+
+void exp_init_data(ffl_ctx_t ctx)
+{
+    int i;
+    mpz_init(ctx->exp.x);
+    mpz_init(ctx->exp.x2);
+    mpz_init(ctx->exp.one);
+    mpz_init(ctx->exp.t);
+    mpz_init(ctx->exp.a);
+    mpz_init(ctx->exp.s0);
+    mpz_init(ctx->exp.s1);
+    mpz_init(ctx->exp.one2);
+    mpz_init(ctx->exp.xt);
+    mpz_init(ctx->exp.ln2);
+    mpz_init(ctx->exp.xl);
+    mpz_init(ctx->exp.xr);
+    mpz_init(ctx->exp.b);
+    for (i=0; i<MAX_SERIES_STEPS; i++)
+    {
+        mpz_init(ctx->exp.pows[i]);
+        mpz_init(ctx->exp.sums[i]);
+        mpz_init(ctx->exp.odd[i]);
+    }
+    ctx->exp.prec = ctx->exp.r = ctx->exp.wp = -1;
+}
+
+void exp_clear_data(ffl_ctx_t ctx)
+{
+    int i;
+    mpz_clear(ctx->exp.x);
+    mpz_clear(ctx->exp.x2);
+    mpz_clear(ctx->exp.one);
+    mpz_clear(ctx->exp.t);
+    mpz_clear(ctx->exp.a);
+    mpz_clear(ctx->exp.s0);
+    mpz_clear(ctx->exp.s1);
+    mpz_clear(ctx->exp.one2);
+    mpz_clear(ctx->exp.xt);
+    mpz_clear(ctx->exp.ln2);
+    mpz_clear(ctx->exp.xl);
+    mpz_clear(ctx->exp.xr);
+    mpz_clear(ctx->exp.b);
+    for (i=0; i<MAX_SERIES_STEPS; i++)
+    {
+        mpz_clear(ctx->exp.pows[i]);
+        mpz_clear(ctx->exp.sums[i]);
+        mpz_clear(ctx->exp.odd[i]);
+    }
+}
+
+/*
+First version -- uses Taylor series for exp(x) directly,
+broken into two pieces
+
+Note: this version is currently not used by the benchmarks
+*/
+void fix_exp(ffl_ctx_t ctx, mpz_t z, mpz_t x, int prec)
+{
+    int k;
+    int r = 8;
+    //prec += 20;
+    //mpz_set(ctx->exp.x, x);
+    //mpz_tdiv_q_2exp(ctx->exp.x, ctx->exp.x, r);
+    mpz_tdiv_q_2exp(ctx->exp.x, x, r);
+    mpz_set_ui(ctx->exp.s0, 1);
+    mpz_mul_2exp(ctx->exp.s0, ctx->exp.s0, prec);
+    mpz_set(ctx->exp.s1, ctx->exp.s0);
+    mpz_mul(ctx->exp.x2, ctx->exp.x, ctx->exp.x);
+    mpz_tdiv_q_2exp(ctx->exp.x2,ctx->exp.x2,prec);
+    mpz_set(ctx->exp.a, ctx->exp.x2);
+    k = 2;
+    while(1)
+    {
+        mpz_tdiv_q_ui(ctx->exp.a, ctx->exp.a, k);
+        if (mpz_sgn(ctx->exp.a) == 0)
+            break;
+        mpz_add(ctx->exp.s0, ctx->exp.s0, ctx->exp.a);
+        k += 1;
+        mpz_tdiv_q_ui(ctx->exp.a, ctx->exp.a, k);
+        if (mpz_sgn(ctx->exp.a) == 0)
+            break;
+        mpz_add(ctx->exp.s1, ctx->exp.s1, ctx->exp.a);
+        k += 1;
+        mpz_mul(ctx->exp.a, ctx->exp.a, ctx->exp.x2);
+        mpz_tdiv_q_2exp(ctx->exp.a,ctx->exp.a,prec);
+        if (mpz_sgn(ctx->exp.a) == 0)
+            break;
+    }
+    mpz_mul(ctx->exp.s1, ctx->exp.s1, ctx->exp.x);
+    mpz_tdiv_q_2exp(ctx->exp.s1,ctx->exp.s1,prec);
+    mpz_add(ctx->exp.s0, ctx->exp.s0, ctx->exp.s1);
+    for(k=0; k<r; k++)
+    {
+        mpz_mul(ctx->exp.s0, ctx->exp.s0, ctx->exp.s0);
+        mpz_tdiv_q_2exp(ctx->exp.s0,ctx->exp.s0,prec);
+    }
+    //mpz_tdiv_q_ui(z, ctx->exp.s0, 20);
+    mpz_set(z, ctx->exp.s0);
+}
+
+
+
+/*
+Computes the exponential / trigonometric series
+
+  alt = 0  -- c = cosh(x), s = sinh(x)
+  alt = 1  -- c = cos(x), s = sin(x)
+  alt = 2  -- c = exp(x), s = n/a
+
+using the cosh/sinh series. By default only the even series is
+summed and the odd part is recovered as sqrt(|1-c^2|), which costs a
+full-precision square root and loses accuracy for small x. With
+alt | EXP_SERIES_DIRECT the odd series is summed alongside the even
+one (sharing the powers of x^2) and (c, s) are carried through the
+duplication steps instead. Parameters:
+
+  prec -- 
+  r    -- number of argument reductions
+  J    -- number of partitions of the series
+
+*/
+void exp_series(ffl_ctx_t ctx, mpz_t c, mpz_t s, mpz_t x, int prec, int r, int J, int alt)
+{
+    exp_series_setup(ctx, prec, r);
+    exp_series_eval(ctx, c, s, x, J, alt);
+}
+
+/*
+Everything in exp_series that depends only on (prec, r): the working
+precision, the fixed-point constants, and the scratch allocations
+(products are formed at 2*wp bits before truncation). A no-op when
+the context is already set up for (prec, r).
+*/
+void exp_series_setup(ffl_ctx_t ctx, int prec, int r)
+{
+    int i, wp;
+
+    if (ctx->exp.prec == prec && ctx->exp.r == r)
+        return;
+
+    wp = prec + 2*r + 10;
+
+    ctx->exp.prec = prec;
+    ctx->exp.r = r;
+    ctx->exp.wp = wp;
+
+    mpz_fixed_one(ctx->exp.one, wp);
+    mpz_fixed_one(ctx->exp.one2, 2*wp);
+
+    mpz_reserve(ctx->exp.x, 2*wp+64);
+    mpz_reserve(ctx->exp.a, 2*wp+64);
+    mpz_reserve(ctx->exp.b, 2*wp+64);
+    for (i=0; i<MAX_SERIES_STEPS; i++)
+    {
+        mpz_reserve(ctx->exp.pows[i], 2*wp+64);
+        mpz_reserve(ctx->exp.sums[i], 2*wp+64);
+        mpz_reserve(ctx->exp.odd[i], 2*wp+64);
+    }
+}
+
+/*
+exp_series for a context already set up by exp_series_setup.
+*/
+void exp_series_eval(ffl_ctx_t ctx, mpz_t c, mpz_t s, mpz_t x, int J, int alt)
+{
+    int i, k;
+    int prec = ctx->exp.prec;
+    int r = ctx->exp.r;
+    int wp = ctx->exp.wp;
+    int direct = alt & EXP_SERIES_DIRECT;
+    int neg = mpz_sgn(x) < 0;   /* c or s may alias x */
+
+    alt &= ~EXP_SERIES_DIRECT;
+
+    /*   x / 2^r, adjusted to wp   */
+    mpz_mul_2exp(ctx->exp.x, x, wp-prec);
+    mpz_tdiv_q_2exp(ctx->exp.x, ctx->exp.x, r);
+    if (direct)
+        mpz_set(ctx->exp.xr, ctx->exp.x);
+
+    if (J < 1)
+        J = 1;
+    
+    for (i=0; i<J; i++)
+    {
+        if (i == 0)
+        {
+            mpz_set(ctx->exp.pows[i], ctx->exp.one);
+        }
+        else if (i == 1)
+        {
+            mpz_mul(ctx->exp.pows[i], ctx->exp.x, ctx->exp.x);
+            mpz_tdiv_q_2exp(ctx->exp.pows[i], ctx->exp.pows[i], wp);
+        }
+        else
+        {
+            mpz_mul(ctx->exp.pows[i], ctx->exp.pows[i-1], ctx->exp.pows[1]);
+            mpz_tdiv_q_2exp(ctx->exp.pows[i], ctx->exp.pows[i], wp);
+        }
+        mpz_set_ui(ctx->exp.sums[i], 0);
+        mpz_set_ui(ctx->exp.odd[i], 0);
+    }
+    FFL_COUNT(ctx, muls, J);
+
+    if (J == 1)
+    {
+        mpz_mul(ctx->exp.x, ctx->exp.x, ctx->exp.x);
+        mpz_tdiv_q_2exp(ctx->exp.x, ctx->exp.x, wp);
+        mpz_set(ctx->exp.a, ctx->exp.x);
+    }
+    else
+    {
+        mpz_mul(ctx->exp.x, ctx->exp.pows[J-1], ctx->exp.pows[1]);
+        mpz_tdiv_q_2exp(ctx->exp.x, ctx->exp.x, wp);
+        mpz_set(ctx->exp.a, ctx->exp.pows[1]);
+    }
+
+    /*
+    a runs through the terms x^2k/(2k)! of the even series and b
+    through the terms x^2k/(2k+1)! of sinh(x)/x; b <= a, so both
+    are exhausted when a is
+    */
+    if (direct)
+        mpz_set(ctx->exp.b, ctx->exp.a);
+
+    k = 2;
+    while (mpz_sgn(ctx->exp.a) != 0)
+    {
+        for (i=0; i<J; i++)
+        {
+            mpz_tdiv_q_ui(ctx->exp.a, ctx->exp.a, (k-1)*k);
+            if (direct)
+                mpz_tdiv_q_ui(ctx->exp.b, ctx->exp.b, k*(k+1));
+            if ((alt == 1) && (k & 2))
+            {
+                mpz_sub(ctx->exp.sums[i], ctx->exp.sums[i], ctx->exp.a);
+                if (direct)
+                    mpz_sub(ctx->exp.odd[i], ctx->exp.odd[i], ctx->exp.b);
+            }
+            else
+            {
+                mpz_add(ctx->exp.sums[i], ctx->exp.sums[i], ctx->exp.a);
+                if (direct)
+                    mpz_add(ctx->exp.odd[i], ctx->exp.odd[i], ctx->exp.b);
+            }
+            k += 2;
+        }
+        mpz_mul(ctx->exp.a, ctx->exp.a, ctx->exp.x);
+        mpz_tdiv_q_2exp(ctx->exp.a, ctx->exp.a, wp);
+        FFL_COUNT(ctx, terms, J);
+        FFL_COUNT(ctx, divs_ui, J);
+        FFL_COUNT(ctx, muls, 1);
+        if (direct)
+        {
+            mpz_mul(ctx->exp.b, ctx->exp.b, ctx->exp.x);
+            mpz_tdiv_q_2exp(ctx->exp.b, ctx->exp.b, wp);
+            FFL_COUNT(ctx, divs_ui, J);
+            FFL_COUNT(ctx, muls, 1);
+        }
+    }
+
+    for (i=1; i<J; i++)
+    {
+        mpz_mul(ctx->exp.sums[i], ctx->exp.sums[i], ctx->exp.pows[i]);
+        mpz_tdiv_q_2exp(ctx->exp.sums[i], ctx->exp.sums[i], wp);
+    }
+    FFL_COUNT(ctx, muls, J-1);
+
+    mpz_set(c, ctx->exp.one);
+    for (i=0; i<J; i++)
+    {
+        mpz_add(c, c, ctx->exp.sums[i]);
+    }
+
+    if (direct)
+    {
+        for (i=1; i<J; i++)
+        {
+            mpz_mul(ctx->exp.odd[i], ctx->exp.odd[i], ctx->exp.pows[i]);
+            mpz_tdiv_q_2exp(ctx->exp.odd[i], ctx->exp.odd[i], wp);
+        }
+        mpz_set(s, ctx->exp.one);
+        for (i=0; i<J; i++)
+        {
+            mpz_add(s, s, ctx->exp.odd[i]);
+        }
+        mpz_mul(s, s, ctx->exp.xr);
+        mpz_tdiv_q_2exp(s, s, wp);
+        FFL_COUNT(ctx, muls, J);
+    }
+
+    /*
+    Repeatedly apply the duplication formula
+
+      cosh(2*x) = 2*cosh(x)^2 - 1
+      cos(2*x) = 2*cos(x)^2 - 1
+      exp(2*x) = exp(x)^2
+
+    and, with EXP_SERIES_DIRECT,
+
+      sinh(2*x) = 2*sinh(x)*cosh(x)
+      sin(2*x) = 2*sin(x)*cos(x)
+    */
+
+    if (direct && alt == 2)
+    {
+        mpz_add(c, c, s);
+        for (i=0; i<r; i++)
+        {
+            mpz_mul(c, c, c);
+            mpz_tdiv_q_2exp(c, c, wp);
+        }
+        FFL_COUNT(ctx, muls, r);
+    }
+    else if (direct)
+    {
+        for (i=0; i<r; i++)
+        {
+            mpz_mul(s, s, c);
+            mpz_tdiv_q_2exp(s, s, wp-1);
+            mpz_mul(c, c, c);
+            mpz_tdiv_q_2exp(c, c, wp-1);
+            mpz_sub(c, c, ctx->exp.one);
+        }
+        FFL_COUNT(ctx, muls, 2*r);
+    }
+    else if (alt == 2)
+    {
+        /* s = sqrt(|1-c^2|), with the sign of sinh(x) */
+        mpz_mul(s, c, c);
+        mpz_sub(s, ctx->exp.one2, s);
+        mpz_abs(s, s);
+        mpz_sqrt(s, s);
+        if (neg)
+            mpz_neg(s, s);
+        mpz_add(c, c, s);
+        for (i=0; i<r; i++)
+        {
+            mpz_mul(c, c, c);
+            mpz_tdiv_q_2exp(c, c, wp);
+        }
+        FFL_COUNT(ctx, muls, r+1);
+        FFL_COUNT(ctx, sqrts, 1);
+    }
+    else
+    {
+        for (i=0; i<r; i++)
+        {
+            mpz_mul(c, c, c);
+            mpz_tdiv_q_2exp(c, c, wp-1);
+            mpz_sub(c, c, ctx->exp.one);
+        }
+        /* s = sqrt(|1-c^2|) */
+        mpz_mul(s, c, c);
+        mpz_sub(s, ctx->exp.one2, s);
+        mpz_abs(s, s);
+        mpz_sqrt(s, s);
+        FFL_COUNT(ctx, muls, r+1);
+        FFL_COUNT(ctx, sqrts, 1);
+    }
+
+    mpz_tdiv_q_2exp(c, c, wp-prec);
+    mpz_tdiv_q_2exp(s, s, wp-prec);
+
+}
+
+/*
+Binary splitting for the Taylor series of exp(p/2^q) over [a, b):
+
+  T/(Q*2^(q*(b-a))) = sum_{n=a}^{b-1} prod_{k=a}^{n} p/(k*2^q)
+  P/(Q*2^(q*(b-a))) = prod_{k=a}^{b-1} p/(k*2^q)
+
+P is not needed for the rightmost interval and is left untouched
+when want_P is zero.
+*/
+void exp_bsplit(mpz_t P, mpz_t Q, mpz_t T, mpz_t p, int q, int a, int b, int want_P)
+{
+    int m;
+    mpz_t P2, Q2, T2;
+
+    if (b - a == 1)
+    {
+        mpz_set(P, p);
+        mpz_set_ui(Q, a);
+        mpz_set(T, p);
+        return;
+    }
+
+    m = a + (b - a) / 2;
+
+    mpz_init(P2);
+    mpz_init(Q2);
+    mpz_init(T2);
+
+    exp_bsplit(P, Q, T, p, q, a, m, 1);
+    exp_bsplit(P2, Q2, T2, p, q, m, b, want_P);
+
+    /* T = T1*Q2*2^(q*(b-m)) + P1*T2 */
+    mpz_mul(T, T, Q2);
+    mpz_mul_2exp(T, T, (mp_bitcnt_t) q * (b - m));
+    mpz_mul(T2, T2, P);
+    mpz_add(T, T, T2);
+
+    mpz_mul(Q, Q, Q2);
+    if (want_P)
+        mpz_mul(P, P, P2);
+
+    mpz_clear(P2);
+    mpz_clear(Q2);
+    mpz_clear(T2);
+}
+
+/*
+y = exp(p/2^q) as a fixed-point number with wp bits, computed by
+binary splitting. p/2^q may have any size: the number of terms is
+taken from its magnitude, so |p| >= 2^q (as in the first chunk of
+exp_bitburst, which holds the integer part of x) only costs more
+terms.
+*/
+void exp_bsplit_fixed(mpz_t y, mpz_t p, int q, int wp)
+{
+    int N;
+    double mag, bits;
+    mpz_t P, Q, T;
+
+    if (mpz_sgn(p) == 0)
+    {
+        mpz_fixed_one(y, wp);
+        return;
+    }
+
+    /* smallest N with |x|^N/N! < 2^-(wp+2) */
+    mag = q - (double) mpz_sizeinbase(p, 2);
+    N = 1;
+    bits = mag;
+    while (bits < wp + 2)
+    {
+        N++;
+        bits += mag + log2((double) N);
+    }
+
+    mpz_init(P);
+    mpz_init(Q);
+    mpz_init(T);
+
+    exp_bsplit(P, Q, T, p, q, 1, N+1, 0);
+
+    /* y = 1 + T/(Q*2^(q*N)) */
+    if ((double) wp >= (double) q * N)
+        mpz_mul_2exp(T, T, wp - (mp_bitcnt_t) q * N);
+    else
+        mpz_mul_2exp(Q, Q, (mp_bitcnt_t) q * N - wp);
+    mpz_tdiv_q(y, T, Q);
+    mpz_fixed_one(P, wp);
+    mpz_add(y, y, P);
+
+    mpz_clear(P);
+    mpz_clear(Q);
+    mpz_clear(T);
+}
+
+/*
+y = exp(x) for a fixed-point x with prec bits, using the bit-burst
+algorithm: x is split into chunks x_0 + x_1 + ... where chunk k holds
+the fractional bits (2^(k-1)*8, 2^k*8] (the integer part goes into
+x_0), exp(x_k) is computed by binary splitting, and the factors are
+multiplied together. Chunk k has a numerator of 2^(k-1)*8 bits and is
+smaller than 2^-(2^(k-1)*8), so each binary splitting costs about the
+same, giving O(M(prec) log(prec)^2) overall.
+*/
+void exp_bitburst(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    int wp, q, qprev;
+
+    wp = prec + 2*(int)log2((double) prec + 1) + 10;
+
+    /* t = |x| at wp bits, s = the current chunk */
+    mpz_mul_2exp(ctx->exp.t, x, wp-prec);
+    mpz_abs(ctx->exp.t, ctx->exp.t);
+    mpz_fixed_one(y, wp);
+
+    qprev = 0;
+    for (q=8; qprev<wp; q*=2)
+    {
+        if (q > wp)
+            q = wp;
+
+        /* p = bits (2^-qprev, 2^-q] of t, i.e. t = p/2^q + rest */
+        mpz_tdiv_q_2exp(ctx->exp.s0, ctx->exp.t, wp-q);
+        mpz_tdiv_r_2exp(ctx->exp.t, ctx->exp.t, wp-q);
+
+        if (mpz_sgn(ctx->exp.s0) != 0)
+        {
+            if (mpz_sgn(x) < 0)
+                mpz_neg(ctx->exp.s0, ctx->exp.s0);
+            exp_bsplit_fixed(ctx->exp.s1, ctx->exp.s0, q, wp);
+            mpz_mul(y, y, ctx->exp.s1);
+            mpz_tdiv_q_2exp(y, y, wp);
+        }
+
+        qprev = q;
+    }
+
+    mpz_tdiv_q_2exp(y, y, wp-prec);
+}
+
+/*
+Level 0 has the k in [-EXP_LUT_SIZE/2, EXP_LUT_SIZE/2) (for |x| < 1/2),
+every higher level the k in [0, EXP_LUT_SIZE).
+*/
+static int exp_lut_index(int level, int k)
+{
+    if (level == 0)
+        return k + EXP_LUT_SIZE/2;
+    return level * EXP_LUT_SIZE + k;
+}
+
+/*
+y = exp(k/2^(EXP_LUT_STEP*(level+1))) as a fixed-point number with
+prec bits, by binary splitting.
+*/
+void exp_lut_entry(mpz_t y, int level, int k, int prec)
+{
+    mpz_t p;
+
+    mpz_init(p);
+    mpz_set_si(p, k);
+    exp_bsplit_fixed(y, p, EXP_LUT_STEP*(level+1), prec);
+    mpz_clear(p);
+}
+
+/*
+Entry k of the given level with at least wp bits, computing and
+publishing it if needed (unless another thread got there first).
+*eprec is set to the precision of the entry.
+*/
+static mpz_srcptr exp_lut_get(int level, int k, int wp, int *eprec)
+{
+    _Atomic(exp_lut_node *) *slot = &exp_lut_lazy[exp_lut_index(level, k)];
+    exp_lut_node *node, *expected;
+    int prec;
+
+    node = atomic_load_explicit(slot, memory_order_acquire);
+    if (node != NULL && node->prec >= wp)
+    {
+        *eprec = node->prec;
+        return node->value;
+    }
+
+    prec = EXP_LUT_PREC;
+    while (prec < wp)
+        prec *= 2;
+
+    node = malloc(sizeof(exp_lut_node));
+    mpz_init(node->value);
+    exp_lut_entry(node->value, level, k, prec);
+    node->prec = prec;
+
+    expected = atomic_load_explicit(slot, memory_order_acquire);
+    do
+    {
+        if (expected != NULL && expected->prec >= wp)
+        {
+            mpz_clear(node->value);
+            free(node);
+            *eprec = expected->prec;
+            return expected->value;
+        }
+        node->next = expected;
+    }
+    while (!atomic_compare_exchange_weak_explicit(slot, &expected, node,
+        memory_order_acq_rel, memory_order_acquire));
+
+    *eprec = prec;
+    return node->value;
+}
+
+/*
+y = exp(x) for a fixed-point x with prec bits, removing lut levels of
+s = EXP_LUT_STEP bits each with the lookup tables first:
+
+  x = k_0/2^s + k_1/2^(2s) + ... + k_(lut-1)/2^(lut*s) + t,
+
+with 0 <= t < 2^-(lut*s), so that exp(x) is exp(t) times the table
+entries of the nonzero k_i, one multiplication each. exp(t) comes
+from exp_series_mpn (exp_series with EXP_SERIES_DIRECT); t being
+small, r can be much smaller than without the tables. lut = 0, or
+|x| >= 1/2, is plain exp_series (exp_series_mpn for small x, see
+EXP_DIRECT_BITS).
+*/
+void exp_series_lut(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J, int lut)
+{
+    int i, wp, eprec, levels;
+    int idx[EXP_LUT_LEVELS];
+    mpz_srcptr e;
+
+    levels = lut;
+    if (levels < 0)
+        levels = 0;
+    if (levels > EXP_LUT_LEVELS)
+        levels = EXP_LUT_LEVELS;
+
+    if (levels == 0 || (long) mpz_sizeinbase(x, 2) >= prec)
+    {
+        if ((long) mpz_sizeinbase(x, 2) <= prec - EXP_DIRECT_BITS)
+            exp_series_mpn(ctx, y, x, prec, r, J);
+        else
+            exp_series(ctx, y, ctx->exp.t, x, prec, r, J, 2);
+        return;
+    }
+
+    /* a few guard bits for the products */
+    wp = prec + 10;
+
+    /* k_i = successive EXP_LUT_STEP-bit chunks of x (k_0 floored), xl = t */
+    mpz_mul_2exp(ctx->exp.xl, x, wp-prec);
+    mpz_fdiv_q_2exp(ctx->exp.a, ctx->exp.xl, wp-EXP_LUT_STEP);
+    idx[0] = mpz_get_si(ctx->exp.a);
+    mpz_fdiv_r_2exp(ctx->exp.xl, ctx->exp.xl, wp-EXP_LUT_STEP);
+    for (i=1; i<levels; i++)
+    {
+        mpz_tdiv_q_2exp(ctx->exp.a, ctx->exp.xl, wp-EXP_LUT_STEP*(i+1));
+        idx[i] = mpz_get_si(ctx->exp.a);
+        mpz_tdiv_r_2exp(ctx->exp.xl, ctx->exp.xl, wp-EXP_LUT_STEP*(i+1));
+    }
+
+    exp_series_mpn(ctx, y, ctx->exp.xl, wp, r, J);
+
+    for (i=0; i<levels; i++)
+    {
+        if (idx[i] == 0)
+            continue;
+        e = exp_lut_get(i, idx[i], wp, &eprec);
+        mpz_tdiv_q_2exp(ctx->exp.a, e, eprec-wp);
+        mpz_mul(y, y, ctx->exp.a);
+        mpz_tdiv_q_2exp(y, y, wp);
+        FFL_COUNT(ctx, muls, 1);
+    }
+
+    mpz_tdiv_q_2exp(y, y, wp-prec);
+}
+
+/*
+Frees the lazily computed lookup tables. Not thread-safe: no other
+thread may be evaluating.
+*/
+void clear_exp_lut()
+{
+    exp_lut_node *node, *next;
+    int k;
+
+    for (k=0; k<EXP_LUT_SLOTS; k++)
+    {
+        node = atomic_exchange_explicit(&exp_lut_lazy[k], NULL, memory_order_acq_rel);
+        while (node != NULL)
+        {
+            next = node->next;
+            mpz_clear(node->value);
+            free(node);
+            node = next;
+        }
+    }
+}
+
+/*
+Default (r, J, lut) for precisions without a tuning entry. With all
+the table levels the argument left for the series is below 2^-32, so
+r only pays off at high precision; from 8000 bits on the tables no
+longer beat more squarings.
+*/
+void exp_default_params(int prec, int *r, int *J, int *lut)
+{
+    if (prec < 8000)
+    {
+        *r = (int) sqrt(prec / 4.0) - EXP_LUT_LEVELS*EXP_LUT_STEP;
+        if (*r < 0)
+            *r = 0;
+        *J = (prec < 300) ? 1 : (prec < 2000) ? 2 : 4;
+        *lut = EXP_LUT_LEVELS;
+    }
+    else
+    {
+        *r = (int) sqrt(prec / 4.0);
+        *J = 4;
+        *lut = 0;
+    }
+}
+
+/*
+Reads a tuning file written by benchmark_optimize_exp. Each line is
+
+  prec r J lut
+
+(lut may be missing, meaning 0) with increasing prec; lines starting
+with # are ignored. Every
+precision up to TUNE_MAX_PREC gets the entry of the smallest tuned
+precision at or above it (or the largest one). Not thread-safe: call
+once before evaluating. Returns the number of entries read, or -1 if
+the file could not be opened.
+*/
+int load_exp_tuning(const char *filename)
+{
+    FILE *fp;
+    char line[256];
+    int tprec[TUNE_SIZE], tr[TUNE_SIZE], tJ[TUNE_SIZE], tlut[TUNE_SIZE];
+    int i, j, n, prec;
+
+    fp = fopen(filename, "rt");
+    if (fp == NULL)
+        return -1;
+
+    n = 0;
+    while (n < TUNE_SIZE && fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (line[0] == '#')
+            continue;
+        tlut[n] = 0;
+        if (sscanf(line, "%d %d %d %d", &tprec[n], &tr[n], &tJ[n], &tlut[n]) < 3)
+            continue;
+        if (tr[n] < 0 || tr[n] > 255 || tJ[n] < 1 || tJ[n] >= MAX_SERIES_STEPS)
+            continue;
+        n++;
+    }
+    fclose(fp);
+
+    if (n == 0)
+        return 0;
+
+    for (i=0, j=0; i<TUNE_SIZE; i++)
+    {
+        prec = i * TUNE_PREC_STEP;
+        while (j < n-1 && tprec[j] < prec)
+            j++;
+        exp_tune_r[i] = tr[j];
+        exp_tune_J[i] = tJ[j];
+        exp_tune_lut[i] = (tlut[j] < 0) ? 0 : (tlut[j] > EXP_LUT_LEVELS) ? EXP_LUT_LEVELS : tlut[j];
+    }
+
+    return n;
+}
+
+/*
+Writes n (prec, r, J, lut) rows in the format read by load_exp_tuning.
+Returns 0 on success.
+*/
+int save_exp_tuning(const char *filename, int *prec, int *r, int *J, int *lut, int n)
+{
+    FILE *fp;
+    int i;
+
+    fp = fopen(filename, "wt");
+    if (fp == NULL)
+        return -1;
+
+    fprintf(fp, "# exp_series_lut tuning: prec r J lut\n");
+    for (i=0; i<n; i++)
+        fprintf(fp, "%d %d %d %d\n", prec[i], r[i], J[i], lut[i]);
+
+    return fclose(fp);
+}
+
+/*
+(r, J, lut) for exp_series_lut at precision prec: the tuned entry if
+there is one, otherwise the default.
+*/
+void exp_tuned_params(int prec, int *r, int *J, int *lut)
+{
+    int i = (prec + TUNE_PREC_STEP - 1) / TUNE_PREC_STEP;
+
+    if (i < TUNE_SIZE && exp_tune_J[i] != 0)
+    {
+        *r = exp_tune_r[i];
+        *J = exp_tune_J[i];
+        *lut = exp_tune_lut[i];
+    }
+    else
+    {
+        exp_default_params(prec, r, J, lut);
+    }
+}
+
+#ifdef FFL_FAST128
+/*
+exp_series_lut on fast128_t numbers with FAST128_BITS fractional bits,
+for |x| < 1/2 and prec <= FAST128_MAX_PREC (within an ulp up to
+FAST128_PREC). All EXP_LUT_LEVELS levels are removed with the tables,
+whose entries are read at FAST128_BITS bits, and the Taylor series of
+the remaining t < 2^-32 needs no squarings. Returns 0, leaving y alone,
+for other x and prec.
+*/
+int exp_fast128(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    int i, k, eprec, cut;
+    int idx[EXP_LUT_LEVELS];
+    __int128 v;
+    fast128_t t, a, c;
+    mpz_srcptr e;
+
+    (void) ctx;     /* only counted into, with FFL_STATS */
+
+    if (prec > FAST128_MAX_PREC || (long) mpz_sizeinbase(x, 2) >= prec)
+        return 0;
+
+    v = mpz_get_fast128(x, FAST128_BITS - prec);
+    if (mpz_sgn(x) < 0)
+        v = -v;
+
+    /* k_i = successive EXP_LUT_STEP-bit chunks of x (k_0 floored), t = the rest */
+    idx[0] = (int) (v >> (FAST128_BITS - EXP_LUT_STEP));
+    t = v - (__int128) idx[0] * ((__int128) 1 << (FAST128_BITS - EXP_LUT_STEP));
+    for (i=1; i<EXP_LUT_LEVELS; i++)
+    {
+        k = FAST128_BITS - EXP_LUT_STEP*(i+1);
+        idx[i] = (int) (t >> k);
+        t &= ((fast128_t) 1 << k) - 1;
+    }
+
+    /* c = exp(t), term by term down to 2^-(prec+10) or to the last bit */
+    cut = FAST128_BITS - prec - 10;
+    if (cut < 0)
+        cut = 0;
+    c = ((fast128_t) 1 << FAST128_BITS) + t;
+    a = t;
+    for (k=2; (a >> cut) != 0; k++)
+    {
+        a = fast128_mul(a, t) / k;
+        c += a;
+        FFL_COUNT(ctx, terms, 1);
+        FFL_COUNT(ctx, muls, 1);
+        FFL_COUNT(ctx, divs_ui, 1);
+    }
+
+    for (i=0; i<EXP_LUT_LEVELS; i++)
+    {
+        if (idx[i] == 0)
+            continue;
+        e = exp_lut_get(i, idx[i], FAST128_BITS, &eprec);
+        c = fast128_mul(c, mpz_get_fast128(e, FAST128_BITS - eprec));
+        FFL_COUNT(ctx, muls, 1);
+    }
+
+    mpz_set_fast128(y, c >> (FAST128_BITS - prec));
+    return 1;
+}
+#endif
+
+/*
+y = exp(x) for a small fixed-point x with prec bits (|x| < 1 or so),
+choosing the method by precision: exp_fast128 up to FAST128_PREC (for
+|x| < 1/2), exp_series_lut with the tuned (r, J, lut) below
+EXP_BITBURST_PREC, exp_bitburst above.
+*/
+void exp_small(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    int r, J, lut;
+
+#ifdef FFL_FAST128
+    if (prec <= FAST128_PREC && exp_fast128(ctx, y, x, prec))
+        return;
+#endif
+
+    if (prec >= EXP_BITBURST_PREC)
+    {
+        exp_bitburst(ctx, y, x, prec);
+        return;
+    }
+
+    exp_tuned_params(prec, &r, &J, &lut);
+    exp_series_lut(ctx, y, x, prec, r, J, lut);
+}
+
+/*
+    exp(x) = y * 2^n
+
+for a fixed-point x with prec bits of any magnitude (as long as n fits
+in an int), y being a fixed-point number with prec bits in
+[1/sqrt(2), sqrt(2)]. x = n log(2) + t with n = round(x / log(2)),
+and y = exp(t) by exp_small; t is formed with 8 guard bits, and
+log(2) comes from the const_ln2 cache. The cost depends on the
+magnitude of x only through the length of log(2).
+*/
+int ffl_exp(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    int ex, wp, wn, n;
+
+    /* |x| < 1/4, nothing to reduce */
+    if ((long) mpz_sizeinbase(x, 2) <= prec - 2)
+    {
+        exp_small(ctx, y, x, prec);
+        return 0;
+    }
+
+    /* |n| < 2^(ex+1), so log(2) needs ex+2 more bits than t */
+    ex = (int) mpz_sizeinbase(x, 2) - prec;
+    if (ex < 0)
+        ex = 0;
+    wp = prec + 8;
+    wn = wp + ex + 2;
+
+    /* n = floor((x + log(2)/2) / log(2)), t = x - n log(2) */
+    const_ln2(ctx->exp.ln2, wn);
+    mpz_mul_2exp(ctx->exp.xt, x, wn - prec);
+    mpz_tdiv_q_2exp(ctx->exp.a, ctx->exp.ln2, 1);
+    mpz_add(ctx->exp.xt, ctx->exp.xt, ctx->exp.a);
+    mpz_fdiv_qr(ctx->exp.a, ctx->exp.xt, ctx->exp.xt, ctx->exp.ln2);
+    n = mpz_get_si(ctx->exp.a);
+    mpz_tdiv_q_2exp(ctx->exp.a, ctx->exp.ln2, 1);
+    mpz_sub(ctx->exp.xt, ctx->exp.xt, ctx->exp.a);
+    mpz_tdiv_q_2exp(ctx->exp.xt, ctx->exp.xt, wn - wp);
+
+    /* the 128-bit kernel takes the guard bits of t in its own */
+#ifdef FFL_FAST128
+    if (prec > FAST128_PREC || !exp_fast128(ctx, y, ctx->exp.xt, wp))
+#endif
+        exp_small(ctx, y, ctx->exp.xt, wp);
+    mpz_tdiv_q_2exp(y, y, wp - prec);
+
+    return n;
+}
+
+/*
+Computes out[i] = exp(in[i]) for i = 0..n-1, all with the same
+(prec, r, J). The precision setup and the scratch allocations are
+shared by the whole batch. out[i] may alias in[i].
+*/
+void exp_series_batch(ffl_ctx_t ctx, mpz_t *out, mpz_t *in, int n, int prec, int r, int J)
+{
+    int i;
+
+    exp_series_setup(ctx, prec, r);
+
+    for (i=0; i<n; i++)
+    {
+        mpz_reserve(out[i], 2*ctx->exp.wp+64);
+        exp_series_eval(ctx, out[i], ctx->exp.t, in[i], J, 2);
+    }
+}
+
+typedef struct
+{
+    ffl_ctx_struct *ctx;
+    mpz_t *out;
+    mpz_t *in;
+    int n;
+    int prec;
+    int r;
+    int J;
+} exp_batch_arg;
+
+void *exp_batch_worker(void *arg)
+{
+    exp_batch_arg *a = (exp_batch_arg *) arg;
+
+    exp_series_batch(a->ctx, a->out, a->in, a->n, a->prec, a->r, a->J);
+    return NULL;
+}
+
+/*
+exp_series_batch with the batch split into nthreads contiguous slices
+of nearly equal size, slice i being evaluated by its own thread using
+ctxs[i]. The contexts are meant to be long-lived (one per worker) so
+that their setup and allocations carry over between batches.
+nthreads <= 1 evaluates in the calling thread using ctxs[0].
+*/
+void exp_series_batch_mt(ffl_ctx_t *ctxs, mpz_t *out, mpz_t *in, int n, int prec, int r, int J, int nthreads)
+{
+    exp_batch_arg *args;
+    pthread_t *threads;
+    int i, lo, hi;
+
+    if (nthreads > n)
+        nthreads = n;
+
+    if (nthreads <= 1)
+    {
+        exp_series_batch(ctxs[0], out, in, n, prec, r, J);
+        return;
+    }
+
+    args = malloc(nthreads * sizeof(exp_batch_arg));
+    threads = malloc(nthreads * sizeof(pthread_t));
+
+    /* balanced slices, none empty since nthreads <= n */
+    for (i=0; i<nthreads; i++)
+    {
+        lo = (int) ((long) i * n / nthreads);
+        hi = (int) ((long) (i+1) * n / nthreads);
+        args[i].ctx = ctxs[i];
+        args[i].out = out + lo;
+        args[i].in = in + lo;
+        args[i].n = hi - lo;
+        args[i].prec = prec;
+        args[i].r = r;
+        args[i].J = J;
+        pthread_create(&threads[i], NULL, exp_batch_worker, &args[i]);
+    }
+    for (i=0; i<nthreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(args);
+    free(threads);
+}
@@ -0,0 +1,547 @@
+/*
+fastfun -- fast fixed-point exp, log and gamma on top of GMP.
+
+Numbers are fixed-point mpz_t values: an integer x with precision
+prec represents x / 2^prec.
+*/
+
+#ifndef FASTFUN_H
+#define FASTFUN_H
+
+#include <stdint.h>
+#include <gmp.h>
+#include <mpfr.h>
+
+#define MAX_SERIES_STEPS 10
+
+/* Largest block size J for the rectangular splitting in gamma_taylor */
+#define MAX_GAMMA_J 64
+
+/*
+Block size gamma_taylor is called with by default, 1 being Horner.
+The coefficients are full-length numbers rather than small rationals,
+so the products in a block cost as much as the Horner steps they
+replace; J between 6 and 16 merely ties the trimmed Horner scheme at
+every precision. See benchmark_gamma in gammatest.
+*/
+#define GAMMA_DEFAULT_J 1
+
+/* Largest number of factors per block in the gamma argument reduction */
+#define MAX_GAMMA_RF 64
+
+/*
+Largest working precision for which gamma_taylor_terms has been
+checked to give enough terms; above it ffl_gamma uses gamma_stirling
+for every x.
+*/
+#define GAMMA_TAYLOR_MAX_PREC 15000
+
+#define LOG_LUT_STEP 9
+#define LOG_LUT_SIZE (1<<(LOG_LUT_STEP+1))
+#define LOG_LUT_PREC 4096
+
+/*
+Number of lookup table levels for the argument reduction in
+log_series, whose lut argument is the number of levels to use (0 for
+none). Level i >= 1 removes a further LOG_LUT_STEP bits; the bound
+keeps the index selection within double precision.
+*/
+#define LOG_LUT_LEVELS 4
+#define LOG_LUT_SLOTS (LOG_LUT_SIZE*(2*LOG_LUT_LEVELS-1))
+
+/*
+Precomputed lookup tables written by save_log_lut and mapped by
+load_log_lut.
+*/
+#define LOG_LUT_FILE "log_lut.bin"
+
+/*
+Gamma coefficient table written by save_gamma_coefficients and mapped
+by load_gamma_coefficients.
+*/
+#define GAMMA_COEFF_FILE "gamma_coeff.bin"
+
+/*
+Lookup tables for exp_series_lut, whose lut argument is the number of
+levels to use (0 for none). Level i holds exp(k/2^(EXP_LUT_STEP*(i+1)))
+for the EXP_LUT_SIZE values of k the reduction can produce, so each
+level removes EXP_LUT_STEP bits of the argument. Entries are computed
+lazily with EXP_LUT_PREC*2^j bits.
+*/
+#define EXP_LUT_STEP 8
+#define EXP_LUT_SIZE (1<<EXP_LUT_STEP)
+#define EXP_LUT_LEVELS 4
+#define EXP_LUT_SLOTS (EXP_LUT_SIZE*EXP_LUT_LEVELS)
+#define EXP_LUT_PREC 256
+
+/*
+Above this precision exp_small uses exp_bitburst instead of exp_series.
+See benchmark_bitburst_exp in exptest.
+*/
+#define EXP_BITBURST_PREC 80000
+
+/*
+Flag for the alt argument of exp_series: evaluate the odd series
+directly instead of recovering s (or, for exp, the odd part of the
+series) with a square root. See benchmark_direct_exp in exptest.
+*/
+#define EXP_SERIES_DIRECT 4
+
+/*
+exp_small uses EXP_SERIES_DIRECT for |x| < 2^-EXP_DIRECT_BITS. The
+square root loses about log2(1/|x|) - 5 bits, while the odd series
+costs 10-35% more time.
+*/
+#define EXP_DIRECT_BITS 4
+
+/*
+Up to FAST128_PREC bits exp_small, ffl_exp and ffl_log use exp_fast128
+and log_fast128, which do the same reduction and series on unsigned
+__int128 numbers with FAST128_BITS fractional bits instead of mpz_t,
+where GMP's size checks and allocations cost more than the
+arithmetic. Their error is a few units of 2^-FAST128_BITS at any
+precision: within an ulp up to FAST128_PREC, which leaves the usual
+10 guard bits, and they accept up to FAST128_MAX_PREC bits. ffl_exp
+and ffl_log compare their target precision with FAST128_PREC and pass
+their guard bits on top, which absorb the larger error in the last
+bits. The ffl_mpfr_* wrappers add MPFR_WRAP_GUARD bits first, so they
+take the fast path only up to prec(y) = FAST128_PREC - MPFR_WRAP_GUARD;
+113 bits would need a third limb. FFL_FAST128 is defined when the
+compiler has __int128 and limbs have 64 bits; compile with
+-DFFL_NO_FAST128 to always use mpz_t.
+*/
+#if defined(__SIZEOF_INT128__) && GMP_NUMB_BITS == 64 && !defined(FFL_NO_FAST128)
+#define FFL_FAST128
+#endif
+#define FAST128_BITS 126
+#define FAST128_PREC (FAST128_BITS - 10)
+#define FAST128_MAX_PREC (FAST128_BITS - 2)
+
+/*
+Largest number of limbs of the working precision for which the
+series in exp_series_mpn and log_series_mpn run on the fixed-size mpn
+kernels in mpn.c; above it they fall back to the mpz_t kernels, whose
+cost is dominated by the multiplications anyway (exptest mpn measures
+no gain past about 2000 bits).
+*/
+#define MPN_MAX_LIMBS 32
+
+/*
+Constants for ffl_const, cached in const.c. A cached constant has
+CONST_EXTRA bits more than first asked for, and is recomputed with at
+least CONST_GROWTH times its bits when more are needed. It is
+evaluated with CONST_GUARD more bits and truncated, since the sums
+for log(2) and Euler's constant are a few hundred units off in their
+own last place.
+*/
+#define CONST_PI 0
+#define CONST_LN2 1
+#define CONST_EULER 2
+#define CONST_COUNT 3
+#define CONST_EXTRA 32
+#define CONST_GROWTH 1.5
+#define CONST_GUARD 16
+
+/*
+From this precision on Euler's constant is computed by binary
+splitting instead of term by term. See benchmark_constants_gamma in
+gammatest.
+*/
+#define CONST_EULER_BSPLIT_PREC 3000
+
+/*
+Guard bits of the first attempt of the correctly rounded ffl_mpfr_*
+wrappers, and the largest exponents of x that ffl_mpfr_exp and
+ffl_mpfr_gamma evaluate themselves; beyond them the result is close
+to overflow or underflow and MPFR takes over.
+*/
+#define MPFR_WRAP_GUARD 16
+#define MPFR_WRAP_EXP_MAX 30
+#define MPFR_WRAP_GAMMA_EXP_MAX 24
+
+/*
+Above this precision ffl_log uses log_agm instead of log_series.
+See benchmark_agm_log in logtest2.
+*/
+#define LOG_AGM_PREC 90000
+
+/*
+Tuned parameters are kept per precision in steps of TUNE_PREC_STEP
+bits up to TUNE_MAX_PREC.
+*/
+#define TUNE_PREC_STEP 16
+#define TUNE_MAX_PREC 80000
+#define TUNE_SIZE (TUNE_MAX_PREC/TUNE_PREC_STEP+1)
+#define EXP_TUNE_FILE "exp_tune.txt"
+#define LOG_TUNE_FILE "log_tune.txt"
+
+/*
+A tuned (r, J) is only accepted if its maximum error on TUNE_SWEEP_N
+random arguments (see bench_sweep) is at most TUNE_MAX_ERR bits worse
+than that of the default parameters on the same arguments.
+*/
+#define TUNE_SWEEP_N 100
+#define TUNE_MAX_ERR 1.0
+
+/*
+Argument ranges of the random sweeps, log-uniform for exp; ffl_exp,
+which reduces by log(2), is swept up to EXP_SWEEP_FULL_HI
+*/
+#define EXP_SWEEP_LO 1e-9
+#define EXP_SWEEP_HI 1.0
+#define EXP_SWEEP_FULL_HI 1e4
+#define LOG_SWEEP_LO 0.5
+#define LOG_SWEEP_HI 2.0
+#define LOG_SWEEP_WIDE_LO 1e-9
+#define LOG_SWEEP_WIDE_HI 1e9
+#define GAMMA_SWEEP_LO 0.5
+#define GAMMA_SWEEP_HI 1e5
+
+/* Scratch space for the exponential series */
+typedef struct
+{
+    mpz_t x;
+    mpz_t t;
+    mpz_t one;
+    mpz_t a;
+    mpz_t s0;
+    mpz_t s1;
+    mpz_t x2;
+
+    mpz_t pows[MAX_SERIES_STEPS];
+    mpz_t sums[MAX_SERIES_STEPS];
+
+    /* argument reduction in ffl_exp and exp_series_lut */
+    mpz_t xt;
+    mpz_t ln2;
+    mpz_t xl;
+
+    /* odd series, with EXP_SERIES_DIRECT */
+    mpz_t xr;
+    mpz_t b;
+    mpz_t odd[MAX_SERIES_STEPS];
+
+    /* set by exp_series_setup */
+    mpz_t one2;
+    int prec;
+    int r;
+    int wp;
+} exp_ctx_struct;
+
+/* Scratch space for the logarithm series */
+typedef struct
+{
+    mpz_t x;
+    mpz_t t;
+    mpz_t one;
+    mpz_t a;
+    mpz_t s0;
+    mpz_t s1;
+    mpz_t x2;
+
+    /* the reduced argument of ffl_log */
+    mpz_t m;
+
+    mpz_t pows[MAX_SERIES_STEPS];
+    mpz_t sums[MAX_SERIES_STEPS];
+
+    /* set by log_series_setup */
+    int prec;
+    int r;
+    int wp;
+} log_ctx_struct;
+
+/* Scratch space for gamma_taylor */
+typedef struct
+{
+    mpz_t rfac;
+    mpz_t one;
+    mpz_t ta;
+    mpz_t tb;
+    mpz_t tc;
+    mpz_t td;
+    mpz_t te;
+
+    /* x^j for the rectangular splitting, t^k for the argument reduction */
+    mpz_t pows[MAX_GAMMA_J+1];
+
+    /* coefficients of a block of the rising factorial */
+    mpz_t rpoly[MAX_GAMMA_RF+1];
+
+    /* log(sqrt(2 pi)) for gamma_stirling, with const_prec bits */
+    mpz_t lsqrt2pi;
+    int const_prec;
+} gamma_ctx_struct;
+
+/*
+Operation counts of the series kernels, accumulated in the context
+when the library is compiled with -DFFL_STATS (make STATS=1 after a
+make clean). Otherwise FFL_COUNT compiles to nothing and the counts
+stay zero; ffl_stats_enabled tells which build is linked.
+*/
+typedef struct
+{
+    unsigned long muls;
+    unsigned long divs;
+    unsigned long divs_ui;
+    unsigned long sqrts;
+    unsigned long terms;
+} ffl_stats_struct;
+
+#ifdef FFL_STATS
+#define FFL_COUNT(ctx, op, n) ((ctx)->stats.op += (n))
+#else
+#define FFL_COUNT(ctx, op, n) ((void) 0)
+#endif
+
+#ifdef FFL_FAST128
+typedef unsigned __int128 fast128_t;
+
+/*
+a*b/2^FAST128_BITS truncated, from the four 64x64-bit products. The
+result must fit, i.e. a*b < 2^(128+FAST128_BITS).
+*/
+static inline fast128_t fast128_mul(fast128_t a, fast128_t b)
+{
+    uint64_t a0 = (uint64_t) a, a1 = (uint64_t) (a >> 64);
+    uint64_t b0 = (uint64_t) b, b1 = (uint64_t) (b >> 64);
+    fast128_t lo, mid, mid2, hi;
+
+    /* a*b = hi*2^128 + lo, no partial sum overflows */
+    lo = (fast128_t) a0 * b0;
+    mid = (fast128_t) a0 * b1 + (uint64_t) (lo >> 64);
+    mid2 = (fast128_t) a1 * b0 + (uint64_t) mid;
+    hi = (fast128_t) a1 * b1 + (uint64_t) (mid >> 64) + (uint64_t) (mid2 >> 64);
+    lo = (mid2 << 64) | (uint64_t) lo;
+
+    return (hi << (128 - FAST128_BITS)) | (lo >> FAST128_BITS);
+}
+#endif
+
+/* Output formats of bench_report */
+#define BENCH_TEXT 0
+#define BENCH_CSV 1
+#define BENCH_JSON 2
+
+#define BENCH_MAX_SAMPLES 101
+
+/*
+Samples per result and minimum length of a sample in nanoseconds used
+by the bench modes of the test programs.
+*/
+#define BENCH_SAMPLES 21
+#define BENCH_SAMPLE_NS 2e6
+
+/* Hardware counters read by bench_count */
+#define BENCH_CYCLES 0
+#define BENCH_INSTRUCTIONS 1
+#define BENCH_CACHE_MISSES 2
+#define BENCH_BRANCH_MISSES 3
+#define BENCH_COUNTERS 4
+
+/*
+Timings of one kernel from bench_run, in nanoseconds per call.
+[ci_lo, ci_hi] is a 95% confidence interval for the median.
+*/
+typedef struct
+{
+    int reps;
+    int samples;
+    double median;
+    double ci_lo;
+    double ci_hi;
+    double p10;
+    double p90;
+    double min;
+
+    /*
+    Per call, set by bench_count if counted is nonzero. A hardware
+    counter that could not be opened and the operation counts of a
+    build without FFL_STATS are negative.
+    */
+    int counted;
+    double hw[BENCH_COUNTERS];
+    double muls;
+    double divs;
+    double divs_ui;
+    double sqrts;
+    double terms;
+} bench_result;
+
+typedef void (*bench_fn)(void *arg);
+
+/*
+Every evaluation only touches the context it is given, so one context
+per thread is enough to evaluate in parallel. Set up with ffl_init.
+*/
+typedef struct
+{
+    exp_ctx_struct exp;
+    log_ctx_struct log;
+    gamma_ctx_struct gamma;
+    ffl_stats_struct stats;
+} ffl_ctx_struct;
+
+typedef ffl_ctx_struct ffl_ctx_t[1];
+
+/*
+A kernel for bench_sweep: y * 2^n = f(x) for fixed-point x and y with
+prec bits, returning n (0 for exp and log). param is passed through.
+*/
+typedef int (*bench_kernel)(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param);
+
+/* The MPFR function bench_sweep compares against, such as mpfr_exp */
+typedef int (*bench_mpfr_fn)(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd);
+
+/*
+Errors of a bench_sweep, in bits: log2 of the error in units of the
+last place 2^(n-prec), or 0 within one unit. worst_x is the argument
+with the largest error, ns the mean time per kernel call.
+*/
+typedef struct
+{
+    int n;
+    double max_err;
+    double mean_err;
+    double worst_x;
+    double ns;
+} bench_sweep_result;
+
+/*
+Outcome of a bench_mpfr_compare: the number of results (and of signs
+of the ternary value) that differ from MPFR, worst_x the last argument
+with a wrong result, and the mean times per call of the replacement
+and of MPFR.
+*/
+typedef struct
+{
+    int n;
+    int wrong;
+    int wrong_ternary;
+    double worst_x;
+    double ns;
+    double ref_ns;
+} bench_mpfr_result;
+
+/* util.c */
+void ffl_init(ffl_ctx_t ctx);
+void ffl_clear(ffl_ctx_t ctx);
+int ffl_stats_enabled();
+double timing();
+void mpz_fixed_one(mpz_t x, int prec);
+void mpz_reserve(mpz_t z, int bits);
+void printx(char *s, mpz_t x, int prec);
+int fix_accuracy(mpz_t y, int prec, mpfr_t ref);
+void mpn_set_mpz_2exp(mp_limb_t *d, int n, mpz_srcptr z, long e);
+void mpz_set_mpn_2exp(mpz_t z, const mp_limb_t *s, int n, long e);
+#ifdef FFL_FAST128
+fast128_t mpz_get_fast128(mpz_srcptr z, int e);
+void mpz_set_fast128(mpz_t z, fast128_t x);
+#endif
+
+/* bench.c */
+double bench_clock();
+int bench_pin_cpu(int cpu);
+void bench_run(bench_result *res, bench_fn fn, void *arg, int samples, double sample_ns);
+void bench_count(bench_result *res, bench_fn fn, void *arg, ffl_ctx_t ctx);
+void bench_sweep(bench_sweep_result *res, ffl_ctx_t ctx, bench_kernel f, void *param,
+    bench_mpfr_fn ref, double lo, double hi, int logscale, int n, int prec, gmp_randstate_t state);
+void bench_mpfr_compare(bench_mpfr_result *res, bench_mpfr_fn f, bench_mpfr_fn ref,
+    double lo, double hi, int logscale, int signs, int n, int prec, gmp_randstate_t state);
+int bench_parse_format(const char *s);
+void bench_report_header(int format, int counters);
+void bench_report(int format, const char *kernel, int prec, const char *params, const bench_result *res);
+
+/* const.c */
+void ffl_const(mpz_t y, int c, int prec);
+void const_pi(mpz_t y, int prec);
+void const_ln2(mpz_t y, int prec);
+void const_euler(mpz_t y, int prec);
+void const_euler_direct(mpz_t y, int prec);
+int const_cached_prec(int c);
+void clear_constants();
+
+/* wrap.c */
+int ffl_mpfr_exp(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd);
+int ffl_mpfr_log(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd);
+int ffl_mpfr_gamma(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd);
+void ffl_mpfr_clear();
+
+/* mpn.c */
+int series_mpn_limbs(int wp);
+void exp_series_mpn(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J);
+int log_atanh_mpn(ffl_ctx_t ctx, mpz_t y, mpz_t z, int wp, int J);
+
+/* exp.c */
+void exp_init_data(ffl_ctx_t ctx);
+void exp_clear_data(ffl_ctx_t ctx);
+void fix_exp(ffl_ctx_t ctx, mpz_t z, mpz_t x, int prec);
+void exp_series(ffl_ctx_t ctx, mpz_t c, mpz_t s, mpz_t x, int prec, int r, int J, int alt);
+void exp_series_setup(ffl_ctx_t ctx, int prec, int r);
+void exp_series_eval(ffl_ctx_t ctx, mpz_t c, mpz_t s, mpz_t x, int J, int alt);
+void exp_series_batch(ffl_ctx_t ctx, mpz_t *out, mpz_t *in, int n, int prec, int r, int J);
+void exp_series_batch_mt(ffl_ctx_t *ctxs, mpz_t *out, mpz_t *in, int n, int prec, int r, int J, int nthreads);
+void exp_bsplit(mpz_t P, mpz_t Q, mpz_t T, mpz_t p, int q, int a, int b, int want_P);
+void exp_bsplit_fixed(mpz_t y, mpz_t p, int q, int wp);
+void exp_bitburst(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+void exp_lut_entry(mpz_t y, int level, int k, int prec);
+void exp_series_lut(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J, int lut);
+void clear_exp_lut();
+void exp_default_params(int prec, int *r, int *J, int *lut);
+int load_exp_tuning(const char *filename);
+int save_exp_tuning(const char *filename, int *prec, int *r, int *J, int *lut, int n);
+void exp_tuned_params(int prec, int *r, int *J, int *lut);
+#ifdef FFL_FAST128
+int exp_fast128(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+#endif
+void exp_small(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+int ffl_exp(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+
+/* log.c */
+extern mpz_t log_lut_table[LOG_LUT_SLOTS];
+extern int log_lut_loaded;
+
+void log_init_data(ffl_ctx_t ctx);
+void log_clear_data(ffl_ctx_t ctx);
+int log_series(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J, int _use_lut);
+void log_series_setup(ffl_ctx_t ctx, int prec, int r);
+int log_series_eval(ffl_ctx_t ctx, mpz_t y, mpz_t x, int J, int _use_lut);
+int log_series_mpn(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J, int _use_lut);
+void log_series_batch(ffl_ctx_t ctx, mpz_t *out, mpz_t *in, int n, int prec, int r, int J, int _use_lut);
+void log_series_batch_mt(ffl_ctx_t *ctxs, mpz_t *out, mpz_t *in, int n, int prec, int r, int J, int _use_lut, int nthreads);
+void log_default_params(int prec, int *r, int *J, int *lut);
+int load_log_tuning(const char *filename);
+int save_log_tuning(const char *filename, int *prec, int *r, int *J, int *lut, int n);
+void log_tuned_params(int prec, int *r, int *J, int *lut);
+void fix_agm(ffl_ctx_t ctx, mpz_t a, mpz_t b);
+void log_agm(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+#ifdef FFL_FAST128
+int log_fast128(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+#endif
+int ffl_log(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+void log_lut_entry(ffl_ctx_t ctx, mpz_t y, int level, int k, int prec);
+int save_log_lut(const char *filename);
+int load_log_lut(const char *filename);
+void unload_log_lut();
+void clear_log_lut();
+
+/* gamma.c */
+void gamma_init_data(ffl_ctx_t ctx);
+void gamma_clear_data(ffl_ctx_t ctx);
+int gamma_taylor_terms(int wp);
+void zeta_array(ffl_ctx_t ctx, mpz_t *z, int N, int prec);
+void gamma_taylor_coefficients(ffl_ctx_t ctx, mpz_t *coeff, int n, int prec);
+void gamma_init_coefficients(ffl_ctx_t ctx, int prec);
+int gamma_coefficients_prec();
+void gamma_coefficients_memory(size_t *table, size_t *tiers, size_t *full);
+void gamma_clear_coefficients();
+int load_gamma_coefficients_text(const char *filename);
+int save_gamma_coefficients(const char *filename, int prec);
+int load_gamma_coefficients(const char *filename);
+int gamma_taylor(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int J);
+double gamma_stirling_min_x(int prec);
+int gamma_stirling(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+double gamma_stirling_cutoff(int prec);
+int ffl_gamma(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec);
+
+#endif
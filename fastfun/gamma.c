@@ -0,0 +1,1420 @@
+/*
+Gamma function.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <gmp.h>
+#include <math.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fastfun.h"
+
+/*
+Tables of Taylor coefficients of 1/gamma(1+x), shared by all threads
+and published like the lazy log lookup tables: gamma_table points to
+the most precise table so far, a table is fully written before a
+single compare-and-swap makes it visible, and a superseded table is
+kept in prev (readers may still be using it) until
+gamma_clear_coefficients. A table loaded by load_gamma_coefficients
+has map set, and its coefficients are read-only views into it.
+
+Coefficient k is kept with only prec-k bits: gamma_taylor evaluates at
+|x| <= 1/2, so its term is scaled by 2^-k and the dropped bits never
+contribute. For each working precision tier T (a multiple of the limb
+size), tiers[T/GMP_NUMB_BITS] is filled lazily with a copy truncated
+to T-k bits, so that gamma_taylor uses the coefficients as they are.
+*/
+typedef struct
+{
+    mpz_t *coeff;
+    int n;
+    int prec;
+} gamma_coeff_tier;
+
+typedef struct gamma_coeff_table
+{
+    mpz_t *coeff;
+    int n;
+    int prec;
+    int max_prec;
+    gamma_coeff_tier *_Atomic *tiers;
+    void *map;
+    size_t map_size;
+    struct gamma_coeff_table *prev;
+} gamma_coeff_table;
+
+static gamma_coeff_table *_Atomic gamma_table;
+
+/*
+Coefficients B_2k/(2k(2k-1)) of the Stirling series for k = 1..n, as
+reduced fractions num[k-1]/den[k-1]. Shared and published the same way
+as the Taylor coefficient tables.
+*/
+typedef struct gamma_stirling_table
+{
+    mpz_t *num;
+    mpz_t *den;
+    int n;
+    struct gamma_stirling_table *prev;
+} gamma_stirling_table;
+
+static gamma_stirling_table *_Atomic stirling_table;
+
+void gamma_init_data(ffl_ctx_t ctx)
+{
+    int i;
+    mpz_init(ctx->gamma.rfac);
+    mpz_init(ctx->gamma.one);
+    mpz_init(ctx->gamma.ta);
+    mpz_init(ctx->gamma.tb);
+    mpz_init(ctx->gamma.tc);
+    mpz_init(ctx->gamma.td);
+    mpz_init(ctx->gamma.te);
+    for (i=0; i<=MAX_GAMMA_J; i++)
+        mpz_init(ctx->gamma.pows[i]);
+    for (i=0; i<=MAX_GAMMA_RF; i++)
+        mpz_init(ctx->gamma.rpoly[i]);
+    mpz_init(ctx->gamma.lsqrt2pi);
+    ctx->gamma.const_prec = 0;
+}
+
+void gamma_clear_data(ffl_ctx_t ctx)
+{
+    int i;
+    mpz_clear(ctx->gamma.rfac);
+    mpz_clear(ctx->gamma.one);
+    mpz_clear(ctx->gamma.ta);
+    mpz_clear(ctx->gamma.tb);
+    mpz_clear(ctx->gamma.tc);
+    mpz_clear(ctx->gamma.td);
+    mpz_clear(ctx->gamma.te);
+    for (i=0; i<=MAX_GAMMA_J; i++)
+        mpz_clear(ctx->gamma.pows[i]);
+    for (i=0; i<=MAX_GAMMA_RF; i++)
+        mpz_clear(ctx->gamma.rpoly[i]);
+    mpz_clear(ctx->gamma.lsqrt2pi);
+}
+
+/*
+Number of Taylor coefficients gamma_taylor uses at wp bits.
+TODO: be both clever and correct here
+*/
+int gamma_taylor_terms(int wp)
+{
+    if (wp < 1000)
+        return (int)(pow(wp, 0.76) + 2);
+
+    /* Valid up to at least GAMMA_TAYLOR_MAX_PREC bits */
+    return (int)(pow(wp, 0.787) + 2);
+}
+
+/*
+The tier precision gamma_taylor uses at wp bits with the given number
+of terms: wp plus the bits lost to rounding in a Horner step per term,
+rounded up to whole limbs.
+*/
+static int gamma_tier_prec(int wp, int terms)
+{
+    int T;
+
+    for (T=wp+1; terms; terms>>=1)
+        T++;
+    return (T + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS * GMP_NUMB_BITS;
+}
+
+/*
+z[n] = zeta(n) as fixed-point numbers with prec bits for 2 <= n <= N+1
+(z has N+2 entries; z[0] = zeta(0) = -1/2 and z[1] = 0).
+
+Odd values use zeta(n) = A pi^n + B, where B is a sum over powers of
+exp(2 pi) gaining 9 bits per term and the rational part A pi^n is
+written in terms of even zeta values. Even values come from
+
+  (m+1/2) zeta(2m) = sum_{k=1}^{m-1} zeta(2k) zeta(2m-2k),
+
+starting at zeta(2) = pi^2/6, so no Bernoulli numbers are needed.
+*/
+void zeta_array(ffl_ctx_t ctx, mpz_t *z, int N, int prec)
+{
+    mpz_t pi, rpi, one, e2pi, ek, s, t, kn;
+    mpz_t *e1, *e2;
+    int wp, k, m, n, U, K;
+
+    wp = prec + 30;
+
+    mpz_init(pi);
+    mpz_init(rpi);
+    mpz_init(one);
+    mpz_init(e2pi);
+    mpz_init(ek);
+    mpz_init(s);
+    mpz_init(t);
+    mpz_init(kn);
+
+    const_pi(pi, wp);
+    mpz_fixed_one(one, wp);
+
+    for (n=0; n<N+2; n++)
+        mpz_set_ui(z[n], 0);
+    mpz_fixed_one(z[0], wp-1);
+    mpz_neg(z[0], z[0]);
+
+    /*
+    e1[k-1] = 1/(exp(2 pi k)-1), e2[k-1] = pi k exp(2 pi k)/(exp(2 pi k)-1)^2,
+    for the k where they still have bits left at wp
+    */
+    K = (wp-1)/9;
+    e1 = malloc(K * sizeof(mpz_t));
+    e2 = malloc(K * sizeof(mpz_t));
+
+    mpz_mul_2exp(t, pi, 1);
+    exp_bitburst(ctx, e2pi, t, wp);
+    mpz_set(ek, e2pi);
+    for (k=1; k<=K; k++)
+    {
+        mpz_init(e1[k-1]);
+        mpz_init(e2[k-1]);
+        mpz_sub(t, ek, one);
+        mpz_fixed_one(e1[k-1], 2*wp);
+        mpz_tdiv_q(e1[k-1], e1[k-1], t);
+        mpz_mul(t, ek, e1[k-1]);
+        mpz_tdiv_q_2exp(t, t, wp);
+        mpz_mul(t, t, e1[k-1]);
+        mpz_tdiv_q_2exp(t, t, wp);
+        mpz_mul(t, t, pi);
+        mpz_tdiv_q_2exp(t, t, wp);
+        mpz_mul_ui(e2[k-1], t, k);
+        mpz_mul(ek, ek, e2pi);
+        mpz_tdiv_q_2exp(ek, ek, wp);
+    }
+
+    /* Exponential sums */
+    for (n=3; n<=N; n+=2)
+    {
+        U = (n-1)/4;
+        mpz_set_ui(s, 0);
+        for (k=1; k<=K; k++)
+        {
+            if (n % 4 == 3)
+            {
+                mpz_set(t, e1[k-1]);
+            }
+            else
+            {
+                mpz_tdiv_q_ui(t, e2[k-1], U);
+                mpz_add(t, t, e1[k-1]);
+            }
+            mpz_ui_pow_ui(kn, k, n);
+            mpz_tdiv_q(t, t, kn);
+            if (mpz_sgn(t) == 0)
+                break;
+            mpz_add(s, s, t);
+        }
+        mpz_mul_si(z[n], s, -2);
+    }
+
+    /* Even zeta values */
+    mpz_mul(z[2], pi, pi);
+    mpz_tdiv_q_2exp(z[2], z[2], wp);
+    mpz_tdiv_q_ui(z[2], z[2], 6);
+    for (m=2; 2*m<=N+1; m++)
+    {
+        mpz_set_ui(s, 0);
+        for (k=1; 2*k<m; k++)
+            mpz_addmul(s, z[2*k], z[2*m-2*k]);
+        mpz_mul_2exp(s, s, 1);
+        if (m % 2 == 0)
+            mpz_addmul(s, z[m], z[m]);
+        mpz_tdiv_q_2exp(s, s, wp-1);
+        mpz_tdiv_q_ui(z[2*m], s, 2*m+1);
+    }
+
+    /* Rational parts of the odd values */
+    mpz_fixed_one(rpi, 2*wp);
+    mpz_tdiv_q(rpi, rpi, pi);
+    for (n=3; n<=N; n+=4)
+    {
+        U = (n-3)/4;
+        mpz_mul_ui(s, z[4*U+4], 4*U+7);
+        mpz_mul_2exp(s, s, wp-2);
+        for (k=1; k<=U; k++)
+            mpz_submul(s, z[4*k], z[4*U+4-4*k]);
+        mpz_tdiv_q_2exp(s, s, wp);
+        mpz_mul(t, s, rpi);
+        mpz_tdiv_q_2exp(t, t, wp-1);
+        mpz_add(z[n], z[n], t);
+    }
+    for (n=5; n<=N; n+=4)
+    {
+        U = (n-1)/4;
+        mpz_mul_ui(s, z[4*U+2], 2*U+1);
+        mpz_mul_2exp(s, s, wp);
+        for (k=1; k<=2*U; k++)
+        {
+            mpz_mul(t, z[2*k], z[4*U+2-2*k]);
+            mpz_mul_ui(t, t, 2*k);
+            if (k % 2)
+                mpz_sub(s, s, t);
+            else
+                mpz_add(s, s, t);
+        }
+        mpz_tdiv_q_2exp(s, s, wp);
+        mpz_mul(t, s, rpi);
+        mpz_tdiv_q_2exp(t, t, wp);
+        mpz_tdiv_q_ui(t, t, 2*U);
+        mpz_add(z[n], z[n], t);
+    }
+
+    for (n=0; n<N+2; n++)
+        mpz_tdiv_q_2exp(z[n], z[n], wp-prec);
+
+    for (k=0; k<K; k++)
+    {
+        mpz_clear(e1[k]);
+        mpz_clear(e2[k]);
+    }
+    free(e1);
+    free(e2);
+
+    mpz_clear(pi);
+    mpz_clear(rpi);
+    mpz_clear(one);
+    mpz_clear(e2pi);
+    mpz_clear(ek);
+    mpz_clear(s);
+    mpz_clear(t);
+    mpz_clear(kn);
+}
+
+/*
+coeff[k] = Taylor coefficient k of 1/gamma(1+x) with prec bits, for
+0 <= k < n. These are the coefficients c_{k+1} of
+
+  1/gamma(x) = x + gamma x^2 + c_3 x^3 + ...,
+
+(k-1) c_k = gamma c_{k-1} - zeta(2) c_{k-2} + zeta(3) c_{k-3} - ...,
+which takes O(n^2) multiplications.
+*/
+void gamma_taylor_coefficients(ffl_ctx_t ctx, mpz_t *coeff, int n, int prec)
+{
+    mpz_t *A, *z;
+    mpz_t s;
+    int wp, j, k;
+
+    wp = prec + 20;
+
+    A = malloc((n+1) * sizeof(mpz_t));
+    z = malloc((n+3) * sizeof(mpz_t));
+    for (k=0; k<=n; k++)
+        mpz_init(A[k]);
+    for (k=0; k<n+3; k++)
+        mpz_init(z[k]);
+    mpz_init(s);
+
+    zeta_array(ctx, z, n+1, wp);
+
+    mpz_fixed_one(A[1], wp);
+    const_euler(A[2], wp);
+
+    for (k=3; k<=n; k++)
+    {
+        mpz_mul(s, A[2], A[k-1]);
+        mpz_neg(s, s);
+        for (j=2; j<k; j++)
+        {
+            if (j % 2)
+                mpz_submul(s, z[j], A[k-j]);
+            else
+                mpz_addmul(s, z[j], A[k-j]);
+        }
+        mpz_tdiv_q_2exp(s, s, wp);
+        mpz_tdiv_q_ui(A[k], s, k-1);
+        mpz_neg(A[k], A[k]);
+    }
+
+    for (k=0; k<n; k++)
+        mpz_tdiv_q_2exp(coeff[k], A[k+1], wp-prec);
+
+    for (k=0; k<=n; k++)
+        mpz_clear(A[k]);
+    for (k=0; k<n+3; k++)
+        mpz_clear(z[k]);
+    free(A);
+    free(z);
+    mpz_clear(s);
+}
+
+static gamma_coeff_table *gamma_new_table(int n, int prec)
+{
+    gamma_coeff_table *tab;
+    int k;
+
+    tab = malloc(sizeof(gamma_coeff_table));
+    tab->coeff = malloc(n * sizeof(mpz_t));
+    for (k=0; k<n; k++)
+        mpz_init(tab->coeff[k]);
+    tab->n = n;
+    tab->prec = prec;
+    tab->tiers = calloc(prec/GMP_NUMB_BITS + 1, sizeof(gamma_coeff_tier *));
+    tab->map = NULL;
+    tab->map_size = 0;
+    tab->prev = NULL;
+    return tab;
+}
+
+static void gamma_free_tier(gamma_coeff_tier *tier)
+{
+    int k;
+
+    for (k=0; k<tier->n; k++)
+        mpz_clear(tier->coeff[k]);
+    free(tier->coeff);
+    free(tier);
+}
+
+static void gamma_free_table(gamma_coeff_table *tab)
+{
+    gamma_coeff_tier *tier;
+    int k;
+
+    for (k=0; k<=tab->prec/GMP_NUMB_BITS; k++)
+    {
+        tier = atomic_load_explicit(&tab->tiers[k], memory_order_acquire);
+        if (tier != NULL)
+            gamma_free_tier(tier);
+    }
+    free(tab->tiers);
+
+    if (tab->map != NULL)
+    {
+        munmap(tab->map, tab->map_size);
+    }
+    else
+    {
+        for (k=0; k<tab->n; k++)
+            mpz_clear(tab->coeff[k]);
+    }
+    free(tab->coeff);
+    free(tab);
+}
+
+/*
+Sets tab->max_prec to the highest precision tab has enough
+coefficients for (a loaded table may fall short of its own precision).
+*/
+static void gamma_table_max_prec(gamma_coeff_table *tab)
+{
+    tab->max_prec = tab->prec;
+    while (tab->max_prec > 0 && tab->n <= gamma_taylor_terms(tab->max_prec))
+        tab->max_prec -= tab->max_prec/64 + 1;
+}
+
+static int gamma_table_covers(gamma_coeff_table *tab, int prec)
+{
+    return tab != NULL && tab->max_prec >= prec;
+}
+
+/*
+The shared table, computed first if it does not cover prec bits yet.
+A table that falls short is replaced by one with at least 5/4 of its
+precision, so that a sequence of growing requests costs a bounded
+multiple of the last one. Two threads may both compute a table; the
+loser frees its copy.
+*/
+static gamma_coeff_table *gamma_coefficients(ffl_ctx_t ctx, int prec)
+{
+    gamma_coeff_table *tab, *expected;
+    int k, p;
+
+    expected = atomic_load_explicit(&gamma_table, memory_order_acquire);
+    if (gamma_table_covers(expected, prec))
+        return expected;
+
+    p = prec;
+    if (expected != NULL && expected->prec + expected->prec/4 > p)
+        p = expected->prec + expected->prec/4;
+
+    tab = gamma_new_table(gamma_taylor_terms(p) + 1, p);
+    gamma_taylor_coefficients(ctx, tab->coeff, tab->n, p);
+    for (k=1; k<tab->n; k++)
+        mpz_tdiv_q_2exp(tab->coeff[k], tab->coeff[k], k);
+    gamma_table_max_prec(tab);
+
+    expected = atomic_load_explicit(&gamma_table, memory_order_acquire);
+    do
+    {
+        if (gamma_table_covers(expected, p))
+        {
+            gamma_free_table(tab);
+            return expected;
+        }
+        tab->prev = expected;
+    }
+    while (!atomic_compare_exchange_weak_explicit(&gamma_table, &expected, tab,
+        memory_order_acq_rel, memory_order_acquire));
+
+    return tab;
+}
+
+/*
+The coefficients of tab truncated to tier precision T <= tab->prec,
+made first if needed. Two threads may both make a tier; the loser
+frees its copy.
+*/
+static gamma_coeff_tier *gamma_tier(gamma_coeff_table *tab, int T)
+{
+    _Atomic(gamma_coeff_tier *) *slot = &tab->tiers[T / GMP_NUMB_BITS];
+    gamma_coeff_tier *tier, *expected;
+    int k;
+
+    tier = atomic_load_explicit(slot, memory_order_acquire);
+    if (tier != NULL)
+        return tier;
+
+    tier = malloc(sizeof(gamma_coeff_tier));
+    tier->n = gamma_taylor_terms(T) + 1;
+    tier->prec = T;
+    tier->coeff = malloc(tier->n * sizeof(mpz_t));
+    for (k=0; k<tier->n; k++)
+    {
+        mpz_init(tier->coeff[k]);
+        mpz_tdiv_q_2exp(tier->coeff[k], tab->coeff[k], tab->prec - T);
+    }
+
+    expected = NULL;
+    if (!atomic_compare_exchange_strong_explicit(slot, &expected, tier,
+        memory_order_acq_rel, memory_order_acquire))
+    {
+        gamma_free_tier(tier);
+        return expected;
+    }
+
+    return tier;
+}
+
+/*
+Makes sure the shared coefficient table covers gamma_taylor at prec
+bits, so that the first call at that precision does not pay for it.
+*/
+void gamma_init_coefficients(ffl_ctx_t ctx, int prec)
+{
+    int T;
+
+    T = gamma_tier_prec(prec + 15, gamma_taylor_terms(prec + 15));
+    gamma_tier(gamma_coefficients(ctx, T), T);
+}
+
+/*
+Bytes of limbs held by the shared coefficient table, by its tiers, and
+the table would need with every coefficient at the full precision.
+*/
+void gamma_coefficients_memory(size_t *table, size_t *tiers, size_t *full)
+{
+    gamma_coeff_table *tab;
+    gamma_coeff_tier *tier;
+    int j, k;
+
+    *table = *tiers = *full = 0;
+
+    tab = atomic_load_explicit(&gamma_table, memory_order_acquire);
+    if (tab == NULL)
+        return;
+
+    for (k=0; k<tab->n; k++)
+    {
+        *table += mpz_size(tab->coeff[k]) * sizeof(mp_limb_t);
+        *full += (mpz_sizeinbase(tab->coeff[k], 2) + k + GMP_NUMB_BITS - 1)
+            / GMP_NUMB_BITS * sizeof(mp_limb_t);
+    }
+    for (j=0; j<=tab->prec/GMP_NUMB_BITS; j++)
+    {
+        tier = atomic_load_explicit(&tab->tiers[j], memory_order_acquire);
+        for (k=0; tier != NULL && k<tier->n; k++)
+            *tiers += mpz_size(tier->coeff[k]) * sizeof(mp_limb_t);
+    }
+}
+
+/*
+Precision of the shared coefficient table, 0 if there is none yet.
+*/
+int gamma_coefficients_prec()
+{
+    gamma_coeff_table *tab;
+
+    tab = atomic_load_explicit(&gamma_table, memory_order_acquire);
+    return tab == NULL ? 0 : tab->prec;
+}
+
+static void gamma_free_stirling(gamma_stirling_table *tab)
+{
+    int k;
+
+    for (k=0; k<tab->n; k++)
+    {
+        mpz_clear(tab->num[k]);
+        mpz_clear(tab->den[k]);
+    }
+    free(tab->num);
+    free(tab->den);
+    free(tab);
+}
+
+/*
+Frees every coefficient table, Stirling's included. Not thread-safe:
+no other thread may be evaluating gamma.
+*/
+void gamma_clear_coefficients()
+{
+    gamma_coeff_table *tab, *prev;
+    gamma_stirling_table *stab, *sprev;
+
+    tab = atomic_exchange_explicit(&gamma_table, NULL, memory_order_acq_rel);
+    while (tab != NULL)
+    {
+        prev = tab->prev;
+        gamma_free_table(tab);
+        tab = prev;
+    }
+
+    stab = atomic_exchange_explicit(&stirling_table, NULL, memory_order_acq_rel);
+    while (stab != NULL)
+    {
+        sprev = stab->prev;
+        gamma_free_stirling(stab);
+        stab = sprev;
+    }
+}
+
+/*
+Reads a coefficient table in the text format of gamma_data.txt, which
+the removed gammatest/gammaseries.py used to write: the precision on
+the first line, then one hexadecimal coefficient per line, each a
+plain fixed-point number with that precision. Coefficient k is divided
+by 2^k on reading to give the graded form kept in memory, and the
+table becomes the shared one. Returns the number of coefficients read,
+or -1 if the file could not be read. Not thread-safe. Kept for
+existing files only: gamma_init_coefficients computes the table, and
+save_gamma_coefficients (gammatest save) writes it in the binary
+format, to which gammatest convert also turns a text file.
+*/
+int load_gamma_coefficients_text(const char *filename)
+{
+    gamma_coeff_table *tab;
+    FILE *fp;
+    int j, k, prec;
+
+    fp = fopen(filename, "rt");
+
+    if (fp == NULL)
+        return -1;
+
+    if (fscanf(fp, "%d", &prec) != 1)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    tab = gamma_new_table(256, prec);
+    for (k=0; ; k++)
+    {
+        if (k == tab->n)
+        {
+            tab->coeff = realloc(tab->coeff, 2 * tab->n * sizeof(mpz_t));
+            for (j=tab->n; j<2*tab->n; j++)
+                mpz_init(tab->coeff[j]);
+            tab->n *= 2;
+        }
+        if (gmp_fscanf(fp, "%Zx\n", tab->coeff[k]) != 1)
+            break;
+    }
+
+    fclose(fp);
+
+    for ( ; tab->n > k; tab->n--)
+        mpz_clear(tab->coeff[tab->n - 1]);
+    for (k=1; k<tab->n; k++)
+        mpz_tdiv_q_2exp(tab->coeff[k], tab->coeff[k], k);
+    gamma_table_max_prec(tab);
+
+    tab->prev = atomic_load_explicit(&gamma_table, memory_order_acquire);
+    atomic_store_explicit(&gamma_table, tab, memory_order_release);
+
+    return tab->n;
+}
+
+/*
+Layout of the coefficient file: this header, then the signed limb
+count of each coefficient (int[n]), then the limbs of coefficient 0,
+1, ... packed one after the other from the next limb boundary.
+Coefficient k has prec-k bits, as in memory. As for the log lookup
+tables, the limbs are in GMP's native format.
+*/
+#define GAMMA_COEFF_MAGIC "FFLGAM2"
+
+typedef struct
+{
+    char magic[8];
+    int prec;
+    int limb_bits;
+    int n;
+    int reserved;
+} gamma_coeff_header;
+
+static size_t gamma_coeff_limbs_offset(int n)
+{
+    size_t off;
+
+    off = sizeof(gamma_coeff_header) + (size_t) n * sizeof(int);
+    return (off + sizeof(mp_limb_t) - 1) / sizeof(mp_limb_t) * sizeof(mp_limb_t);
+}
+
+/*
+Writes the shared table, computed first if it does not cover
+gamma_taylor at prec bits, to filename in the format read by
+load_gamma_coefficients. Returns 0 on success, -1 on failure.
+*/
+int save_gamma_coefficients(const char *filename, int prec)
+{
+    gamma_coeff_table *tab;
+    gamma_coeff_header h;
+    ffl_ctx_t ctx;
+    FILE *fp;
+    int *sizes;
+    size_t pad;
+    int k, n, ok;
+
+    ffl_init(ctx);
+    tab = gamma_coefficients(ctx, gamma_tier_prec(prec + 15, gamma_taylor_terms(prec + 15)));
+    ffl_clear(ctx);
+
+    fp = fopen(filename, "wb");
+    if (fp == NULL)
+        return -1;
+
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, GAMMA_COEFF_MAGIC);
+    h.prec = tab->prec;
+    h.limb_bits = GMP_LIMB_BITS;
+    h.n = tab->n;
+
+    sizes = malloc(tab->n * sizeof(int));
+    for (k=0; k<tab->n; k++)
+    {
+        n = mpz_size(tab->coeff[k]);
+        sizes[k] = (mpz_sgn(tab->coeff[k]) < 0) ? -n : n;
+    }
+
+    pad = gamma_coeff_limbs_offset(tab->n) - sizeof(h) - tab->n * sizeof(int);
+    ok = fwrite(&h, sizeof(h), 1, fp) == 1
+        && fwrite(sizes, sizeof(int), tab->n, fp) == (size_t) tab->n
+        && fwrite("\0\0\0\0\0\0\0", 1, pad, fp) == pad;
+    for (k=0; k<tab->n && ok; k++)
+        ok = fwrite(mpz_limbs_read(tab->coeff[k]), sizeof(mp_limb_t),
+            mpz_size(tab->coeff[k]), fp) == mpz_size(tab->coeff[k]);
+    ok = (fclose(fp) == 0) && ok;
+
+    free(sizes);
+
+    return ok ? 0 : -1;
+}
+
+/*
+Maps a table written by save_gamma_coefficients read-only and makes
+it the shared table. The coefficients are views into the mapping, so
+nothing is parsed or copied and the pages are shared with every other
+process mapping the file. Returns the number of coefficients, or -1
+if the file could not be mapped or was written with another limb
+size. Not thread-safe.
+*/
+int load_gamma_coefficients(const char *filename)
+{
+    struct stat st;
+    const gamma_coeff_header *h;
+    const int *sizes;
+    const mp_limb_t *limbs;
+    gamma_coeff_table *tab;
+    size_t size, nlimbs;
+    void *map;
+    int fd, k;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(gamma_coeff_header))
+    {
+        close(fd);
+        return -1;
+    }
+
+    size = st.st_size;
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    h = (const gamma_coeff_header *) map;
+    if (memcmp(h->magic, GAMMA_COEFF_MAGIC, sizeof(GAMMA_COEFF_MAGIC)) != 0
+        || h->limb_bits != GMP_LIMB_BITS || h->n < 1
+        || gamma_coeff_limbs_offset(h->n) > size)
+    {
+        munmap(map, size);
+        return -1;
+    }
+
+    sizes = (const int *) (h + 1);
+    limbs = (const mp_limb_t *) ((const char *) map + gamma_coeff_limbs_offset(h->n));
+
+    nlimbs = 0;
+    for (k=0; k<h->n; k++)
+        nlimbs += abs(sizes[k]);
+    if (gamma_coeff_limbs_offset(h->n) + nlimbs * sizeof(mp_limb_t) != size)
+    {
+        munmap(map, size);
+        return -1;
+    }
+
+    tab = malloc(sizeof(gamma_coeff_table));
+    tab->coeff = malloc(h->n * sizeof(mpz_t));
+    tab->n = h->n;
+    tab->prec = h->prec;
+    tab->tiers = calloc(h->prec/GMP_NUMB_BITS + 1, sizeof(gamma_coeff_tier *));
+    tab->map = map;
+    tab->map_size = size;
+    for (k=0; k<h->n; k++)
+    {
+        mpz_roinit_n(tab->coeff[k], limbs, sizes[k]);
+        limbs += abs(sizes[k]);
+    }
+    gamma_table_max_prec(tab);
+
+    tab->prev = atomic_load_explicit(&gamma_table, memory_order_acquire);
+    atomic_store_explicit(&gamma_table, tab, memory_order_release);
+
+    return tab->n;
+}
+
+/*
+y = sum_{k<=terms} c_k x^k with T bits, c_k being the coefficients of
+tier (with T-k bits) and x = ctx->gamma.ta with wp bits, |x| <= 1/2.
+y may be ctx->gamma.tb, but no other gamma scratch variable.
+
+J <= 1 uses Horner with T-k bits at step k. Otherwise the terms are
+split into blocks of J,
+
+  y = sum_i (sum_{j<J} c_{iJ+j} x^j) x^(iJ),
+
+with x^j kept with T+j bits, so that every c_{iJ+j} x^j in block i has
+2T-iJ bits and the block is summed with mpz_addmul and shifted once.
+As in the Horner scheme, the powers are cut to the magnitude of the
+largest coefficient in the block, and x^J to that of the running sum.
+In both cases an error in term k is scaled by |x|^k <= 2^-k, which the
+tier precision allows for.
+*/
+static void gamma_poly(ffl_ctx_t ctx, mpz_t y, gamma_coeff_tier *tier, int terms, int T, int wp, int J)
+{
+    int i, j, k, m, n, q, L;
+
+    if (J > MAX_GAMMA_J)
+        J = MAX_GAMMA_J;
+
+    mpz_mul_2exp(ctx->gamma.tc, ctx->gamma.ta, T-wp);
+
+    if (J <= 1)
+    {
+        /*
+        y has T-k-1 bits before step k, so with q = size(y)+2 bits
+        of x the product is still good to T-k bits
+        */
+        mpz_set(y, tier->coeff[terms]);
+        for (k=terms-1; k>=0; k--)
+        {
+            q = mpz_sizeinbase(y, 2) + 2;
+            if (q > T - GMP_NUMB_BITS)
+            {
+                /* Trimming would not save a limb */
+                mpz_mul(y, y, ctx->gamma.tc);
+                mpz_tdiv_q_2exp(y, y, T-1);
+            }
+            else
+            {
+                mpz_tdiv_q_2exp(ctx->gamma.td, ctx->gamma.tc, T-q);
+                mpz_mul(y, y, ctx->gamma.td);
+                mpz_tdiv_q_2exp(y, y, q-1);
+            }
+            mpz_add(y, y, tier->coeff[k]);
+        }
+        FFL_COUNT(ctx, muls, terms);
+        FFL_COUNT(ctx, terms, terms+1);
+        return;
+    }
+
+    /* pows[j] = x^j with T+j bits */
+    mpz_fixed_one(ctx->gamma.pows[0], T);
+    mpz_mul_2exp(ctx->gamma.pows[1], ctx->gamma.tc, 1);
+    for (j=2; j<=J; j++)
+    {
+        mpz_mul(ctx->gamma.pows[j], ctx->gamma.pows[j-1], ctx->gamma.pows[1]);
+        mpz_tdiv_q_2exp(ctx->gamma.pows[j], ctx->gamma.pows[j], T);
+    }
+    FFL_COUNT(ctx, muls, J-1);
+
+    m = terms / J;
+    for (i=m; i>=0; i--)
+    {
+        /*
+        td = block i with 2P-L bits, P = T-iJ, where the coefficients
+        of the block are below 2^-L, from x^j with P+j-L bits
+        */
+        n = (i*J+J-1 <= terms) ? J : terms-i*J+1;
+        L = T;
+        for (j=0; j<n; j++)
+        {
+            q = T-i*J-j - (int) mpz_sizeinbase(tier->coeff[i*J+j], 2) - 2;
+            if (q < L)
+                L = q;
+        }
+        if (L < 0)
+            L = 0;
+        mpz_set_ui(ctx->gamma.td, 0);
+        for (j=0; j<n; j++)
+        {
+            mpz_tdiv_q_2exp(ctx->gamma.te, ctx->gamma.pows[j], i*J+L);
+            mpz_addmul(ctx->gamma.td, tier->coeff[i*J+j], ctx->gamma.te);
+        }
+        mpz_tdiv_q_2exp(ctx->gamma.td, ctx->gamma.td, T-i*J-L);
+        FFL_COUNT(ctx, muls, n);
+        FFL_COUNT(ctx, terms, n);
+
+        if (i == m)
+        {
+            mpz_swap(y, ctx->gamma.td);
+        }
+        else
+        {
+            /* y = y x^J + block; y has P-J bits, so size(y)+J+2 bits of x^J do */
+            q = mpz_sizeinbase(y, 2) + J + 2;
+            if (q > T+J)
+                q = T+J;
+            mpz_tdiv_q_2exp(ctx->gamma.te, ctx->gamma.pows[J], T+J-q);
+            mpz_mul(y, y, ctx->gamma.te);
+            mpz_tdiv_q_2exp(y, y, q-J);
+            mpz_add(y, y, ctx->gamma.td);
+            FFL_COUNT(ctx, muls, 1);
+        }
+    }
+}
+
+/*
+Number of factors per block in gamma_rising: as many as keep the
+coefficients within a limb, or more at high precision, where the
+full multiplications dominate, but not so many that the coefficients
+(about p log2(steps) bits) become a sizeable fraction of wp, and not
+past the sqrt(steps) minimizing steps/p + p.
+*/
+static int gamma_rising_block(int steps, int wp)
+{
+    double L;
+    int p, q;
+
+    L = log2(steps + 1.0);
+    p = (int) (sizeof(unsigned long) * CHAR_BIT / L);
+    q = (int) (wp / (32 * L));
+    if (q > sqrt(steps))
+        q = (int) sqrt(steps);
+    if (q > p)
+        p = q;
+    if (p > MAX_GAMMA_RF)
+        p = MAX_GAMMA_RF;
+    if (p < 1)
+        p = 1;
+    return p;
+}
+
+/*
+rfac * 2^n = t (t+1) ... (t+steps-1), with t = ctx->gamma.ta >= 0.5
+and rfac with wp bits. Returns n. Uses ctx->gamma.pows for t^k.
+
+The factors are taken p at a time. A block
+
+  (t+m) (t+m+1) ... (t+m+p-1) = sum_{k<=p} c_k t^k
+
+has integer coefficients, which are expanded exactly and summed
+against the powers t^k with multiplications by short numbers only,
+so this costs steps/p + p full multiplications instead of steps.
+All the terms are positive, so nothing cancels.
+*/
+static int gamma_rising(ffl_ctx_t ctx, int steps, int wp, int p)
+{
+    int i, k, m, r, tmp;
+    int expt = 0;
+    unsigned long bound, c[MAX_GAMMA_RF+1];
+
+    if (p > MAX_GAMMA_RF)
+        p = MAX_GAMMA_RF;
+    if (p > steps)
+        p = steps;
+
+    /* pows[k] = t^k with wp bits */
+    mpz_set(ctx->gamma.pows[0], ctx->gamma.one);
+    mpz_set(ctx->gamma.pows[1], ctx->gamma.ta);
+    for (k=2; k<=p; k++)
+    {
+        mpz_mul(ctx->gamma.pows[k], ctx->gamma.pows[k-1], ctx->gamma.ta);
+        mpz_tdiv_q_2exp(ctx->gamma.pows[k], ctx->gamma.pows[k], wp);
+    }
+    FFL_COUNT(ctx, muls, p-1);
+
+    mpz_set(ctx->gamma.rfac, ctx->gamma.one);
+    for (m=0; m<steps; m+=p)
+    {
+        r = (steps-m < p) ? steps-m : p;
+
+        /*
+        The coefficients sum to (m+1) ... (m+r), so if that fits in a
+        limb, so do they
+        */
+        bound = 1;
+        for (i=0; i<r && bound; i++)
+            bound = (bound > ULONG_MAX / (m+i+1)) ? 0 : bound * (m+i+1);
+
+        if (bound)
+        {
+            /* c = (t+m) ... (t+m+r-1), multiplying in one factor at a time */
+            c[0] = 1;
+            for (i=0; i<r; i++)
+            {
+                c[i+1] = c[i];
+                for (k=i; k>=1; k--)
+                    c[k] = c[k] * (m+i) + c[k-1];
+                c[0] *= m+i;
+            }
+
+            mpz_mul_ui(ctx->gamma.te, ctx->gamma.one, c[0]);
+            for (k=1; k<=r; k++)
+                mpz_addmul_ui(ctx->gamma.te, ctx->gamma.pows[k], c[k]);
+        }
+        else
+        {
+            /* The same with mpz coefficients */
+            mpz_set_ui(ctx->gamma.rpoly[0], 1);
+            for (i=0; i<r; i++)
+            {
+                mpz_set(ctx->gamma.rpoly[i+1], ctx->gamma.rpoly[i]);
+                for (k=i; k>=1; k--)
+                {
+                    mpz_mul_ui(ctx->gamma.rpoly[k], ctx->gamma.rpoly[k], m+i);
+                    mpz_add(ctx->gamma.rpoly[k], ctx->gamma.rpoly[k], ctx->gamma.rpoly[k-1]);
+                }
+                mpz_mul_ui(ctx->gamma.rpoly[0], ctx->gamma.rpoly[0], m+i);
+            }
+
+            mpz_mul_2exp(ctx->gamma.te, ctx->gamma.rpoly[0], wp);
+            for (k=1; k<=r; k++)
+                mpz_addmul(ctx->gamma.te, ctx->gamma.rpoly[k], ctx->gamma.pows[k]);
+            FFL_COUNT(ctx, muls, r);
+
+            /* Keep wp bits of the block */
+            tmp = mpz_sizeinbase(ctx->gamma.te, 2) - wp - 1;
+            mpz_tdiv_q_2exp(ctx->gamma.te, ctx->gamma.te, tmp);
+            expt += tmp;
+        }
+
+        mpz_mul(ctx->gamma.rfac, ctx->gamma.rfac, ctx->gamma.te);
+        mpz_tdiv_q_2exp(ctx->gamma.rfac, ctx->gamma.rfac, wp);
+        FFL_COUNT(ctx, muls, 1);
+        tmp = mpz_sizeinbase(ctx->gamma.rfac, 2) - wp;
+        if (tmp > 0)
+        {
+            mpz_tdiv_q_2exp(ctx->gamma.rfac, ctx->gamma.rfac, tmp);
+            expt += tmp;
+        }
+    }
+
+    return expt;
+}
+
+/*
+    gamma(x) = y * 2^n
+
+    assumes x >= 0.5
+
+    n is set to a nonzero value if x >> 10^0
+
+    J is the block size of the polynomial evaluation (see gamma_poly)
+*/
+int gamma_taylor(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int J)
+{
+    int n, steps, terms, T;
+    int wp;
+    int expt = 0;
+    gamma_coeff_tier *tier;
+    wp = prec + 15;
+
+    terms = gamma_taylor_terms(wp);
+    T = gamma_tier_prec(wp, terms);
+    tier = gamma_tier(gamma_coefficients(ctx, T), T);
+
+    mpz_mul_2exp(ctx->gamma.ta, x, wp-prec);
+
+    mpz_set_ui(ctx->gamma.one, 1);
+    mpz_mul_2exp(ctx->gamma.one, ctx->gamma.one, wp);
+
+    /* Reduce to [0.5,1.5) */
+    mpz_tdiv_q_2exp(ctx->gamma.tb, ctx->gamma.ta, wp-1);
+    n = mpz_get_si(ctx->gamma.tb);
+    steps = (n-1)/2;
+    if (steps)
+    {
+        mpz_submul_ui(ctx->gamma.ta, ctx->gamma.one, steps);
+        expt = gamma_rising(ctx, steps, wp, gamma_rising_block(steps, wp));
+    }
+    else
+    {
+        mpz_set(ctx->gamma.rfac, ctx->gamma.one);
+    }
+
+    /* Polynomial is for G(1+x), so center on [-0.5,0.5) */
+    mpz_sub(ctx->gamma.ta, ctx->gamma.ta, ctx->gamma.one);
+
+    gamma_poly(ctx, ctx->gamma.tb, tier, terms, T, wp, J);
+    mpz_tdiv_q_2exp(ctx->gamma.tb, ctx->gamma.tb, T-wp);
+
+    mpz_mul_2exp(ctx->gamma.rfac, ctx->gamma.rfac, wp - (wp-prec));
+    mpz_div(y, ctx->gamma.rfac, ctx->gamma.tb);
+    FFL_COUNT(ctx, divs, 1);
+
+    return expt;
+}
+
+/*
+The Stirling coefficients for k = 1..n (at least), computed first if
+needed. They come from the tangent numbers T_k, using the algorithm of
+Brent and Harvey (O(n^2) multiplications by single limbs):
+
+  B_2k/(2k(2k-1)) = (-1)^(k-1) T_k / ((2k-1) 2^2k (2^2k-1)).
+
+A table that falls short is replaced by one at least twice as long;
+two threads may both compute one, and the loser frees its copy.
+*/
+static gamma_stirling_table *gamma_stirling_coefficients(int n)
+{
+    gamma_stirling_table *tab, *expected;
+    mpz_t g;
+    int j, k;
+
+    expected = atomic_load_explicit(&stirling_table, memory_order_acquire);
+    if (expected != NULL && expected->n >= n)
+        return expected;
+
+    if (expected != NULL && 2*expected->n > n)
+        n = 2*expected->n;
+
+    tab = malloc(sizeof(gamma_stirling_table));
+    tab->num = malloc(n * sizeof(mpz_t));
+    tab->den = malloc(n * sizeof(mpz_t));
+    for (k=0; k<n; k++)
+    {
+        mpz_init(tab->num[k]);
+        mpz_init(tab->den[k]);
+    }
+    tab->n = n;
+    tab->prev = NULL;
+
+    /* num[k-1] = T_k */
+    mpz_set_ui(tab->num[0], 1);
+    for (k=1; k<n; k++)
+        mpz_mul_ui(tab->num[k], tab->num[k-1], k);
+    for (k=2; k<=n; k++)
+    {
+        for (j=k; j<=n; j++)
+        {
+            mpz_mul_ui(tab->num[j-1], tab->num[j-1], j-k+2);
+            mpz_addmul_ui(tab->num[j-1], tab->num[j-2], j-k);
+        }
+    }
+
+    mpz_init(g);
+    for (k=1; k<=n; k++)
+    {
+        mpz_set_ui(tab->den[k-1], 1);
+        mpz_mul_2exp(tab->den[k-1], tab->den[k-1], 2*k);
+        mpz_sub_ui(tab->den[k-1], tab->den[k-1], 1);
+        mpz_mul_2exp(tab->den[k-1], tab->den[k-1], 2*k);
+        mpz_mul_ui(tab->den[k-1], tab->den[k-1], 2*k-1);
+
+        mpz_gcd(g, tab->num[k-1], tab->den[k-1]);
+        mpz_divexact(tab->num[k-1], tab->num[k-1], g);
+        mpz_divexact(tab->den[k-1], tab->den[k-1], g);
+        if (!(k % 2))
+            mpz_neg(tab->num[k-1], tab->num[k-1]);
+    }
+    mpz_clear(g);
+
+    expected = atomic_load_explicit(&stirling_table, memory_order_acquire);
+    do
+    {
+        if (expected != NULL && expected->n >= n)
+        {
+            gamma_free_stirling(tab);
+            return expected;
+        }
+        tab->prev = expected;
+    }
+    while (!atomic_compare_exchange_weak_explicit(&stirling_table, &expected, tab,
+        memory_order_acq_rel, memory_order_acquire));
+
+    return tab;
+}
+
+/*
+Smallest x for which gamma_stirling evaluates the series directly at
+prec bits; smaller x are first shifted up to it. The series reaches
+2^-wp with about pi x terms once x > wp log(2)/(2 pi) = 0.11 wp; going
+further trades terms for factors of the shift, and 0.2 wp was about
+the best from 53 to 10000 bits.
+*/
+double gamma_stirling_min_x(int prec)
+{
+    return 0.2 * (prec + 15) + 10;
+}
+
+/*
+z = z >> s, or z << -s for negative s
+*/
+static void gamma_shift(mpz_t z, int s)
+{
+    if (s >= 0)
+        mpz_tdiv_q_2exp(z, z, s);
+    else
+        mpz_mul_2exp(z, z, -s);
+}
+
+/*
+Makes sure ctx->gamma.lsqrt2pi has at least wp bits.
+log(sqrt(2 pi)) = log(pi/2)/2 + log(2).
+*/
+static void gamma_stirling_constants(ffl_ctx_t ctx, int wp)
+{
+    if (ctx->gamma.const_prec >= wp)
+        return;
+
+    wp += wp/4 + 10;
+
+    const_pi(ctx->gamma.tb, wp - 1);
+    ffl_log(ctx, ctx->gamma.lsqrt2pi, ctx->gamma.tb, wp);
+    mpz_tdiv_q_2exp(ctx->gamma.lsqrt2pi, ctx->gamma.lsqrt2pi, 1);
+    const_ln2(ctx->gamma.tb, wp);
+    mpz_add(ctx->gamma.lsqrt2pi, ctx->gamma.lsqrt2pi, ctx->gamma.tb);
+
+    ctx->gamma.const_prec = wp;
+}
+
+/*
+    gamma(x) = y * 2^n
+
+    assumes x >= 0.5
+
+Uses Stirling's series
+
+    log gamma(x) = (x-1/2) log(x) - x + log(sqrt(2 pi))
+                   + sum_{k=1}^N B_2k / (2k(2k-1) x^(2k-1)),
+
+truncated at the first term below 2^-wp (the remainder is smaller than
+that term), after shifting x up to gamma_stirling_min_x with the rising
+factorial. Then gamma(x) = exp(log gamma(x)) = y * 2^n by ffl_exp.
+
+Term k is needed to 2^-wp absolute only, so the products get shorter
+as the terms get smaller.
+*/
+int gamma_stirling(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    gamma_stirling_table *tab;
+    double xd, lx, lt, prev_lt, lf;
+    long e, m, n;
+    int k, N, g, gprev, d, q, steps, ex, Eu, wl, gs;
+    int wp;
+    int expt = 0;
+
+    /* Shift up to min_x; the rising factorial loses about log2(steps) bits */
+    xd = mpz_get_d_2exp(&e, x);
+    xd = ldexp(xd, e - prec);
+    steps = 0;
+    if (xd < gamma_stirling_min_x(prec))
+        steps = (int) ceil(gamma_stirling_min_x(prec) - xd);
+
+    wp = prec + 15 + (steps ? (int) log2(steps) : 0);
+
+    gamma_stirling_constants(ctx, wp);
+
+    mpz_mul_2exp(ctx->gamma.ta, x, wp-prec);
+    mpz_fixed_one(ctx->gamma.one, wp);
+
+    if (steps)
+    {
+        expt = gamma_rising(ctx, steps, wp, gamma_rising_block(steps, wp));
+        mpz_addmul_ui(ctx->gamma.ta, ctx->gamma.one, steps);
+        xd += steps;
+    }
+
+    /* Terms, estimating |B_2k/(2k(2k-1))| by 2 (2k-2)!/(2 pi)^2k */
+    lx = log2(xd);
+    prev_lt = 0;
+    lf = 0;
+    N = 0;
+    for (k=1; ; k++)
+    {
+        /* lf = log((2k-2)!); lgamma would set signgam, which is shared */
+        if (k > 1)
+            lf += log((2.0*k-3) * (2.0*k-2));
+        lt = (1 + (lf - 2*k*log(2*M_PI)) / log(2)) - (2*k-1)*lx;
+        if (lt < -wp-2 || (k > 1 && lt > prev_lt))
+            break;
+        prev_lt = lt;
+        N = k;
+    }
+
+    tab = gamma_stirling_coefficients(N);
+
+    /* Guard bits for the N terms, each off by a few units in the last place */
+    gs = 4 + (int) log2(N + 1);
+
+    /* td = 1/x^2 with Eu bits, a little more than wp significant */
+    ex = mpz_sizeinbase(ctx->gamma.ta, 2) - wp;
+    Eu = wp + 2*ex + 4 + gs;
+    mpz_mul(ctx->gamma.te, ctx->gamma.ta, ctx->gamma.ta);
+    mpz_fixed_one(ctx->gamma.td, Eu + 2*wp);
+    mpz_tdiv_q(ctx->gamma.td, ctx->gamma.td, ctx->gamma.te);
+
+    /*
+    tb = sum_k c_k x^(1-2k) with wp+gs bits. |c_k| < 2^g, so
+    tc = x^(1-2k) is kept with wp+g+gs bits, which shrinks to about
+    wp + log2|term k| significant bits, and c_k is cut to match.
+    */
+    mpz_set_ui(ctx->gamma.tb, 0);
+    gprev = 0;
+    for (k=1; k<=N; k++)
+    {
+        g = (int) mpz_sizeinbase(tab->num[k-1], 2) - (int) mpz_sizeinbase(tab->den[k-1], 2) + 1;
+        if (g < 0)
+            g = 0;
+
+        if (k == 1)
+        {
+            mpz_fixed_one(ctx->gamma.tc, wp + g + gs + wp);
+            mpz_tdiv_q(ctx->gamma.tc, ctx->gamma.tc, ctx->gamma.ta);
+        }
+        else
+        {
+            /* tc *= 1/x^2 with as many bits as tc has */
+            q = mpz_sizeinbase(ctx->gamma.tc, 2) + 2;
+            d = (int) mpz_sizeinbase(ctx->gamma.td, 2) - q;
+            if (d < 0)
+                d = 0;
+            mpz_tdiv_q_2exp(ctx->gamma.te, ctx->gamma.td, d);
+            mpz_mul(ctx->gamma.tc, ctx->gamma.tc, ctx->gamma.te);
+            gamma_shift(ctx->gamma.tc, Eu - d + gprev - g);
+        }
+        gprev = g;
+
+        /* num_k without the bits that fall below 2^-(wp+gs) */
+        d = g + (int) mpz_sizeinbase(tab->den[k-1], 2) - 1 - (int) mpz_sizeinbase(ctx->gamma.tc, 2);
+        if (d < 0)
+            d = 0;
+        mpz_tdiv_q_2exp(ctx->gamma.te, tab->num[k-1], d);
+        mpz_mul(ctx->gamma.te, ctx->gamma.te, ctx->gamma.tc);
+        if (d > g)
+        {
+            /* scale up before dividing, or the rounding error grows too */
+            mpz_mul_2exp(ctx->gamma.te, ctx->gamma.te, d - g);
+            mpz_tdiv_q(ctx->gamma.te, ctx->gamma.te, tab->den[k-1]);
+        }
+        else
+        {
+            mpz_tdiv_q(ctx->gamma.te, ctx->gamma.te, tab->den[k-1]);
+            mpz_tdiv_q_2exp(ctx->gamma.te, ctx->gamma.te, g - d);
+        }
+        mpz_add(ctx->gamma.tb, ctx->gamma.tb, ctx->gamma.te);
+    }
+    mpz_tdiv_q_2exp(ctx->gamma.tb, ctx->gamma.tb, gs);
+
+    /*
+    log(x) = log(x/2^m) + m log(2) with x/2^m in [1,2), good to
+    2^-(wp+ex) so that (x-1/2) log(x) is good to 2^-wp
+    */
+    m = ex - 1;
+    wl = wp + ex + 2;
+
+    mpz_mul_2exp(ctx->gamma.tc, ctx->gamma.ta, wl-wp-m);
+    ffl_log(ctx, ctx->gamma.td, ctx->gamma.tc, wl);
+    const_ln2(ctx->gamma.te, wl + ex + 2);
+    mpz_mul_si(ctx->gamma.te, ctx->gamma.te, m);
+    mpz_tdiv_q_2exp(ctx->gamma.te, ctx->gamma.te, ex + 2);
+    mpz_add(ctx->gamma.td, ctx->gamma.td, ctx->gamma.te);
+
+    /* tb += (x-1/2) log(x) - x + log(sqrt(2 pi)) */
+    mpz_tdiv_q_2exp(ctx->gamma.tc, ctx->gamma.one, 1);
+    mpz_sub(ctx->gamma.tc, ctx->gamma.ta, ctx->gamma.tc);
+    mpz_mul(ctx->gamma.tc, ctx->gamma.tc, ctx->gamma.td);
+    mpz_tdiv_q_2exp(ctx->gamma.tc, ctx->gamma.tc, wl);
+    mpz_add(ctx->gamma.tb, ctx->gamma.tb, ctx->gamma.tc);
+    mpz_sub(ctx->gamma.tb, ctx->gamma.tb, ctx->gamma.ta);
+    mpz_tdiv_q_2exp(ctx->gamma.tc, ctx->gamma.lsqrt2pi, ctx->gamma.const_prec - wp);
+    mpz_add(ctx->gamma.tb, ctx->gamma.tb, ctx->gamma.tc);
+
+    n = ffl_exp(ctx, ctx->gamma.tc, ctx->gamma.tb, wp);
+
+    if (steps)
+    {
+        mpz_mul_2exp(ctx->gamma.tc, ctx->gamma.tc, prec);
+        mpz_tdiv_q(y, ctx->gamma.tc, ctx->gamma.rfac);
+    }
+    else
+    {
+        mpz_tdiv_q_2exp(y, ctx->gamma.tc, wp-prec);
+    }
+
+    return n - expt;
+}
+
+/*
+Smallest x for which ffl_gamma uses gamma_stirling rather than
+gamma_taylor at prec bits. Measured crossovers: about 40 at 53 bits,
+200 at 1000 bits, 500-700 at 3000 bits, 2000 at 10000 bits. See
+benchmark_stirling_gamma in gammatest.
+*/
+double gamma_stirling_cutoff(int prec)
+{
+    return 0.2 * (prec + 15) + 30;
+}
+
+/*
+    gamma(x) = y * 2^n
+
+    assumes x >= 0.5
+
+gamma_taylor (with the argument reduction) for small x, gamma_stirling
+for large x, and for every x once the tier precision of gamma_taylor
+exceeds GAMMA_TAYLOR_MAX_PREC.
+*/
+int ffl_gamma(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    double xd;
+    long e;
+
+    xd = mpz_get_d_2exp(&e, x);
+    xd = ldexp(xd, e - prec);
+
+    if (xd >= gamma_stirling_cutoff(prec)
+        || gamma_tier_prec(prec + 15, gamma_taylor_terms(prec + 15)) > GAMMA_TAYLOR_MAX_PREC)
+        return gamma_stirling(ctx, y, x, prec);
+
+    return gamma_taylor(ctx, y, x, prec, GAMMA_DEFAULT_J);
+}
@@ -0,0 +1,1166 @@
+/*
+Logarithm.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include <string.h>
+#include <pthread.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fastfun.h"
+
+/*
+Tuned (r, J, lut) for log_series, indexed by precision in steps of
+TUNE_PREC_STEP bits, filled by load_log_tuning. A zero J means
+untuned.
+*/
+unsigned char log_tune_r[TUNE_SIZE];
+unsigned char log_tune_J[TUNE_SIZE];
+unsigned char log_tune_lut[TUNE_SIZE];
+
+/*
+Lookup tables shared by all threads, pointing read-only into the file
+mapped by load_log_lut, in the slot order of log_lut_index. When
+log_lut_loaded is set, log_series_eval uses them instead of the lazy
+tables for working precisions up to LOG_LUT_PREC.
+*/
+mpz_t log_lut_table[LOG_LUT_SLOTS];
+int log_lut_loaded = 0;
+
+static void *log_lut_map = NULL;
+static size_t log_lut_map_size = 0;
+
+/*
+Lookup tables filled lazily when no precomputed table is loaded (or
+above LOG_LUT_PREC), shared by all threads.
+
+A slot points to the most precise node computed so far. A node is
+computed into its own mpz and published with a single
+compare-and-swap of the slot, so readers take no lock and never see a
+partially written value. Two threads may both compute a missing
+entry; the loser frees its copy. A more precise node keeps the one it
+replaces in next, since readers may still be using it. Nodes are only
+freed by clear_log_lut.
+*/
+typedef struct log_lut_node
+{
+    mpz_t value;
+    int prec;
+    struct log_lut_node *next;
+} log_lut_node;
+
+static log_lut_node *_Atomic log_lut_lazy[LOG_LUT_SLOTS];
+
+/*
+Layout of the lookup table file: this header, then the signed limb
+count of each slot (int[entries], in the order of log_lut_index),
+then entries*stride limbs with slot i starting at limb i*stride. The
+limbs are in GMP's native format, so a table is only valid on
+machines with the same limb size and byte order as the one that wrote
+it.
+*/
+#define LOG_LUT_MAGIC "FFLLUT2"
+#define LOG_LUT_STRIDE (LOG_LUT_PREC/GMP_NUMB_BITS + 1)
+
+typedef struct
+{
+    char magic[8];
+    int step;
+    int prec;
+    int limb_bits;
+    int entries;
+    int stride;
+    int levels;
+} log_lut_header;
+
+void log_init_data(ffl_ctx_t ctx)
+{
+    int i;
+    mpz_init(ctx->log.x);
+    mpz_init(ctx->log.x2);
+    mpz_init(ctx->log.m);
+    mpz_init(ctx->log.one);
+    mpz_init(ctx->log.t);
+    mpz_init(ctx->log.a);
+    mpz_init(ctx->log.s0);
+    mpz_init(ctx->log.s1);
+    for (i=0; i<MAX_SERIES_STEPS; i++)
+    {
+        mpz_init(ctx->log.pows[i]);
+        mpz_init(ctx->log.sums[i]);
+    }
+    ctx->log.prec = ctx->log.r = ctx->log.wp = -1;
+}
+
+void log_clear_data(ffl_ctx_t ctx)
+{
+    int i;
+    mpz_clear(ctx->log.x);
+    mpz_clear(ctx->log.x2);
+    mpz_clear(ctx->log.m);
+    mpz_clear(ctx->log.one);
+    mpz_clear(ctx->log.t);
+    mpz_clear(ctx->log.a);
+    mpz_clear(ctx->log.s0);
+    mpz_clear(ctx->log.s1);
+    for (i=0; i<MAX_SERIES_STEPS; i++)
+    {
+        mpz_clear(ctx->log.pows[i]);
+        mpz_clear(ctx->log.sums[i]);
+    }
+}
+
+/*
+Level 0 has the LOG_LUT_SIZE entries k >= 0, every higher level the
+2*LOG_LUT_SIZE entries LOG_LUT_KMIN <= k < LOG_LUT_KMAX, one level
+after the other. After level 0 with index k0, level 1 needs k up to
+2^(2*LOG_LUT_STEP)/(k0+1), so the tables are built for k0 >= 260,
+i.e. x >= 0.508, which covers the [1/sqrt(2), sqrt(2)) of ffl_log.
+Below that log_lut_reduce clamps k, level 1 only partly reduces x and
+the series takes more terms. k < 0 only happens when rounding leaves
+x just below 1.
+*/
+#define LOG_LUT_KMIN (-16)
+#define LOG_LUT_KMAX (2*LOG_LUT_SIZE + LOG_LUT_KMIN)
+
+static int log_lut_index(int level, int k)
+{
+    if (level == 0)
+        return k;
+    return (2*level - 1) * LOG_LUT_SIZE + k - LOG_LUT_KMIN;
+}
+
+/*
+Whether k is an entry of the given level; any other k would index the
+slots of another level (or past the table).
+*/
+static int log_lut_in_range(int level, int k)
+{
+    if (level == 0)
+        return k >= 1 && k < LOG_LUT_SIZE;
+    return k >= LOG_LUT_KMIN && k < LOG_LUT_KMAX;
+}
+
+/*
+Entry k of the given level with at least wp bits, or NULL if it has
+not been computed to that precision yet. *eprec is set to the
+precision of the entry.
+*/
+static mpz_srcptr log_lut_lookup(int level, int k, int wp, int *eprec)
+{
+    log_lut_node *node;
+
+    if (log_lut_loaded && wp <= LOG_LUT_PREC)
+    {
+        *eprec = LOG_LUT_PREC;
+        return log_lut_table[log_lut_index(level, k)];
+    }
+
+    node = atomic_load_explicit(&log_lut_lazy[log_lut_index(level, k)], memory_order_acquire);
+    if (node == NULL || node->prec < wp)
+        return NULL;
+
+    *eprec = node->prec;
+    return node->value;
+}
+
+/*
+Computes entry k of the given level with LOG_LUT_PREC*2^j >= wp bits
+and publishes it unless another thread got there first. Returns the
+published entry and sets *eprec to its precision. Changes the setup
+of ctx.
+*/
+static mpz_srcptr log_lut_fill(ffl_ctx_t ctx, int level, int k, int wp, int *eprec)
+{
+    _Atomic(log_lut_node *) *slot = &log_lut_lazy[log_lut_index(level, k)];
+    log_lut_node *node, *expected;
+    int prec;
+
+    prec = LOG_LUT_PREC;
+    while (prec < wp)
+        prec *= 2;
+
+    node = malloc(sizeof(log_lut_node));
+    mpz_init(node->value);
+    log_lut_entry(ctx, node->value, level, k, prec);
+    node->prec = prec;
+
+    expected = atomic_load_explicit(slot, memory_order_acquire);
+    do
+    {
+        if (expected != NULL && expected->prec >= wp)
+        {
+            mpz_clear(node->value);
+            free(node);
+            *eprec = expected->prec;
+            return expected->value;
+        }
+        node->next = expected;
+    }
+    while (!atomic_compare_exchange_weak_explicit(slot, &expected, node,
+        memory_order_acq_rel, memory_order_acquire));
+
+    *eprec = prec;
+    return node->value;
+}
+
+/*
+Table-driven argument reduction over the given number of levels, for
+a context set up by log_series_setup. Sets ctx->log.x to x (at the
+working precision) times 2^LOG_LUT_STEP/idx[0] and times
+(1 - idx[i]/2^(LOG_LUT_STEP*(i+1))) for each level i >= 1, so that
+log(x) is log(ctx->log.x) plus the corresponding table entries. Level
+0 leaves ctx->log.x within 2^-8 of 1 (for x >= 1/2) and each further
+level gains another LOG_LUT_STEP bits. The factors of the higher
+levels are short, so applying them is linear in the precision.
+Returns 0 if x is outside [2^-LOG_LUT_STEP, 2), where level 0 has no
+entry, and 1 otherwise.
+*/
+static int log_lut_reduce(ffl_ctx_t ctx, mpz_t x, int levels, int *idx)
+{
+    int i, m;
+    int prec = ctx->log.prec;
+    int wp = ctx->log.wp;
+    long k, e;
+    double v;
+
+    mpz_mul_2exp(ctx->log.x, x, wp-prec);
+
+    // write x = t + k/2^n, log(k/2^n) cached,
+    // so that log(x) = log(k/2^n) + log(1 + (x-t)/t)
+    mpz_tdiv_q_2exp(ctx->log.t, ctx->log.x, wp-LOG_LUT_STEP);
+    if (mpz_sgn(ctx->log.t) <= 0 || mpz_cmp_ui(ctx->log.t, LOG_LUT_SIZE) >= 0)
+        return 0;
+    idx[0] = mpz_get_ui(ctx->log.t);
+
+    // t = k/2^n
+    // 1+(x-t)/t = = 1 + (x-t)*(2^n/k) = x*2^n/k
+    mpz_mul_2exp(ctx->log.x, ctx->log.x, LOG_LUT_STEP);
+    mpz_tdiv_q_ui(ctx->log.x, ctx->log.x, idx[0]);
+    FFL_COUNT(ctx, divs_ui, 1);
+
+    for (i=1; i<levels; i++)
+    {
+        // x*(1 - k/2^m) ~= 1 for k ~= 2^m*(1 - 1/x); the leading
+        // bits of x are enough to pick k
+        m = LOG_LUT_STEP*(i+1);
+        v = mpz_get_d_2exp(&e, ctx->log.x);
+        k = (long) floor(ldexp(1.0 - 1.0/ldexp(v, e-wp), m));
+        if (k < LOG_LUT_KMIN)
+            k = LOG_LUT_KMIN;
+        if (k > LOG_LUT_KMAX-1)
+            k = LOG_LUT_KMAX-1;
+        idx[i] = k;
+
+        if (k != 0)
+        {
+            mpz_mul_si(ctx->log.t, ctx->log.x, k);
+            mpz_tdiv_q_2exp(ctx->log.t, ctx->log.t, m);
+            mpz_sub(ctx->log.x, ctx->log.x, ctx->log.t);
+        }
+    }
+
+    return 1;
+}
+
+/*
+y = log(x) for a fixed-point x with prec bits, using _use_lut levels
+of the lookup tables, r square roots and a series split into J sums.
+x must be positive, and in [2^-LOG_LUT_STEP, 2) if _use_lut > 0; the
+tables reduce fully from about 1/2 on (see LOG_LUT_KMIN), smaller x
+are still correct but slower. Returns 0, or -1 without touching y for
+other x.
+*/
+int log_series(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J, int _use_lut)
+{
+    log_series_setup(ctx, prec, r);
+    return log_series_eval(ctx, y, x, J, _use_lut);
+}
+
+/*
+Everything in log_series that depends only on (prec, r): the working
+precision, the fixed-point one, and the scratch allocations (the
+square roots are taken of 2*wp-bit numbers). A no-op when the context
+is already set up for (prec, r).
+*/
+void log_series_setup(ffl_ctx_t ctx, int prec, int r)
+{
+    int i, wp;
+
+    if (ctx->log.prec == prec && ctx->log.r == r)
+        return;
+
+    wp = prec + r + 10;
+
+    ctx->log.prec = prec;
+    ctx->log.r = r;
+    ctx->log.wp = wp;
+
+    mpz_fixed_one(ctx->log.one, wp);
+
+    mpz_reserve(ctx->log.x, 2*wp+64);
+    mpz_reserve(ctx->log.t, 2*wp+64);
+    mpz_reserve(ctx->log.a, 2*wp+64);
+    for (i=0; i<MAX_SERIES_STEPS; i++)
+    {
+        mpz_reserve(ctx->log.pows[i], 2*wp+64);
+        mpz_reserve(ctx->log.sums[i], 2*wp+64);
+    }
+}
+
+/*
+y = atanh(z) = z + z^3/3 + z^5/5 + ... for z = ctx->log.x (wp bits,
+|z| < 1/2) with rectangular splitting into J sums. Overwrites
+ctx->log.x.
+*/
+static void log_atanh_series(ffl_ctx_t ctx, mpz_t y, int J)
+{
+    int i, k;
+    int wp = ctx->log.wp;
+
+    for (i=0; i<J; i++)
+    {
+        if (i == 0)
+        {
+            mpz_set(ctx->log.pows[i], ctx->log.one);
+        }
+        else if (i == 1)
+        {
+            mpz_mul(ctx->log.pows[i], ctx->log.x, ctx->log.x);
+            mpz_tdiv_q_2exp(ctx->log.pows[i], ctx->log.pows[i], wp);
+        }
+        else
+        {
+            mpz_mul(ctx->log.pows[i], ctx->log.pows[i-1], ctx->log.pows[1]);
+            mpz_tdiv_q_2exp(ctx->log.pows[i], ctx->log.pows[i], wp);
+        }
+        mpz_set_ui(ctx->log.sums[i], 0);
+    }
+    FFL_COUNT(ctx, muls, J);
+
+    if (J == 1)
+    {
+        mpz_set(ctx->log.a, ctx->log.x);
+        mpz_mul(ctx->log.x, ctx->log.x, ctx->log.x);
+        mpz_tdiv_q_2exp(ctx->log.x, ctx->log.x, wp);
+    }
+    else
+    {
+        mpz_set(ctx->log.a, ctx->log.x);
+        mpz_mul(ctx->log.x, ctx->log.pows[J-1], ctx->log.pows[1]);
+        mpz_tdiv_q_2exp(ctx->log.x, ctx->log.x, wp);
+    }
+
+    // Main Taylor series loop
+    k = 1;
+    while (mpz_sgn(ctx->log.a) != 0)
+    {
+        for (i=0; i<J; i++)
+        {
+            mpz_tdiv_q_ui(ctx->log.t, ctx->log.a, k);
+            mpz_add(ctx->log.sums[i], ctx->log.sums[i], ctx->log.t);
+            k += 2;
+        }
+        mpz_mul(ctx->log.a, ctx->log.a, ctx->log.x);
+        mpz_tdiv_q_2exp(ctx->log.a, ctx->log.a, wp);
+        FFL_COUNT(ctx, terms, J);
+        FFL_COUNT(ctx, divs_ui, J);
+        FFL_COUNT(ctx, muls, 1);
+    }
+
+    for (i=1; i<J; i++)
+    {
+        mpz_mul(ctx->log.sums[i], ctx->log.sums[i], ctx->log.pows[i]);
+        mpz_tdiv_q_2exp(ctx->log.sums[i], ctx->log.sums[i], wp);
+    }
+    FFL_COUNT(ctx, muls, J-1);
+
+    mpz_set_ui(y, 0);
+    for (i=0; i<J; i++)
+    {
+        mpz_add(y, y, ctx->log.sums[i]);
+    }
+}
+
+/*
+log_series_eval, with the series summed by log_atanh_mpn if mpn is
+set and the working precision has an mpn kernel.
+*/
+static int log_series_run(ffl_ctx_t ctx, mpz_t y, mpz_t x, int J, int _use_lut, int mpn)
+{
+    int i;
+    int levels, missing;
+    int idx[LOG_LUT_LEVELS];
+    int lut_prec[LOG_LUT_LEVELS];
+    mpz_srcptr lut[LOG_LUT_LEVELS];
+    int prec = ctx->log.prec;
+    int r = ctx->log.r;
+    int wp = ctx->log.wp;
+
+    levels = _use_lut;
+    if (levels < 0)
+        levels = 0;
+    if (levels > LOG_LUT_LEVELS)
+        levels = LOG_LUT_LEVELS;
+
+    if (mpz_sgn(x) <= 0)
+        return -1;
+
+    if (levels == 0)
+    {
+        mpz_mul_2exp(ctx->log.x, x, wp-prec);
+    }
+    else
+    {
+        if (!log_lut_reduce(ctx, x, levels, idx))
+            return -1;
+
+        missing = 0;
+        for (i=0; i<levels; i++)
+        {
+            lut[i] = NULL;
+            if (!log_lut_in_range(i, idx[i]))
+                return -1;
+            if (i == 0 || idx[i] != 0)
+            {
+                lut[i] = log_lut_lookup(i, idx[i], wp, &lut_prec[i]);
+                missing |= (lut[i] == NULL);
+            }
+        }
+
+        if (missing)
+        {
+            for (i=0; i<levels; i++)
+            {
+                if ((i == 0 || idx[i] != 0) && lut[i] == NULL)
+                    lut[i] = log_lut_fill(ctx, i, idx[i], wp, &lut_prec[i]);
+            }
+
+            // Note: need to restore overwritten variables
+            log_series_setup(ctx, prec, r);
+            log_lut_reduce(ctx, x, levels, idx);
+        }
+    }
+
+    for (i=0; i<r; i++)
+    {
+        mpz_mul_2exp(ctx->log.x, ctx->log.x, wp);
+        mpz_sqrt(ctx->log.x, ctx->log.x);
+    }
+    FFL_COUNT(ctx, sqrts, r);
+
+    mpz_add(ctx->log.t, ctx->log.x, ctx->log.one);
+    mpz_sub(ctx->log.x, ctx->log.x, ctx->log.one);
+    mpz_mul_2exp(ctx->log.x, ctx->log.x, wp);
+    mpz_tdiv_q(ctx->log.x, ctx->log.x, ctx->log.t);
+    FFL_COUNT(ctx, divs, 1);
+
+    if (J < 1)
+        J = 1;
+
+    if (!mpn || !log_atanh_mpn(ctx, y, ctx->log.x, wp, J))
+        log_atanh_series(ctx, y, J);
+
+    if (levels > 0)
+    {
+        mpz_mul_2exp(y, y, r+1);
+        for (i=0; i<levels; i++)
+        {
+            if (lut[i] == NULL)
+                continue;
+            mpz_tdiv_q_2exp(ctx->log.t, lut[i], lut_prec[i]-wp);
+            mpz_add(y, y, ctx->log.t);
+        }
+        mpz_tdiv_q_2exp(y, y, wp-prec);
+    }
+    else
+    {
+        mpz_tdiv_q_2exp(y, y, wp-prec-r-1);
+    }
+
+    return 0;
+}
+
+/*
+log_series for a context already set up by log_series_setup.
+*/
+int log_series_eval(ffl_ctx_t ctx, mpz_t y, mpz_t x, int J, int _use_lut)
+{
+    return log_series_run(ctx, y, x, J, _use_lut, 0);
+}
+
+/*
+log_series with the series on the fixed-size mpn kernels of mpn.c
+(see log_atanh_mpn) when the working precision has at most
+MPN_MAX_LIMBS limbs. The reduction and the tables are the same.
+*/
+int log_series_mpn(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J, int _use_lut)
+{
+    log_series_setup(ctx, prec, r);
+    return log_series_run(ctx, y, x, J, _use_lut, 1);
+}
+
+/*
+Default (r, J, lut) for precisions without a tuning entry.
+*/
+void log_default_params(int prec, int *r, int *J, int *lut)
+{
+    if (prec < 200)
+    {
+        *r = 0;
+        *J = 1;
+        *lut = 1;
+    }
+    else
+    {
+        *r = 0;
+        *J = (prec < 2000) ? 2 : (prec < 8000) ? 4 : 8;
+        *lut = LOG_LUT_LEVELS;
+    }
+}
+
+/*
+Reads a tuning file written by benchmark_optimize_log. Each line is
+
+  prec r J lut
+
+with increasing prec; lines starting with # are ignored. Every
+precision up to TUNE_MAX_PREC gets the entry of the smallest tuned
+precision at or above it (or the largest one). Not thread-safe: call
+once before evaluating. Returns the number of entries read, or -1 if
+the file could not be opened.
+*/
+int load_log_tuning(const char *filename)
+{
+    FILE *fp;
+    char line[256];
+    int tprec[TUNE_SIZE], tr[TUNE_SIZE], tJ[TUNE_SIZE], tlut[TUNE_SIZE];
+    int i, j, n, prec;
+
+    fp = fopen(filename, "rt");
+    if (fp == NULL)
+        return -1;
+
+    n = 0;
+    while (n < TUNE_SIZE && fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%d %d %d %d", &tprec[n], &tr[n], &tJ[n], &tlut[n]) != 4)
+            continue;
+        if (tr[n] < 0 || tr[n] > 255 || tJ[n] < 1 || tJ[n] >= MAX_SERIES_STEPS)
+            continue;
+        n++;
+    }
+    fclose(fp);
+
+    if (n == 0)
+        return 0;
+
+    for (i=0, j=0; i<TUNE_SIZE; i++)
+    {
+        prec = i * TUNE_PREC_STEP;
+        while (j < n-1 && tprec[j] < prec)
+            j++;
+        log_tune_r[i] = tr[j];
+        log_tune_J[i] = tJ[j];
+        log_tune_lut[i] = (tlut[j] < 0) ? 0 : (tlut[j] > LOG_LUT_LEVELS) ? LOG_LUT_LEVELS : tlut[j];
+    }
+
+    return n;
+}
+
+/*
+Writes n (prec, r, J, lut) rows in the format read by load_log_tuning.
+Returns 0 on success.
+*/
+int save_log_tuning(const char *filename, int *prec, int *r, int *J, int *lut, int n)
+{
+    FILE *fp;
+    int i;
+
+    fp = fopen(filename, "wt");
+    if (fp == NULL)
+        return -1;
+
+    fprintf(fp, "# log_series tuning: prec r J lut\n");
+    for (i=0; i<n; i++)
+        fprintf(fp, "%d %d %d %d\n", prec[i], r[i], J[i], lut[i]);
+
+    return fclose(fp);
+}
+
+/*
+(r, J, lut) for log_series at precision prec: the tuned entry if there
+is one, otherwise the default.
+*/
+void log_tuned_params(int prec, int *r, int *J, int *lut)
+{
+    int i = (prec + TUNE_PREC_STEP - 1) / TUNE_PREC_STEP;
+
+    if (i < TUNE_SIZE && log_tune_J[i] != 0)
+    {
+        *r = log_tune_r[i];
+        *J = log_tune_J[i];
+        *lut = log_tune_lut[i];
+    }
+    else
+    {
+        log_default_params(prec, r, J, lut);
+    }
+}
+
+/*
+a = the arithmetic-geometric mean of the fixed-point numbers a and b
+(both positive, with the same number of fractional bits). b is
+overwritten. The first steps amplify
+the absolute error of b by up to sqrt(a/b), and a tiny b has few
+significant bits, so a b near 2^-m needs about m extra bits of
+working precision (m/2 if b is exact).
+*/
+void fix_agm(ffl_ctx_t ctx, mpz_t a, mpz_t b)
+{
+    for (;;)
+    {
+        mpz_sub(ctx->log.t, a, b);
+        if (mpz_cmpabs_ui(ctx->log.t, 4) <= 0)
+            break;
+        mpz_mul(ctx->log.t, a, b);
+        mpz_add(a, a, b);
+        mpz_tdiv_q_2exp(a, a, 1);
+        mpz_sqrt(b, ctx->log.t);
+    }
+}
+
+/*
+y = log(x) for a fixed-point x > 0 with prec bits, using
+
+  log(x) = pi/(2*AGM(1, 4/s)) - m*log(2),  s = x*2^m,
+
+which is exact to O(log(s)/s^2), with m chosen so that s > 2^(wp/2+8).
+O(M(prec) log(prec)) with pi and log(2) from the constant cache, so
+it beats log_series at high precision. b = 4/s only keeps about
+wp - log2(x) significant bits, and m turns negative for x beyond
+2^(wp/2), so x has to be of moderate size; ffl_log only passes x in
+[1/sqrt(2), sqrt(2)).
+*/
+void log_agm(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    int wp, n, m;
+
+    wp = prec + 2*(int)log2((double) prec + 1) + 20;
+
+    /* x >= 2^(n-1-prec), so s >= 2^(wp/2+8) */
+    n = mpz_sizeinbase(x, 2);
+    m = wp/2 + 8 - (n-1-prec);
+
+    /* b = 4/s = 2^(wp+2+prec-m)/x, AGM with m extra bits */
+    mpz_fixed_one(ctx->log.x2, wp + 2 + prec);
+    mpz_tdiv_q(ctx->log.x2, ctx->log.x2, x);
+    mpz_fixed_one(ctx->log.a, wp + m);
+    fix_agm(ctx, ctx->log.a, ctx->log.x2);
+    mpz_tdiv_q_2exp(ctx->log.a, ctx->log.a, m);
+
+    /* y = pi/(2*AGM) - m*log(2) */
+    const_pi(ctx->log.t, wp);
+    mpz_mul_2exp(ctx->log.t, ctx->log.t, wp-1);
+    mpz_tdiv_q(y, ctx->log.t, ctx->log.a);
+    const_ln2(ctx->log.t, wp);
+    mpz_mul_si(ctx->log.t, ctx->log.t, m);
+    mpz_sub(y, y, ctx->log.t);
+
+    mpz_tdiv_q_2exp(y, y, wp-prec);
+}
+
+#ifdef FFL_FAST128
+/*
+1/n with FAST128_BITS fractional bits, so that the terms of the series
+in log_fast128 cost a multiplication instead of a 128-bit division.
+After the first table level |u| < 2^-8, so 16 terms are enough.
+*/
+#define LOG_FAST128_INV(n) (((fast128_t) 1 << FAST128_BITS) / (n))
+#define LOG_FAST128_TERMS 20
+
+static const fast128_t log_fast128_inv[LOG_FAST128_TERMS] =
+{
+    0, LOG_FAST128_INV(1), LOG_FAST128_INV(2), LOG_FAST128_INV(3),
+    LOG_FAST128_INV(4), LOG_FAST128_INV(5), LOG_FAST128_INV(6),
+    LOG_FAST128_INV(7), LOG_FAST128_INV(8), LOG_FAST128_INV(9),
+    LOG_FAST128_INV(10), LOG_FAST128_INV(11), LOG_FAST128_INV(12),
+    LOG_FAST128_INV(13), LOG_FAST128_INV(14), LOG_FAST128_INV(15),
+    LOG_FAST128_INV(16), LOG_FAST128_INV(17), LOG_FAST128_INV(18),
+    LOG_FAST128_INV(19)
+};
+
+/* u*k/2^m truncated towards zero, for |u| < 2^FAST128_BITS and |k| < 2^m */
+static __int128 log_fast128_mul_si(__int128 u, long k, int m)
+{
+    fast128_t a = (u < 0) ? -u : u;
+    fast128_t b = (k < 0) ? -k : k;
+
+    a = (a >> m) * b + (((a & (((fast128_t) 1 << m) - 1)) * b) >> m);
+    return ((u < 0) != (k < 0)) ? -(__int128) a : (__int128) a;
+}
+
+/*
+log_series on numbers with FAST128_BITS fractional bits, for x in
+[1/2, 2) and prec <= FAST128_MAX_PREC (within an ulp up to
+FAST128_PREC). The table reduction is that of
+log_lut_reduce with the tuned number of levels (at least one), but it
+carries u = x - 1, which may end up slightly negative, and the series
+is that of log(1 + u), since dividing by x + 1 would need a 256-bit
+numerator. Returns 0, leaving y alone, for other x and prec. Changes the setup
+of ctx if a table entry has to be computed.
+*/
+int log_fast128(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    int i, m, n, r, J, levels, eprec, cut;
+    int idx[LOG_LUT_LEVELS];
+    long k;
+    double d;
+    __int128 u, p, s, t;
+    fast128_t v;
+    mpz_srcptr e;
+
+    n = mpz_sizeinbase(x, 2);
+    if (prec > FAST128_MAX_PREC || mpz_sgn(x) <= 0 || n < prec || n > prec + 1)
+        return 0;
+
+    log_tuned_params(prec, &r, &J, &levels);
+    if (levels < 1)
+        levels = 1;
+    if (levels > LOG_LUT_LEVELS)
+        levels = LOG_LUT_LEVELS;
+
+    /* x = k/2^LOG_LUT_STEP + v, u = x*2^LOG_LUT_STEP/k - 1 */
+    v = mpz_get_fast128(x, FAST128_BITS - prec);
+    idx[0] = (int) (v >> (FAST128_BITS - LOG_LUT_STEP));
+    if (!log_lut_in_range(0, idx[0]))
+        return 0;
+    v &= ((fast128_t) 1 << (FAST128_BITS - LOG_LUT_STEP)) - 1;
+    u = (v << LOG_LUT_STEP) / idx[0];
+    FFL_COUNT(ctx, divs_ui, 1);
+
+    for (i=1; i<levels; i++)
+    {
+        // x*(1 - k/2^m) ~= 1 for k ~= 2^m*u/(1+u), and
+        // (1+u)*(1 - k/2^m) = 1 + u - k/2^m - u*k/2^m
+        m = LOG_LUT_STEP*(i+1);
+        d = ldexp((double) u, -FAST128_BITS);
+        k = (long) floor(ldexp(d / (1.0 + d), m));
+        if (k < LOG_LUT_KMIN)
+            k = LOG_LUT_KMIN;
+        if (k > LOG_LUT_KMAX-1)
+            k = LOG_LUT_KMAX-1;
+        idx[i] = k;
+
+        if (k != 0)
+            u -= (__int128) k * ((__int128) 1 << (FAST128_BITS - m)) + log_fast128_mul_si(u, k, m);
+    }
+
+    /*
+    s = log(1 + u) = u - u^2/2 + u^3/3 - ..., up to the terms below
+    2^-(prec+10) or the last bit; the rest is smaller than the rounding
+    errors
+    */
+    cut = FAST128_BITS - prec - 10;
+    if (cut < 0)
+        cut = 0;
+    s = u;
+    p = u;
+    for (n=2; n<LOG_FAST128_TERMS; n++)
+    {
+        v = fast128_mul((p < 0) ? -p : p, (u < 0) ? -u : u);
+        if ((v >> cut) == 0)
+            break;
+        p = ((p < 0) != (u < 0)) ? -(__int128) v : (__int128) v;
+        t = (__int128) fast128_mul(v, log_fast128_inv[n]);
+        if ((p < 0) == (n % 2 == 0))
+            s += t;
+        else
+            s -= t;
+        FFL_COUNT(ctx, terms, 1);
+        FFL_COUNT(ctx, muls, 2);
+    }
+
+    for (i=0; i<levels; i++)
+    {
+        if (i > 0 && idx[i] == 0)
+            continue;
+        e = log_lut_lookup(i, idx[i], FAST128_BITS, &eprec);
+        if (e == NULL)
+            e = log_lut_fill(ctx, i, idx[i], FAST128_BITS, &eprec);
+        t = (__int128) mpz_get_fast128(e, FAST128_BITS - eprec);
+        s += (mpz_sgn(e) < 0) ? -t : t;
+    }
+
+    /* truncated towards zero, like mpz_tdiv_q_2exp */
+    v = ((s < 0) ? -s : s) >> (FAST128_BITS - prec);
+    mpz_set_fast128(y, v);
+    if (s < 0)
+        mpz_neg(y, y);
+    return 1;
+}
+#endif
+
+/*
+y = log(x) for a fixed-point x > 0 with prec bits. x = 2^n m with m in
+[1/sqrt(2), sqrt(2)), log(m) by log_fast128 up to FAST128_PREC, by
+log_series_mpn with the tuned parameters up to LOG_AGM_PREC and by
+log_agm above, and n log(2) from the constant cache; for n != 0 both
+are taken with a few guard bits, which also cover the truncation of
+m and, up to FAST128_PREC, the last bits of log_fast128. Returns 0, or
+-1 without touching y if x <= 0.
+*/
+int ffl_log(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec)
+{
+    int r, J, lut, wp, done;
+    long n, nb, e;
+
+    if (mpz_sgn(x) <= 0)
+        return -1;
+
+    /* x = 2^n m, m = x*2^-n truncated to wp bits */
+    n = (long) mpz_sizeinbase(x, 2) - prec;
+    if (mpz_get_d_2exp(&e, x) < M_SQRT1_2)
+        n--;
+
+    wp = (n == 0) ? prec : prec + 4;
+    if (n >= wp - prec)
+        mpz_tdiv_q_2exp(ctx->log.m, x, n - (wp - prec));
+    else
+        mpz_mul_2exp(ctx->log.m, x, (wp - prec) - n);
+
+    done = 0;
+    if (prec >= LOG_AGM_PREC)
+    {
+        log_agm(ctx, y, ctx->log.m, wp);
+        done = 1;
+    }
+#ifdef FFL_FAST128
+    else if (prec <= FAST128_PREC)
+    {
+        done = log_fast128(ctx, y, ctx->log.m, wp);
+    }
+#endif
+
+    if (!done)
+    {
+        log_tuned_params(wp, &r, &J, &lut);
+        log_series_mpn(ctx, y, ctx->log.m, wp, r, J, lut);
+    }
+
+    if (n != 0)
+    {
+        for (nb = 0; (labs(n) >> nb) != 0; nb++)
+            ;
+        const_ln2(ctx->log.t, wp + nb);
+        mpz_mul_si(ctx->log.t, ctx->log.t, n);
+        mpz_tdiv_q_2exp(ctx->log.t, ctx->log.t, nb);
+        mpz_add(y, y, ctx->log.t);
+        mpz_tdiv_q_2exp(y, y, wp - prec);
+    }
+
+    return 0;
+}
+
+/*
+y = entry k of the given lookup table level with prec bits:
+log(k/2^LOG_LUT_STEP) for level 0, and -log(1 - k/2^(LOG_LUT_STEP*(level+1)))
+for the higher levels. Changes the setup of ctx.
+*/
+void log_lut_entry(ffl_ctx_t ctx, mpz_t y, int level, int k, int prec)
+{
+    if (level == 0)
+    {
+        mpz_set_ui(ctx->log.t, k);
+        mpz_mul_2exp(ctx->log.t, ctx->log.t, prec - LOG_LUT_STEP);
+        log_series(ctx, y, ctx->log.t, prec, 8, 8, 0);
+    }
+    else
+    {
+        mpz_set_si(ctx->log.t, -k);
+        mpz_mul_2exp(ctx->log.t, ctx->log.t, prec - LOG_LUT_STEP*(level+1));
+        mpz_fixed_one(y, prec);
+        mpz_add(ctx->log.t, ctx->log.t, y);
+        log_series(ctx, y, ctx->log.t, prec, 2, 8, 0);
+        mpz_neg(y, y);
+    }
+}
+
+/*
+Computes all LOG_LUT_LEVELS lookup tables with LOG_LUT_PREC bits and
+writes them to filename in the format read by load_log_lut. The
+entries are the same as those filled lazily by log_series_eval up to
+LOG_LUT_PREC. Returns 0 on success.
+*/
+int save_log_lut(const char *filename)
+{
+    FILE *fp;
+    ffl_ctx_t ctx;
+    log_lut_header h;
+    int *sizes;
+    mp_limb_t *limbs;
+    mpz_t y;
+    int level, k, i, n, ok;
+
+    sizes = calloc(LOG_LUT_SLOTS, sizeof(int));
+    limbs = calloc((size_t) LOG_LUT_SLOTS * LOG_LUT_STRIDE, sizeof(mp_limb_t));
+    log_init_data(ctx);
+    mpz_init(y);
+
+    ok = 1;
+    for (level=0; level<LOG_LUT_LEVELS && ok; level++)
+    {
+        for (k=(level == 0) ? 1 : LOG_LUT_KMIN; k<((level == 0) ? LOG_LUT_SIZE : LOG_LUT_KMAX); k++)
+        {
+            if (k == 0)
+                continue;
+            log_lut_entry(ctx, y, level, k, LOG_LUT_PREC);
+            n = mpz_size(y);
+            if (n > LOG_LUT_STRIDE)
+            {
+                ok = 0;
+                break;
+            }
+            i = log_lut_index(level, k);
+            sizes[i] = (mpz_sgn(y) < 0) ? -n : n;
+            memcpy(limbs + (size_t) i * LOG_LUT_STRIDE, mpz_limbs_read(y), n * sizeof(mp_limb_t));
+        }
+    }
+
+    mpz_clear(y);
+    log_clear_data(ctx);
+
+    fp = ok ? fopen(filename, "wb") : NULL;
+    if (fp != NULL)
+    {
+        memset(&h, 0, sizeof(h));
+        strcpy(h.magic, LOG_LUT_MAGIC);
+        h.step = LOG_LUT_STEP;
+        h.prec = LOG_LUT_PREC;
+        h.limb_bits = GMP_LIMB_BITS;
+        h.entries = LOG_LUT_SLOTS;
+        h.stride = LOG_LUT_STRIDE;
+        h.levels = LOG_LUT_LEVELS;
+
+        ok = fwrite(&h, sizeof(h), 1, fp) == 1
+            && fwrite(sizes, sizeof(int), LOG_LUT_SLOTS, fp) == LOG_LUT_SLOTS
+            && fwrite(limbs, sizeof(mp_limb_t) * LOG_LUT_STRIDE, LOG_LUT_SLOTS, fp) == LOG_LUT_SLOTS;
+        ok = (fclose(fp) == 0) && ok;
+    }
+    else
+    {
+        ok = 0;
+    }
+
+    free(sizes);
+    free(limbs);
+
+    return ok ? 0 : -1;
+}
+
+/*
+Maps tables written by save_log_lut read-only and makes log_series
+use them in every context for working precisions up to LOG_LUT_PREC.
+The pages are shared with every other process mapping the same file,
+and nothing is copied. Not thread-safe: call once before evaluating.
+Returns 0 on success, or -1 if the file could not be mapped or was
+written for another LOG_LUT_STEP, LOG_LUT_PREC, LOG_LUT_LEVELS or
+limb size (the lazy tables are then used).
+*/
+int load_log_lut(const char *filename)
+{
+    struct stat st;
+    const log_lut_header *h;
+    const int *sizes;
+    const mp_limb_t *limbs;
+    size_t size;
+    void *map;
+    int fd, k;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    size = sizeof(log_lut_header) + LOG_LUT_SLOTS * sizeof(int)
+        + (size_t) LOG_LUT_SLOTS * LOG_LUT_STRIDE * sizeof(mp_limb_t);
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size != size)
+    {
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    h = (const log_lut_header *) map;
+    if (memcmp(h->magic, LOG_LUT_MAGIC, sizeof(LOG_LUT_MAGIC)) != 0
+        || h->step != LOG_LUT_STEP || h->prec != LOG_LUT_PREC
+        || h->limb_bits != GMP_LIMB_BITS || h->entries != LOG_LUT_SLOTS
+        || h->stride != LOG_LUT_STRIDE || h->levels != LOG_LUT_LEVELS)
+    {
+        munmap(map, size);
+        return -1;
+    }
+
+    sizes = (const int *) (h + 1);
+    limbs = (const mp_limb_t *) (sizes + LOG_LUT_SLOTS);
+
+    for (k=0; k<LOG_LUT_SLOTS; k++)
+    {
+        if (abs(sizes[k]) > LOG_LUT_STRIDE)
+        {
+            munmap(map, size);
+            return -1;
+        }
+    }
+
+    unload_log_lut();
+
+    for (k=0; k<LOG_LUT_SLOTS; k++)
+    {
+        mpz_roinit_n(log_lut_table[k], limbs + (size_t) k * LOG_LUT_STRIDE, sizes[k]);
+    }
+
+    log_lut_map = map;
+    log_lut_map_size = size;
+    log_lut_loaded = 1;
+
+    return 0;
+}
+
+/*
+Unmaps the tables loaded by load_log_lut and goes back to the lazy
+tables. Not thread-safe.
+*/
+void unload_log_lut()
+{
+    if (log_lut_map == NULL)
+        return;
+
+    log_lut_loaded = 0;
+    munmap(log_lut_map, log_lut_map_size);
+    log_lut_map = NULL;
+    log_lut_map_size = 0;
+}
+
+/*
+Computes out[i] = log(in[i]) for i = 0..n-1, all with the same
+(prec, r, J, _use_lut). The precision setup and the scratch
+allocations are shared by the whole batch. out[i] may alias in[i].
+Arguments that log_series rejects leave out[i] unchanged.
+*/
+void log_series_batch(ffl_ctx_t ctx, mpz_t *out, mpz_t *in, int n, int prec, int r, int J, int _use_lut)
+{
+    int i;
+
+    for (i=0; i<n; i++)
+    {
+        /* redone only if a lookup table fill changed the setup */
+        log_series_setup(ctx, prec, r);
+        mpz_reserve(out[i], 2*ctx->log.wp+64);
+        log_series_eval(ctx, out[i], in[i], J, _use_lut);
+    }
+}
+
+typedef struct
+{
+    ffl_ctx_struct *ctx;
+    mpz_t *out;
+    mpz_t *in;
+    int n;
+    int prec;
+    int r;
+    int J;
+    int use_lut;
+} log_batch_arg;
+
+void *log_batch_worker(void *arg)
+{
+    log_batch_arg *a = (log_batch_arg *) arg;
+
+    log_series_batch(a->ctx, a->out, a->in, a->n, a->prec, a->r, a->J, a->use_lut);
+    return NULL;
+}
+
+/*
+log_series_batch with the batch split into nthreads contiguous slices
+of nearly equal size, slice i being evaluated by its own thread using
+ctxs[i]. The contexts are meant to be long-lived (one per worker) so
+that their setup and allocations carry over between batches.
+nthreads <= 1 evaluates in the calling thread using ctxs[0].
+*/
+void log_series_batch_mt(ffl_ctx_t *ctxs, mpz_t *out, mpz_t *in, int n, int prec, int r, int J, int _use_lut, int nthreads)
+{
+    log_batch_arg *args;
+    pthread_t *threads;
+    int i, lo, hi;
+
+    if (nthreads > n)
+        nthreads = n;
+
+    if (nthreads <= 1)
+    {
+        log_series_batch(ctxs[0], out, in, n, prec, r, J, _use_lut);
+        return;
+    }
+
+    args = malloc(nthreads * sizeof(log_batch_arg));
+    threads = malloc(nthreads * sizeof(pthread_t));
+
+    /* balanced slices, none empty since nthreads <= n */
+    for (i=0; i<nthreads; i++)
+    {
+        lo = (int) ((long) i * n / nthreads);
+        hi = (int) ((long) (i+1) * n / nthreads);
+        args[i].ctx = ctxs[i];
+        args[i].out = out + lo;
+        args[i].in = in + lo;
+        args[i].n = hi - lo;
+        args[i].prec = prec;
+        args[i].r = r;
+        args[i].J = J;
+        args[i].use_lut = _use_lut;
+        pthread_create(&threads[i], NULL, log_batch_worker, &args[i]);
+    }
+    for (i=0; i<nthreads; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(args);
+    free(threads);
+}
+
+/*
+Frees every entry of the lazy lookup tables. Not thread-safe: no
+other thread may be evaluating a logarithm.
+*/
+void clear_log_lut()
+{
+    log_lut_node *node, *next;
+    int k;
+
+    for (k=0; k<LOG_LUT_SLOTS; k++)
+    {
+        node = atomic_exchange_explicit(&log_lut_lazy[k], NULL, memory_order_acq_rel);
+        while (node != NULL)
+        {
+            next = node->next;
+            mpz_clear(node->value);
+            free(node);
+            node = next;
+        }
+    }
+}
@@ -0,0 +1,362 @@
+/*
+Series kernels on mpn limb arrays, instantiated per limb count.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+
+#include "fastfun.h"
+
+/*
+The kernels work on nonnegative fixed-point numbers with n limbs, that
+is W = n*GMP_NUMB_BITS fractional bits, in arrays of MPN_MAX_LIMBS
+limbs on the stack. Products are mpn_mul into 2n limbs of which the
+upper n are the result, so unlike with mpz_t there is no shift, no
+allocation and no sign to normalize. Each kernel is written
+once as an always_inline function of n and instantiated with a
+constant n by MPN_INSTANCE, so that every loop over the limbs has a
+fixed trip count.
+*/
+typedef void (*exp_mpn_fn)(ffl_ctx_struct *ctx, mp_limb_t *c, const mp_limb_t *x, int neg, int r, int J);
+typedef void (*log_mpn_fn)(ffl_ctx_struct *ctx, mp_limb_t *y, const mp_limb_t *z, int J);
+
+/* Number of limbs of a without the leading zero ones */
+static inline mp_size_t mpn_len(const mp_limb_t *a, mp_size_t n)
+{
+    while (n > 0 && a[n-1] == 0)
+        n--;
+    return n;
+}
+
+/*
+z = a*b / 2^W with n-limb a, b and z, using scratch p of 2n limbs.
+The terms of the series shrink geometrically, so the product is taken
+over the limbs that are not leading zeros only, as mpz_t sizes would.
+z may be a or b.
+*/
+static inline __attribute__((always_inline)) void mpn_mul_fix(mp_limb_t *z,
+    const mp_limb_t *a, const mp_limb_t *b, mp_limb_t *p, const int n)
+{
+    mp_size_t an, bn, m;
+
+    an = mpn_len(a, n);
+    bn = mpn_len(b, n);
+    m = an + bn - n;
+
+    if (m <= 0)
+    {
+        mpn_zero(z, n);
+        return;
+    }
+
+    if (a == b)
+        mpn_sqr(p, a, an);
+    else if (an >= bn)
+        mpn_mul(p, a, an, b, bn);
+    else
+        mpn_mul(p, b, bn, a, an);
+
+    mpn_copyi(z, p + n, m);
+    mpn_zero(z + m, n - m);
+}
+
+/* z = a / d, dividing only the limbs of a that are not leading zeros; z may be a */
+static inline void mpn_div_fix(mp_limb_t *z, const mp_limb_t *a, mp_limb_t d, const int n)
+{
+    mp_size_t an = mpn_len(a, n);
+
+    if (an > 0)
+        mpn_divrem_1(z, 0, a, an, d);
+    if (z != a)
+        mpn_zero(z + an, n - an);
+}
+
+/*
+c = exp(+-x) with x < 2^-EXP_DIRECT_BITS, as exp_series_eval computes
+it with alt = 2 | EXP_SERIES_DIRECT: the even and the odd series with
+rectangular splitting into J sums, then r squarings. x has n limbs, c
+has n+1 (c < 2 before the squarings, c^2 < 4 after each).
+*/
+static inline __attribute__((always_inline)) void exp_mpn_kernel(ffl_ctx_struct *ctx,
+    mp_limb_t *c, const mp_limb_t *x, int neg, int r, int J, const int n)
+{
+    mp_limb_t pows[MAX_SERIES_STEPS][MPN_MAX_LIMBS];
+    mp_limb_t sums[MAX_SERIES_STEPS][MPN_MAX_LIMBS];
+    mp_limb_t odd[MAX_SERIES_STEPS][MPN_MAX_LIMBS];
+    mp_limb_t a[MPN_MAX_LIMBS], b[MPN_MAX_LIMBS], xJ[MPN_MAX_LIMBS];
+    mp_limb_t s[MPN_MAX_LIMBS+1];
+    mp_limb_t p[2*MPN_MAX_LIMBS+2];
+    int i, k;
+
+    (void) ctx;     /* only counted into, with FFL_STATS */
+
+    /* pows[i] = x^(2i), xJ = x^(2J) */
+    mpn_mul_fix(pows[1], x, x, p, n);
+    for (i=2; i<J; i++)
+        mpn_mul_fix(pows[i], pows[i-1], pows[1], p, n);
+    if (J == 1)
+        mpn_copyi(xJ, pows[1], n);
+    else
+        mpn_mul_fix(xJ, pows[J-1], pows[1], p, n);
+    FFL_COUNT(ctx, muls, J);
+
+    for (i=0; i<J; i++)
+    {
+        mpn_zero(sums[i], n);
+        mpn_zero(odd[i], n);
+    }
+
+    /* a = x^2k/(2k)!, b = x^2k/(2k+1)! */
+    mpn_copyi(a, pows[1], n);
+    mpn_copyi(b, pows[1], n);
+
+    k = 2;
+    while (!mpn_zero_p(a, n))
+    {
+        for (i=0; i<J; i++)
+        {
+            mpn_div_fix(a, a, (mp_limb_t) (k-1)*k, n);
+            mpn_div_fix(b, b, (mp_limb_t) k*(k+1), n);
+            mpn_add_n(sums[i], sums[i], a, n);
+            mpn_add_n(odd[i], odd[i], b, n);
+            k += 2;
+        }
+        mpn_mul_fix(a, a, xJ, p, n);
+        mpn_mul_fix(b, b, xJ, p, n);
+        FFL_COUNT(ctx, terms, J);
+        FFL_COUNT(ctx, divs_ui, 2*J);
+        FFL_COUNT(ctx, muls, 2);
+    }
+
+    for (i=1; i<J; i++)
+    {
+        mpn_mul_fix(sums[i], sums[i], pows[i], p, n);
+        mpn_mul_fix(odd[i], odd[i], pows[i], p, n);
+    }
+    FFL_COUNT(ctx, muls, 2*(J-1));
+
+    /* c = 1 + sums, s = (1 + odd) x */
+    mpn_zero(c, n);
+    c[n] = 1;
+    mpn_zero(s, n);
+    s[n] = 1;
+    for (i=0; i<J; i++)
+    {
+        mpn_add(c, c, n+1, sums[i], n);
+        mpn_add(s, s, n+1, odd[i], n);
+    }
+    mpn_mul(p, s, n+1, x, n);
+    mpn_copyi(s, p + n, n+1);
+    FFL_COUNT(ctx, muls, 1);
+
+    if (neg)
+        mpn_sub_n(c, c, s, n+1);
+    else
+        mpn_add_n(c, c, s, n+1);
+
+    for (i=0; i<r; i++)
+    {
+        mpn_sqr(p, c, n+1);
+        mpn_copyi(c, p + n, n+1);
+    }
+    FFL_COUNT(ctx, muls, r);
+}
+
+/*
+y = atanh(z) = z + z^3/3 + z^5/5 + ... for z < 1/2 as the series in
+log_series_eval sums it, with rectangular splitting into J sums.
+*/
+static inline __attribute__((always_inline)) void log_mpn_kernel(ffl_ctx_struct *ctx,
+    mp_limb_t *y, const mp_limb_t *z, int J, const int n)
+{
+    mp_limb_t pows[MAX_SERIES_STEPS][MPN_MAX_LIMBS];
+    mp_limb_t sums[MAX_SERIES_STEPS][MPN_MAX_LIMBS];
+    mp_limb_t a[MPN_MAX_LIMBS], t[MPN_MAX_LIMBS], zJ[MPN_MAX_LIMBS];
+    mp_limb_t p[2*MPN_MAX_LIMBS];
+    int i, k;
+
+    (void) ctx;     /* only counted into, with FFL_STATS */
+
+    /* pows[i] = z^(2i), zJ = z^(2J) */
+    mpn_mul_fix(pows[1], z, z, p, n);
+    for (i=2; i<J; i++)
+        mpn_mul_fix(pows[i], pows[i-1], pows[1], p, n);
+    if (J == 1)
+        mpn_copyi(zJ, pows[1], n);
+    else
+        mpn_mul_fix(zJ, pows[J-1], pows[1], p, n);
+    FFL_COUNT(ctx, muls, J);
+
+    for (i=0; i<J; i++)
+        mpn_zero(sums[i], n);
+
+    mpn_copyi(a, z, n);
+
+    k = 1;
+    while (!mpn_zero_p(a, n))
+    {
+        for (i=0; i<J; i++)
+        {
+            mpn_div_fix(t, a, k, n);
+            mpn_add_n(sums[i], sums[i], t, n);
+            k += 2;
+        }
+        mpn_mul_fix(a, a, zJ, p, n);
+        FFL_COUNT(ctx, terms, J);
+        FFL_COUNT(ctx, divs_ui, J);
+        FFL_COUNT(ctx, muls, 1);
+    }
+
+    for (i=1; i<J; i++)
+        mpn_mul_fix(sums[i], sums[i], pows[i], p, n);
+    FFL_COUNT(ctx, muls, J-1);
+
+    mpn_copyi(y, sums[0], n);
+    for (i=1; i<J; i++)
+        mpn_add_n(y, y, sums[i], n);
+}
+
+#define MPN_INSTANCE(n) \
+static void exp_mpn_##n(ffl_ctx_struct *ctx, mp_limb_t *c, const mp_limb_t *x, int neg, int r, int J) \
+{ \
+    exp_mpn_kernel(ctx, c, x, neg, r, J, n); \
+} \
+static void log_mpn_##n(ffl_ctx_struct *ctx, mp_limb_t *y, const mp_limb_t *z, int J) \
+{ \
+    log_mpn_kernel(ctx, y, z, J, n); \
+}
+
+/*
+Every limb count up to 16, then every second one up to MPN_MAX_LIMBS,
+so that rounding up to an instance costs at most an eighth more
+limbs.
+*/
+MPN_INSTANCE(2)
+MPN_INSTANCE(3)
+MPN_INSTANCE(4)
+MPN_INSTANCE(5)
+MPN_INSTANCE(6)
+MPN_INSTANCE(7)
+MPN_INSTANCE(8)
+MPN_INSTANCE(9)
+MPN_INSTANCE(10)
+MPN_INSTANCE(11)
+MPN_INSTANCE(12)
+MPN_INSTANCE(13)
+MPN_INSTANCE(14)
+MPN_INSTANCE(15)
+MPN_INSTANCE(16)
+MPN_INSTANCE(18)
+MPN_INSTANCE(20)
+MPN_INSTANCE(22)
+MPN_INSTANCE(24)
+MPN_INSTANCE(26)
+MPN_INSTANCE(28)
+MPN_INSTANCE(30)
+MPN_INSTANCE(32)
+
+typedef struct
+{
+    int limbs;
+    exp_mpn_fn exp;
+    log_mpn_fn log;
+} mpn_kernel;
+
+#define MPN_KERNEL(n) {n, exp_mpn_##n, log_mpn_##n}
+
+/* The instances in increasing order of limbs */
+static const mpn_kernel mpn_kernels[] =
+{
+    MPN_KERNEL(2), MPN_KERNEL(3), MPN_KERNEL(4), MPN_KERNEL(5),
+    MPN_KERNEL(6), MPN_KERNEL(7), MPN_KERNEL(8), MPN_KERNEL(9),
+    MPN_KERNEL(10), MPN_KERNEL(11), MPN_KERNEL(12), MPN_KERNEL(13),
+    MPN_KERNEL(14), MPN_KERNEL(15), MPN_KERNEL(16), MPN_KERNEL(18),
+    MPN_KERNEL(20), MPN_KERNEL(22), MPN_KERNEL(24), MPN_KERNEL(26),
+    MPN_KERNEL(28), MPN_KERNEL(30), MPN_KERNEL(32)
+};
+
+/*
+The instance with the fewest limbs holding wp fractional bits, or
+NULL if wp needs more than MPN_MAX_LIMBS limbs.
+*/
+static const mpn_kernel *mpn_kernel_for(int wp)
+{
+    int i, n;
+
+    n = (wp + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    for (i=0; i<(int)(sizeof(mpn_kernels)/sizeof(mpn_kernels[0])); i++)
+    {
+        if (mpn_kernels[i].limbs >= n)
+            return &mpn_kernels[i];
+    }
+    return NULL;
+}
+
+/*
+Number of limbs of the kernels used at working precision wp, or 0 if
+the mpz_t kernels are used instead.
+*/
+int series_mpn_limbs(int wp)
+{
+    const mpn_kernel *k = mpn_kernel_for(wp);
+    return (k == NULL) ? 0 : k->limbs;
+}
+
+/*
+y = exp(x) with the same (prec, r, J) as exp_series with
+alt = 2 | EXP_SERIES_DIRECT, which it falls back to beyond
+MPN_MAX_LIMBS limbs; |x| < 2^-EXP_DIRECT_BITS. The working precision
+prec + 2r + 10 is rounded up to the limbs of an instance, which only
+adds guard bits.
+*/
+void exp_series_mpn(ffl_ctx_t ctx, mpz_t y, mpz_t x, int prec, int r, int J)
+{
+    mp_limb_t xr[MPN_MAX_LIMBS], c[MPN_MAX_LIMBS+1];
+    const mpn_kernel *k;
+    long w;
+
+    k = mpn_kernel_for(prec + 2*r + 10);
+    if (k == NULL)
+    {
+        exp_series(ctx, y, ctx->exp.t, x, prec, r, J, 2 | EXP_SERIES_DIRECT);
+        return;
+    }
+
+    if (J < 1)
+        J = 1;
+
+    /* |x| / 2^r with w bits */
+    w = (long) k->limbs * GMP_NUMB_BITS;
+    mpn_set_mpz_2exp(xr, k->limbs, x, w - prec - r);
+
+    k->exp(ctx, c, xr, mpz_sgn(x) < 0, r, J);
+
+    mpz_set_mpn_2exp(y, c, k->limbs + 1, w - prec);
+}
+
+/*
+y = atanh(z) for a fixed-point z with wp bits, |z| < 1/2, with the
+series of log_series_eval split into J sums. Returns 0 without
+touching y if wp needs more than MPN_MAX_LIMBS limbs.
+*/
+int log_atanh_mpn(ffl_ctx_t ctx, mpz_t y, mpz_t z, int wp, int J)
+{
+    mp_limb_t za[MPN_MAX_LIMBS], s[MPN_MAX_LIMBS];
+    const mpn_kernel *k;
+    long w;
+
+    k = mpn_kernel_for(wp);
+    if (k == NULL)
+        return 0;
+
+    w = (long) k->limbs * GMP_NUMB_BITS;
+    mpn_set_mpz_2exp(za, k->limbs, z, w - wp);
+
+    k->log(ctx, s, za, J);
+
+    mpz_set_mpn_2exp(y, s, k->limbs, w - wp);
+    if (mpz_sgn(z) < 0)
+        mpz_neg(y, y);
+    return 1;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+#include <gmp.h>
+#include <mpfr.h>
+
+#include "fastfun.h"
+
+void ffl_init(ffl_ctx_t ctx)
+{
+    exp_init_data(ctx);
+    log_init_data(ctx);
+    gamma_init_data(ctx);
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+}
+
+void ffl_clear(ffl_ctx_t ctx)
+{
+    exp_clear_data(ctx);
+    log_clear_data(ctx);
+    gamma_clear_data(ctx);
+}
+
+/* Nonzero if the library counts operations in ctx->stats */
+int ffl_stats_enabled()
+{
+#ifdef FFL_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* Microseconds on the monotonic clock, which NTP does not step */
+double timing()
+{
+    return bench_clock() / 1000;
+}
+
+void mpz_fixed_one(mpz_t x, int prec)
+{
+    //mpz_set_ui(x, 1);
+    //mpz_mul_2exp(x, x, prec);
+    mpz_set_ui(x, 0);
+    mpz_setbit(x, prec);
+}
+
+/* Grow z so that it can hold bits bits without reallocating */
+void mpz_reserve(mpz_t z, int bits)
+{
+    if ((mp_bitcnt_t) z->_mp_alloc * GMP_NUMB_BITS < (mp_bitcnt_t) bits)
+        mpz_realloc2(z, bits);
+}
+
+/*
+d = |z|*2^e truncated, as n limbs, for e of either sign; the result
+must fit.
+*/
+void mpn_set_mpz_2exp(mp_limb_t *d, int n, mpz_srcptr z, long e)
+{
+    const mp_limb_t *s = mpz_limbs_read(z);
+    int size = mpz_size(z);
+    int q, b, m;
+
+    mpn_zero(d, n);
+
+    if (e >= 0)
+    {
+        q = e / GMP_NUMB_BITS;
+        b = e % GMP_NUMB_BITS;
+        m = (size < n - q) ? size : n - q;
+        if (m <= 0)
+            return;
+        if (b != 0)
+        {
+            mp_limb_t hi = mpn_lshift(d + q, s, m, b);
+            if (q + m < n)
+                d[q + m] = hi;
+        }
+        else
+        {
+            mpn_copyi(d + q, s, m);
+        }
+        return;
+    }
+
+    q = -e / GMP_NUMB_BITS;
+    b = -e % GMP_NUMB_BITS;
+    m = size - q;
+    if (m <= 0)
+        return;
+    if (m > n)
+        m = n;
+    if (b != 0)
+    {
+        mpn_rshift(d, s + q, m, b);
+        if (q + m < size)
+            d[m-1] |= s[q + m] << (GMP_NUMB_BITS - b);
+    }
+    else
+    {
+        mpn_copyi(d, s + q, m);
+    }
+}
+
+/* z = s/2^e truncated, for the n limbs s and e >= 0 */
+void mpz_set_mpn_2exp(mpz_t z, const mp_limb_t *s, int n, long e)
+{
+    mp_limb_t *d;
+    int q, b, m;
+
+    q = e / GMP_NUMB_BITS;
+    b = e % GMP_NUMB_BITS;
+    m = n - q;
+    if (m <= 0)
+    {
+        mpz_set_ui(z, 0);
+        return;
+    }
+
+    d = mpz_limbs_write(z, m);
+    if (b != 0)
+        mpn_rshift(d, s + q, m, b);
+    else
+        mpn_copyi(d, s + q, m);
+    mpz_limbs_finish(z, m);
+}
+
+#ifdef FFL_FAST128
+/*
+|z|*2^e truncated, for e of either sign; the result must fit in 128
+bits. Reads the limbs directly, without a temporary mpz_t.
+*/
+fast128_t mpz_get_fast128(mpz_srcptr z, int e)
+{
+    fast128_t x;
+    int q, b;
+
+    if (e >= 0)
+        return ((fast128_t) mpz_getlimbn(z, 1) << 64 | mpz_getlimbn(z, 0)) << e;
+
+    q = (-e) / 64;
+    b = (-e) % 64;
+    x = (fast128_t) mpz_getlimbn(z, q+1) << 64 | mpz_getlimbn(z, q);
+    if (b != 0)
+        x = (x >> b) | ((fast128_t) mpz_getlimbn(z, q+2) << (128 - b));
+    return x;
+}
+
+/* z = x */
+void mpz_set_fast128(mpz_t z, fast128_t x)
+{
+    mp_limb_t *d = mpz_limbs_write(z, 2);
+
+    d[0] = (mp_limb_t) x;
+    d[1] = (mp_limb_t) (x >> 64);
+    mpz_limbs_finish(z, 2);
+}
+#endif
+
+void printx(char *s, mpz_t x, int prec)
+{
+    mpfr_t y;
+    mpfr_init2(y, 53);
+    mpfr_set_z(y, x, GMP_RNDN);
+    mpfr_div_2ui(y, y, prec, GMP_RNDN);
+    mpfr_printf("%s: %Rf\n", s, y);
+    mpfr_clear(y);
+}
+
+/*
+Number of correct bits of the fixed-point y (prec bits) compared to
+the reference value ref; prec if they agree exactly.
+*/
+int fix_accuracy(mpz_t y, int prec, mpfr_t ref)
+{
+    mpfr_t t;
+    int accuracy = prec;
+
+    mpfr_init2(t, mpfr_get_prec(ref) + 10);
+    mpfr_set_z(t, y, GMP_RNDN);
+    mpfr_div_2ui(t, t, prec, GMP_RNDN);
+    mpfr_sub(t, t, ref, GMP_RNDN);
+    mpfr_abs(t, t, GMP_RNDN);
+    if (!mpfr_zero_p(t))
+        accuracy = -(int)mpfr_get_exp(t)+1;
+    mpfr_clear(t);
+
+    return accuracy;
+}
@@ -0,0 +1,239 @@
+/*
+Correctly rounded exp, log and gamma on mpfr_t, with the signatures of
+mpfr_exp, mpfr_log and mpfr_gamma.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include <mpfr.h>
+#include <math.h>
+
+#include "fastfun.h"
+
+/*
+Scratch space of the wrappers, one per thread so that they can be
+called like the MPFR functions without a context. Set up on the first
+call in a thread and freed by ffl_mpfr_clear.
+*/
+typedef struct
+{
+    ffl_ctx_t ctx;
+    mpz_t x;
+    mpz_t y;
+    mpz_t t;
+    mpfr_t b;
+    int init;
+} mpfr_wrap_struct;
+
+static _Thread_local mpfr_wrap_struct mpfr_wrap;
+
+static mpfr_wrap_struct *mpfr_wrap_get()
+{
+    mpfr_wrap_struct *w = &mpfr_wrap;
+
+    if (!w->init)
+    {
+        ffl_init(w->ctx);
+        mpz_init(w->x);
+        mpz_init(w->y);
+        mpz_init(w->t);
+        mpfr_init2(w->b, MPFR_PREC_MIN);
+        w->init = 1;
+    }
+
+    return w;
+}
+
+/* Frees the scratch space of the calling thread */
+void ffl_mpfr_clear()
+{
+    mpfr_wrap_struct *w = &mpfr_wrap;
+
+    if (!w->init)
+        return;
+
+    ffl_clear(w->ctx);
+    mpz_clear(w->x);
+    mpz_clear(w->y);
+    mpz_clear(w->t);
+    mpfr_clear(w->b);
+    w->init = 0;
+}
+
+/* z = x*2^wp truncated, i.e. x as a fixed-point number with wp bits */
+static void mpfr_wrap_fixed(mpz_t z, mpfr_srcptr x, long wp)
+{
+    long e;
+
+    e = mpfr_get_z_2exp(z, x) + wp;
+    if (e >= 0)
+        mpz_mul_2exp(z, z, e);
+    else
+        mpz_tdiv_q_2exp(z, z, -e);
+}
+
+/*
+Rounds w->y * 2^e into z if that is sure to give the correctly rounded
+value of a number within 2^errexp of it, setting *inex to the ternary
+value. Returns zero if the Ziv loop has to try again with more bits.
+The exact value must not be representable, as mpfr_can_round cannot
+tell the ternary value then. Near the ends of the exponent range the
+approximation is formed in the widest range, and only the result is
+checked against the current one.
+*/
+static int mpfr_wrap_round(mpfr_ptr z, int *inex, mpfr_wrap_struct *w, long e,
+    long errexp, mpfr_rnd_t rnd)
+{
+    mpfr_exp_t emin, emax;
+    long bits, err;
+    int ok, wide;
+
+    if (mpz_sgn(w->y) == 0)
+        return 0;
+
+    bits = mpz_sizeinbase(w->y, 2);
+    emin = mpfr_get_emin();
+    emax = mpfr_get_emax();
+    wide = (e + bits - 2 < emin || e + bits + 2 > emax);
+    if (wide)
+    {
+        mpfr_set_emin(mpfr_get_emin_min());
+        mpfr_set_emax(mpfr_get_emax_max());
+    }
+
+    mpfr_set_prec(w->b, bits);
+    mpfr_set_z_2exp(w->b, w->y, e, MPFR_RNDN);
+    err = mpfr_get_exp(w->b) - errexp;
+    ok = err > 0 && mpfr_can_round(w->b, err, MPFR_RNDN, MPFR_RNDZ,
+        mpfr_get_prec(z) + (rnd == MPFR_RNDN));
+    if (ok)
+        *inex = mpfr_set(z, w->b, rnd);
+
+    if (wide)
+    {
+        mpfr_set_emin(emin);
+        mpfr_set_emax(emax);
+        if (ok)
+            *inex = mpfr_check_range(z, *inex, rnd);
+    }
+
+    return ok;
+}
+
+/*
+y = exp(x) correctly rounded, a drop-in replacement for mpfr_exp. x is
+converted with prec(y) + MPFR_WRAP_GUARD bits and evaluated by
+ffl_exp, and the precision grows by half in each retry until the
+result can be rounded. Special values, |x| < 2^-prec(y) (where exp(x)
+rounds like 1 + x) and |x| >= 2^MPFR_WRAP_EXP_MAX go to mpfr_exp.
+*/
+int ffl_mpfr_exp(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd)
+{
+    mpfr_wrap_struct *w;
+    long wp;
+    int n, inex;
+
+    if (!mpfr_regular_p(x) || mpfr_get_exp(x) < -mpfr_get_prec(y)
+        || mpfr_get_exp(x) > MPFR_WRAP_EXP_MAX)
+        return mpfr_exp(y, x, rnd);
+
+    w = mpfr_wrap_get();
+
+    for (wp = mpfr_get_prec(y) + MPFR_WRAP_GUARD; ; wp += wp/2)
+    {
+        mpfr_wrap_fixed(w->x, x, wp);
+        n = ffl_exp(w->ctx, w->y, w->x, wp);
+
+        /* a few units of 2^(n-wp) from ffl_exp and the truncation of x */
+        if (mpfr_wrap_round(y, &inex, w, n - wp, n - wp + 3, rnd))
+            return inex;
+    }
+}
+
+/*
+y = log(x) correctly rounded, a drop-in replacement for mpfr_log.
+x = m 2^k with m in [1/sqrt(2), sqrt(2)), log(m) by ffl_log and k
+log(2) from the constant cache. For k = 0 the working precision also
+covers the cancellation in log(m) ~ m - 1. Special values, x <= 0 and
+x = 1 go to mpfr_log.
+*/
+int ffl_mpfr_log(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd)
+{
+    mpfr_wrap_struct *w;
+    long wp, k, kb, cancel;
+    int inex;
+
+    if (!mpfr_regular_p(x) || mpfr_sgn(x) < 0 || mpfr_cmp_ui(x, 1) == 0)
+        return mpfr_log(y, x, rnd);
+
+    w = mpfr_wrap_get();
+
+    if (mpfr_get_d_2exp(&k, x, MPFR_RNDZ) < M_SQRT1_2)
+        k--;
+
+    cancel = 0;
+    if (k == 0)
+    {
+        mpfr_set_prec(w->b, mpfr_get_prec(x) + 2);
+        mpfr_sub_ui(w->b, x, 1, MPFR_RNDN);
+        cancel = -mpfr_get_exp(w->b);
+    }
+
+    for (kb = 0; (labs(k) >> kb) != 0; kb++)
+        ;
+
+    for (wp = mpfr_get_prec(y) + MPFR_WRAP_GUARD + cancel; ; wp += wp/2)
+    {
+        mpfr_wrap_fixed(w->x, x, wp - k);
+        ffl_log(w->ctx, w->y, w->x, wp);
+
+        if (k != 0)
+        {
+            const_ln2(w->t, wp + kb);
+            mpz_mul_si(w->t, w->t, k);
+            mpz_tdiv_q_2exp(w->t, w->t, kb);
+            mpz_add(w->y, w->y, w->t);
+        }
+
+        /* a few units of 2^-wp from ffl_log, k log(2) and the truncation of m */
+        if (mpfr_wrap_round(y, &inex, w, -wp, -wp + 3, rnd))
+            return inex;
+    }
+}
+
+/*
+y = gamma(x) correctly rounded, a drop-in replacement for mpfr_gamma,
+by ffl_gamma like ffl_mpfr_exp. Truncating x to the working precision
+changes gamma(x) by a factor of about 1 + digamma(x) 2^-wp, with
+|digamma(x)| < EXP(x) + 2, which the error bound allows for. Special
+values, x < 1/2 (there is no reflection here), integers (where gamma
+is exact) and x >= 2^MPFR_WRAP_GAMMA_EXP_MAX go to mpfr_gamma. The
+first call at a new precision computes the Taylor coefficients or the
+Stirling tables, which costs many calls' worth (gamma_init_coefficients
+prefills the former).
+*/
+int ffl_mpfr_gamma(mpfr_ptr y, mpfr_srcptr x, mpfr_rnd_t rnd)
+{
+    mpfr_wrap_struct *w;
+    long wp, c;
+    int n, inex;
+
+    if (!mpfr_regular_p(x) || mpfr_cmp_d(x, 0.5) < 0 || mpfr_integer_p(x)
+        || mpfr_get_exp(x) > MPFR_WRAP_GAMMA_EXP_MAX)
+        return mpfr_gamma(y, x, rnd);
+
+    w = mpfr_wrap_get();
+
+    for (c = 4; (1L << (c - 4)) < mpfr_get_exp(x) + 2; c++)
+        ;
+
+    for (wp = mpfr_get_prec(y) + MPFR_WRAP_GUARD + c; ; wp += wp/2)
+    {
+        mpfr_wrap_fixed(w->x, x, wp);
+        n = ffl_gamma(w->ctx, w->y, w->x, wp);
+
+        if (mpfr_wrap_round(y, &inex, w, n - wp, n - wp + c, rnd))
+            return inex;
+    }
+}
@@ -1,296 +1,920 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 #include <mpfr.h>
-#include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <math.h>
 
-#define MAX_GAMMA_COEFF 3000
-mpz_t g_rfac;
-mpz_t g_one;
-mpz_t gamma_coeff[MAX_GAMMA_COEFF];
+#include "fastfun.h"
 
-mpz_t ta;
-mpz_t tb;
-mpz_t tc;
-mpz_t td;
-
-int gamma_coeff_prec = 0;
-int gamma_max_coeff_index = 0;
+/* ffl_gamma, gamma_taylor and gamma_stirling as bench_sweep kernels */
+static int gamma_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
+{
+    (void) param;
+    return ffl_gamma(ctx, y, x, prec);
+}
 
-void ffl_init()
+static int gamma_taylor_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    int k;
-    mpz_init(g_rfac);
-    mpz_init(g_one);
-    mpz_init(ta);
-    mpz_init(tb);
-    mpz_init(tc);
-    mpz_init(td);
-    for (k=0; k<MAX_GAMMA_COEFF; k++)
-    {
-        mpz_init(gamma_coeff[k]);
-    }
+    (void) param;
+    return gamma_taylor(ctx, y, x, prec, GAMMA_DEFAULT_J);
 }
 
-void ffl_clear()
+static int gamma_stirling_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    int k;
-    mpz_clear(g_rfac);
-    mpz_clear(g_one);
-    mpz_clear(ta);
-    mpz_clear(tb);
-    mpz_clear(tc);
-    mpz_clear(td);
-    for (k=0; k<MAX_GAMMA_COEFF; k++)
-    {
-        mpz_clear(gamma_coeff[k]);
-    }
+    (void) param;
+    return gamma_stirling(ctx, y, x, prec);
 }
 
-void load_gamma_coefficients()
+void benchmark_gamma(ffl_ctx_t ctx)
 {
-    FILE *fp;
-    int k;
-    int l;
+    /* arguments in tenths */
+    static const int xs[] = {57, 570, 5700, 57000};
+    int REPS;
+    int prec;
+    int i, k, r, J, best_r, best_J;
+    size_t j;
+    double best_time, best_here, horner_time;
+    int Jmin, Jmax;
+    double t1, t2, elapsed;
+    double mpfr_time;
+    int accuracy, min_accuracy;
+    int expt;
+    size_t table_size, tier_size, full_size;
 
-    fp = fopen("gamma_data.txt", "rt");
+    mpz_t x, y, dummy;
+    mpfr_t mx, my;
 
-    if ((fp == NULL) || (fscanf(fp, "%d", &gamma_coeff_prec) != 1))
-    {
-        printf("Could not open gamma_data.txt!\n");
-        exit(1);
-    }
+    mpfr_init(mx);
+    mpfr_init(my);
 
-    for (k=0; k<MAX_GAMMA_COEFF; k++)
+    mpz_init(x);
+    mpz_init(y);
+    mpz_init(dummy);
+
+    /* x = 5.7, then large x where the argument reduction dominates */
+    for (j=0; j<sizeof(xs)/sizeof(xs[0]); j++)
     {
-        if (gmp_fscanf(fp, "%Zx\n", gamma_coeff[k]) != 1)
-            break;
+        printf("x = %d.%d\n", xs[j] / 10, xs[j] % 10);
+        for (prec=53; prec<10000; prec+=prec/4)
+        {
+            if (prec < 300)
+                REPS = 100;
+            else if (prec < 600)
+                REPS = 50;
+            else if (prec < 1200)
+                REPS = 10;
+            else
+                REPS = 2;
+
+            mpz_set_ui(x, xs[j]);
+            mpz_mul_2exp(x, x, prec);
+            mpz_div_ui(x, x, 10);
+
+            min_accuracy = prec;
+            best_time = 1e100;
+            best_r = 0;
+            best_J = 0;
+
+            mpfr_set_prec(mx, prec+10);
+            mpfr_set_prec(my, prec);
+            mpfr_set_z(mx, x, GMP_RNDN);
+            mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
+
+            mpfr_time = 1e100;
+            for (i=0; i<10; i++)
+            {
+                t1 = timing();
+                for (k=0; k<REPS; k++)
+                {
+                    mpfr_gamma(my, mx, GMP_RNDN);
+                }
+                t2 = timing();
+                elapsed = (t2-t1)/REPS;
+                if (elapsed < mpfr_time)
+                    mpfr_time = elapsed;
+            }
+
+            /*
+            Search the block size, J = 1 being Horner. It does not
+            depend on x, so the larger x use the default.
+            */
+            best_time = horner_time = 1e100;
+            if (j == 0)
+            {
+                Jmin = 1;
+                Jmax = 2 * (int) sqrt(gamma_taylor_terms(prec + 15)) + 1;
+                if (Jmax > MAX_GAMMA_J)
+                    Jmax = MAX_GAMMA_J;
+            }
+            else
+            {
+                Jmin = Jmax = GAMMA_DEFAULT_J;
+            }
+            for (J=Jmin; J<=Jmax; J++)
+            {
+                best_here = 1e100;
+                for (i=0; i<10; i++)
+                {
+                    t1 = timing();
+                    for (k=0; k<REPS; k++)
+                    {
+                        gamma_taylor(ctx, y, x, prec, J);
+                    }
+                    t2 = timing();
+                    elapsed = (t2-t1)/REPS;
+                    if (elapsed < best_here)
+                        best_here = elapsed;
+                }
+                if (J == 1)
+                    horner_time = best_here;
+                if (best_here < best_time)
+                {
+                    best_time = best_here;
+                    best_J = J;
+                }
+            }
+
+            expt = gamma_taylor(ctx, y, x, prec, best_J);
+
+            mpfr_set_z(mx, y, GMP_RNDN);
+            mpfr_mul_2ui(mx, mx, expt, GMP_RNDN);
+            mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
+
+            mpfr_sub(mx, mx, my, GMP_RNDN);
+            mpfr_div(mx, mx, my, GMP_RNDN);
+            mpfr_abs(mx, mx, GMP_RNDN);
+
+            if (!mpfr_zero_p(mx))
+            {
+                accuracy = -(int)mpfr_get_exp(mx)+1;
+                if (accuracy < min_accuracy)
+                {
+                    min_accuracy = accuracy;
+                }
+            }
+
+            mpfr_time *= 1000;
+            best_time *= 1000;
+            horner_time *= 1000;
+            if (j == 0)
+                printf("%5d %5d %10ld %10d   %.3f  J=%2d (default %2d)  %.3f vs Horner\n",
+                    prec, min_accuracy, (long)mpfr_time, (int)best_time, mpfr_time/best_time,
+                    best_J, GAMMA_DEFAULT_J, horner_time/best_time);
+            else
+                printf("%5d %5d %10ld %10d   %.3f\n",
+                    prec, min_accuracy, (long)mpfr_time, (int)best_time, mpfr_time/best_time);
+
+        }
     }
 
-    gamma_max_coeff_index = k;
+    gamma_coefficients_memory(&table_size, &tier_size, &full_size);
+    printf("coefficients: %zu KB graded (%zu KB at full precision), tiers %zu KB\n",
+        table_size/1024, full_size/1024, tier_size/1024);
 
-    fclose(fp);
-}
+    mpfr_clear(mx);
+    mpfr_clear(my);
+
+    mpz_clear(x);
+    mpz_clear(y);
+    mpz_clear(dummy);
 
-void printx(char *s, mpz_t x, int prec)
-{
-    mpfr_t y;
-    mpfr_init2(y, 53);
-    mpfr_set_z(y, x, GMP_RNDN);
-    mpfr_div_2ui(y, y, prec, GMP_RNDN);
-    mpfr_printf("%s: %Rf\n", s, y);
-    mpfr_clear(y);
 }
 
-/*
-    gamma(x) = y * 2^n
 
-    assumes x >= 0.5
 
-    n is set to a nonzero value if x >> 10^0
+/*
+Each thread owns its context and output variables and evaluates
+the same argument REPS times. Only x and the coefficient table
+are shared, and both are read-only (the table is computed up front).
 */
-int gamma_taylor(mpz_t y, mpz_t x, int prec)
+typedef struct
+{
+    mpz_srcptr x;
+    mpz_srcptr ref;
+    int prec;
+    int reps;
+    int mismatch;
+} gamma_thread_arg;
+
+void *gamma_thread_worker(void *arg)
 {
-    int k, n, tmp, steps, terms, dprec;
-    int wp;
-    int expt = 0;
-    wp = prec + 15;
+    gamma_thread_arg *a = (gamma_thread_arg *) arg;
+    ffl_ctx_t ctx;
+    mpz_t y;
+    int k;
+
+    ffl_init(ctx);
+    mpz_init(y);
+
+    for (k=0; k<a->reps; k++)
+    {
+        gamma_taylor(ctx, y, (mpz_ptr) a->x, a->prec, GAMMA_DEFAULT_J);
+    }
 
-    mpz_mul_2exp(ta, x, wp-prec);
+    a->mismatch = (mpz_cmp(y, a->ref) != 0);
 
-    mpz_set_ui(g_one, 1);
-    mpz_mul_2exp(g_one, g_one, wp);
+    mpz_clear(y);
+    ffl_clear(ctx);
+    return NULL;
+}
 
-    /* Reduce to [0.5,1.5) */
-    mpz_tdiv_q_2exp(tb, ta, wp-1);
-    n = mpz_get_si(tb);
-    steps = (n-1)/2;
-    if (steps)
+/*
+Throughput of gamma_taylor with 1..N threads, N = number of online
+cores unless given explicitly. Every thread does the same amount of
+work, so with perfect scaling the wall time stays constant and
+evals/s grows linearly.
+*/
+void benchmark_threads_gamma(int ncpu)
+{
+    static const int precs[] = {53, 333, 1000, 3333};
+    gamma_thread_arg args[64];
+    pthread_t threads[64];
+    ffl_ctx_t ctx;
+    mpz_t x, ref;
+    int nthreads, i, j, prec, REPS, mismatch;
+    double t1, t2, rate, base_rate;
+
+    if (ncpu < 1)
+        ncpu = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1)
+        ncpu = 1;
+    if (ncpu > 64)
+        ncpu = 64;
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(ref);
+
+    printf(" prec threads     evals/s  speedup  efficiency  ok\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
     {
-        /* TODO: using a polynomial of degree p,
-           falling factorial can be evaluated using n/p+p
-           full multiplications instead of n.
-        */
-        mpz_sub(ta, ta, g_one);
-        mpz_set(g_rfac, ta);
-        for (k=1; k<steps; k++)
+        prec = precs[j];
+        REPS = 1000000 / (prec + 100);
+        if (REPS < 4)
+            REPS = 4;
+
+        mpz_set_ui(x, 57);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 10);
+
+        gamma_init_coefficients(ctx, prec);
+        gamma_taylor(ctx, ref, x, prec, GAMMA_DEFAULT_J);
+
+        base_rate = 0;
+        for (nthreads=1; nthreads<=ncpu; nthreads++)
         {
-            mpz_sub(ta, ta, g_one);
-            mpz_mul(g_rfac, g_rfac, ta);
-            mpz_tdiv_q_2exp(g_rfac, g_rfac, wp);
-            /* Don't grow too large */
-            if (!(k % 4))
+            t1 = timing();
+            for (i=0; i<nthreads; i++)
+            {
+                args[i].x = x;
+                args[i].ref = ref;
+                args[i].prec = prec;
+                args[i].reps = REPS;
+                pthread_create(&threads[i], NULL, gamma_thread_worker, &args[i]);
+            }
+            mismatch = 0;
+            for (i=0; i<nthreads; i++)
             {
-                tmp = mpz_sizeinbase(g_rfac, 2) - wp;
-                mpz_tdiv_q_2exp(g_rfac, g_rfac, tmp);
-                expt += tmp;
+                pthread_join(threads[i], NULL);
+                mismatch |= args[i].mismatch;
             }
+            t2 = timing();
+
+            rate = 1e6 * nthreads * REPS / (t2-t1);
+            if (nthreads == 1)
+                base_rate = rate;
+
+            printf("%5d %7d %11.0f %8.2f %11.2f  %s\n", prec, nthreads, rate,
+                rate/base_rate, rate/base_rate/nthreads, mismatch ? "NO" : "yes");
         }
     }
-    else
-    {
-        mpz_set(g_rfac, g_one);
-    }
 
-    /* Polynomial is for G(1+x), so center on [-0.5,0.5) */
-    mpz_sub(ta, ta, g_one);
+    mpz_clear(x);
+    mpz_clear(ref);
+    ffl_clear(ctx);
+}
 
-    /* TODO: be both clever and correct here */
-    if (wp < 1000)
-    {
-        terms = (int)(pow(wp, 0.76) + 2);
-    }
-    else
-    {
-        /* Valid up to at least 15000 bits */
-        terms = (int)(pow(wp, 0.787) + 2);
-    }
 
-    dprec = gamma_coeff_prec-wp;
-    mpz_tdiv_q_2exp(tb, gamma_coeff[terms], dprec);
-    for (k=terms-1; k>=0; k--)
+/*
+Time to compute the coefficient table from scratch, and to extend it
+from a table at 4/5 of the precision. The table is checked against
+gamma(1/2)^2 = pi.
+*/
+void benchmark_coefficients_gamma()
+{
+    ffl_ctx_t ctx;
+    int prec;
+    double t1, t2, t3;
+    mpz_t x, y;
+    mpfr_t ref;
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+    mpfr_init(ref);
+
+    printf(" prec terms   scratch(ms)  extend(ms)  accuracy\n");
+
+    for (prec=53; prec<10000; prec*=2)
     {
-        mpz_mul(tb, tb, ta);
-        mpz_tdiv_q_2exp(tb, tb, wp);
-        mpz_tdiv_q_2exp(tc, gamma_coeff[k], dprec);
-        mpz_add(tb, tb, tc);
+        gamma_clear_coefficients();
+        t1 = timing();
+        gamma_init_coefficients(ctx, prec*4/5);
+        t2 = timing();
+        gamma_init_coefficients(ctx, prec);
+        t3 = timing();
+
+        mpz_fixed_one(x, prec-1);
+        gamma_taylor(ctx, y, x, prec, GAMMA_DEFAULT_J);
+        mpz_mul(y, y, y);
+        mpz_tdiv_q_2exp(y, y, prec);
+        mpfr_set_prec(ref, prec+10);
+        mpfr_const_pi(ref, GMP_RNDN);
+
+        printf("%5d %5d %13.2f %11.2f %9d\n", prec, gamma_taylor_terms(prec+15),
+            (t2-t1)/1000, (t3-t2)/1000, fix_accuracy(y, prec, ref));
     }
 
-    mpz_mul_2exp(g_rfac, g_rfac, wp - (wp-prec));
-    mpz_div(y, g_rfac, tb);
-
-    return expt;
+    mpz_clear(x);
+    mpz_clear(y);
+    mpfr_clear(ref);
+    ffl_clear(ctx);
 }
 
-double timing()
+
+/*
+Startup cost of getting a coefficient table for prec bits: computing
+it, parsing it from the old text format, and mapping the binary file,
+each followed by a first gamma_taylor call (which for the mapped
+table also pays for the page faults).
+*/
+void benchmark_startup_gamma(int prec)
 {
-    double v;
-    struct timeval t;
-    gettimeofday(&t, NULL);
-    v = (double) t.tv_usec;
-    v = v + 1e6 * (double) t.tv_sec;
-    return v;
-}
+    const char *text_file = "gamma_startup.txt";
+    const char *bin_file = "gamma_startup.bin";
+    ffl_ctx_t ctx;
+    FILE *fp;
+    mpz_t *coeff;
+    mpz_t x, y;
+    double t1, t2, t3;
+    int k, n;
 
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+    mpz_set_ui(x, 57);
+    mpz_mul_2exp(x, x, prec);
+    mpz_div_ui(x, x, 10);
+
+    n = gamma_taylor_terms(prec+15) + 1;
+    coeff = malloc(n * sizeof(mpz_t));
+    for (k=0; k<n; k++)
+        mpz_init(coeff[k]);
+
+    printf("%d coefficients with %d bits\n", n, prec+15);
+    printf("   source        load_us  first_call_us\n");
+
+    t1 = timing();
+    gamma_taylor_coefficients(ctx, coeff, n, prec+15);
+    t2 = timing();
+    printf("%9s %14.0f\n", "computed", t2-t1);
+
+    fp = fopen(text_file, "w");
+    fprintf(fp, "%d\n", prec+15);
+    for (k=0; k<n; k++)
+        gmp_fprintf(fp, "%Zx\n", coeff[k]);
+    fclose(fp);
 
+    gamma_clear_coefficients();
+    t1 = timing();
+    load_gamma_coefficients_text(text_file);
+    t2 = timing();
+    gamma_taylor(ctx, y, x, prec, GAMMA_DEFAULT_J);
+    t3 = timing();
+    printf("%9s %14.0f %14.0f\n", "text", t2-t1, t3-t2);
+
+    save_gamma_coefficients(bin_file, prec+15);
+
+    gamma_clear_coefficients();
+    t1 = timing();
+    load_gamma_coefficients(bin_file);
+    t2 = timing();
+    gamma_taylor(ctx, y, x, prec, GAMMA_DEFAULT_J);
+    t3 = timing();
+    printf("%9s %14.0f %14.0f\n", "mapped", t2-t1, t3-t2);
+
+    gamma_clear_coefficients();
+    remove(text_file);
+    remove(bin_file);
+
+    for (k=0; k<n; k++)
+        mpz_clear(coeff[k]);
+    free(coeff);
+    mpz_clear(x);
+    mpz_clear(y);
+    ffl_clear(ctx);
+}
 
-void benchmark_gamma()
-{
-    int REPS;
-    int prec;
-    int i, k, r, J, best_r, best_J;
-    double best_time, best_here;
-    double t1, t2, elapsed;
-    double mpfr_time;
-    int accuracy, min_accuracy;
-    int expt;
 
-    mpz_t x, y, dummy;
+/*
+gamma_taylor (with the argument reduction) against gamma_stirling over
+a sweep of x magnitudes, with the choice ffl_gamma makes and its
+accuracy. Taylor is skipped where its reduction would take too long.
+*/
+void benchmark_stirling_gamma()
+{
+    static const int precs[] = {53, 200, 1000, 3000, 10000};
+    static const double xs[] = {2.37, 13.7, 47.3, 137.3, 473.3, 1373.3,
+        4733.3, 13733.3, 137333.3, 1373333.3};
+    ffl_ctx_t ctx;
+    mpz_t x, y;
     mpfr_t mx, my;
+    double t1, t2, elapsed, taylor_time, stirling_time;
+    int REPS, prec, accuracy, expt;
+    size_t i, j;
+    int k, r;
 
-    mpfr_init(mx);
-    mpfr_init(my);
-
+    ffl_init(ctx);
     mpz_init(x);
     mpz_init(y);
-    mpz_init(dummy);
+    mpfr_init(mx);
+    mpfr_init(my);
 
-    for (prec=53; prec<gamma_coeff_prec-100; prec+=prec/4)
+    printf(" prec          x   taylor_us stirling_us  ffl_gamma  accuracy\n");
+    for (i=0; i<sizeof(precs)/sizeof(precs[0]); i++)
     {
+        prec = precs[i];
         if (prec < 300)
             REPS = 100;
-        else if (prec < 600)
-            REPS = 50;
         else if (prec < 1200)
             REPS = 10;
         else
-            REPS = 2;
+            REPS = 1;
 
-        mpz_set_ui(x, 57);
-        mpz_mul_2exp(x, x, prec);
-        mpz_div_ui(x, x, 10);
+        gamma_init_coefficients(ctx, prec);
+
+        for (j=0; j<sizeof(xs)/sizeof(xs[0]); j++)
+        {
+            mpz_set_d(x, xs[j] * 1024);
+            mpz_mul_2exp(x, x, prec - 10);
+
+            taylor_time = stirling_time = 1e100;
+            for (r=0; r<5; r++)
+            {
+                if (xs[j] < 20 * gamma_stirling_cutoff(prec))
+                {
+                    t1 = timing();
+                    for (k=0; k<REPS; k++)
+                        gamma_taylor(ctx, y, x, prec, GAMMA_DEFAULT_J);
+                    t2 = timing();
+                    elapsed = (t2-t1)/REPS;
+                    if (elapsed < taylor_time)
+                        taylor_time = elapsed;
+                }
+
+                t1 = timing();
+                for (k=0; k<REPS; k++)
+                    gamma_stirling(ctx, y, x, prec);
+                t2 = timing();
+                elapsed = (t2-t1)/REPS;
+                if (elapsed < stirling_time)
+                    stirling_time = elapsed;
+            }
+
+            mpfr_set_prec(mx, prec+64);
+            mpfr_set_prec(my, prec);
+            mpfr_set_z(mx, x, GMP_RNDN);
+            mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
+            mpfr_gamma(my, mx, GMP_RNDN);
+
+            expt = ffl_gamma(ctx, y, x, prec);
+            mpfr_set_z(mx, y, GMP_RNDN);
+            mpfr_mul_2si(mx, mx, expt - prec, GMP_RNDN);
+            mpfr_sub(mx, mx, my, GMP_RNDN);
+            mpfr_div(mx, mx, my, GMP_RNDN);
+            accuracy = mpfr_zero_p(mx) ? prec : -(int)mpfr_get_exp(mx)+1;
+
+            if (taylor_time < 1e100)
+                printf("%5d %10.1f %11.1f %11.1f %10s %9d\n", prec, xs[j],
+                    taylor_time, stirling_time,
+                    xs[j] >= gamma_stirling_cutoff(prec) ? "stirling" : "taylor", accuracy);
+            else
+                printf("%5d %10.1f %11s %11.1f %10s %9d\n", prec, xs[j],
+                    "-", stirling_time,
+                    xs[j] >= gamma_stirling_cutoff(prec) ? "stirling" : "taylor", accuracy);
+        }
+    }
+
+    mpfr_clear(mx);
+    mpfr_clear(my);
+    mpz_clear(x);
+    mpz_clear(y);
+    gamma_clear_coefficients();
+    ffl_clear(ctx);
+}
 
-        min_accuracy = prec;
-        best_time = 1e100;
-        best_r = 0;
-        best_J = 0;
+typedef struct
+{
+    ffl_ctx_struct *ctx;
+    mpz_ptr y;
+    mpz_ptr x;
+    int prec;
+} gamma_bench_arg;
 
-        mpfr_set_prec(mx, prec+10);
-        mpfr_set_prec(my, prec);
-        mpfr_set_z(mx, x, GMP_RNDN);
-        mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
+static void gamma_bench_call(void *arg)
+{
+    gamma_bench_arg *a = (gamma_bench_arg *) arg;
+    ffl_gamma(a->ctx, a->y, a->x, a->prec);
+}
 
-        mpfr_time = 1e100;
-        for (i=0; i<10; i++)
+/*
+ffl_gamma at x = 5.7, 57, 570 and 5700 through the benchmark harness,
+one line per precision and argument in the given format, with the
+hardware and operation counts per call. The Taylor coefficients are
+loaded or computed beforehand. Runs on cpu if
+cpu >= 0. Times in nanoseconds.
+*/
+void benchmark_suite_gamma(int format, int cpu)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333, 10000};
+    /* arguments in tenths */
+    static const int xs[] = {57, 570, 5700, 57000};
+    ffl_ctx_t ctx;
+    mpz_t x, y;
+    gamma_bench_arg arg;
+    bench_result res;
+    char params[64];
+    int i, j, prec;
+
+    if (bench_pin_cpu(cpu) != 0)
+        fprintf(stderr, "could not pin to cpu %d\n", cpu);
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+
+    if (load_gamma_coefficients(GAMMA_COEFF_FILE) < 0)
+        gamma_init_coefficients(ctx, precs[sizeof(precs)/sizeof(precs[0]) - 1]);
+
+    bench_report_header(format, 1);
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+
+        for (i=0; i<(int)(sizeof(xs)/sizeof(xs[0])); i++)
         {
-            t1 = timing();
-            for (k=0; k<REPS; k++)
+            mpz_set_ui(x, xs[i]);
+            mpz_mul_2exp(x, x, prec);
+            mpz_div_ui(x, x, 10);
+
+            snprintf(params, sizeof(params), "x=%d.%d %s", xs[i] / 10, xs[i] % 10,
+                xs[i] >= 10 * gamma_stirling_cutoff(prec) ? "stirling" : "taylor");
+
+            arg.ctx = ctx;
+            arg.y = y;
+            arg.x = x;
+            arg.prec = prec;
+            bench_run(&res, gamma_bench_call, &arg, BENCH_SAMPLES, BENCH_SAMPLE_NS);
+            bench_count(&res, gamma_bench_call, &arg, ctx);
+            bench_report(format, "gamma", prec, params, &res);
+        }
+    }
+
+    mpz_clear(x);
+    mpz_clear(y);
+    ffl_clear(ctx);
+}
+
+/*
+ffl_gamma on n random arguments per precision (fewer above 1000 bits),
+log-uniform in [GAMMA_SWEEP_LO, GAMMA_SWEEP_HI), against mpfr_gamma;
+also gamma_taylor up to twice and gamma_stirling down from half the
+cutoff of ffl_gamma, to check both sides of the switch. Errors in bits
+(log2 of the error in ulps of y), times in nanoseconds.
+*/
+void benchmark_sweep_gamma(int n)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333, 10000};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result res;
+    double lo, hi;
+    int i, j, prec, count;
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    if (load_gamma_coefficients(GAMMA_COEFF_FILE) < 0)
+        gamma_init_coefficients(ctx, precs[sizeof(precs)/sizeof(precs[0]) - 1]);
+
+    printf(" prec  kernel                lo          hi      n  max_err  mean_err          worst_x      ns/call\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        for (i=0; i<3; i++)
+        {
+            if (i == 0)
             {
-                mpfr_gamma(my, mx, GMP_RNDN);
+                lo = GAMMA_SWEEP_LO;
+                hi = GAMMA_SWEEP_HI;
+                bench_sweep(&res, ctx, gamma_sweep_kernel, NULL, mpfr_gamma,
+                    lo, hi, 1, count, prec, state);
             }
-            t2 = timing();
-            elapsed = (t2-t1)/REPS;
-            if (elapsed < mpfr_time)
-                mpfr_time = elapsed;
+            else if (i == 1)
+            {
+                lo = GAMMA_SWEEP_LO;
+                hi = 2 * gamma_stirling_cutoff(prec);
+                bench_sweep(&res, ctx, gamma_taylor_sweep_kernel, NULL, mpfr_gamma,
+                    lo, hi, 1, count, prec, state);
+            }
+            else
+            {
+                lo = gamma_stirling_cutoff(prec) / 2;
+                hi = GAMMA_SWEEP_HI;
+                bench_sweep(&res, ctx, gamma_stirling_sweep_kernel, NULL, mpfr_gamma,
+                    lo, hi, 1, count, prec, state);
+            }
+            printf("%5d  %-14s %11.1f %11.1f %6d %8.2f %9.3f %16.6f %12.0f\n", prec,
+                i == 0 ? "ffl_gamma" : i == 1 ? "gamma_taylor" : "gamma_stirling",
+                lo, hi, res.n, res.max_err, res.mean_err, res.worst_x, res.ns);
+            fflush(stdout);
         }
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+
+typedef struct
+{
+    mpz_ptr y;
+    int c;
+    int prec;
+} const_bench_arg;
+
+static void const_bench_call(void *arg)
+{
+    const_bench_arg *a = (const_bench_arg *) arg;
+    ffl_const(a->y, a->c, a->prec);
+}
 
-        best_time = 1e100;
-        for (i=0; i<10; i++)
+/* ref = constant c with the precision of ref */
+static void const_bench_ref(mpfr_t ref, int c)
+{
+    if (c == CONST_PI)
+        mpfr_const_pi(ref, GMP_RNDN);
+    else if (c == CONST_LN2)
+        mpfr_const_log2(ref, GMP_RNDN);
+    else
+        mpfr_const_euler(ref, GMP_RNDN);
+}
+
+/*
+The cached constants pi, log(2) and Euler's constant. At each
+precision: the first call from an empty cache (binary splitting), a
+repeated call (a shift of the cached value) through the benchmark
+harness, mpfr_const_* with the MPFR cache freed, and for Euler's
+constant const_euler_direct, which sums term by term. acc_c is the
+accuracy of a call for all const_cached_prec() bits of the cache,
+which must not lose more than a bit. Then n calls at precisions rising
+log-uniformly from 53 to 10^5 bits, which recompute only a few times,
+so that their mean cost is close to that of one first call at 10^5
+bits divided by n. Times in microseconds, repeated calls in
+nanoseconds.
+*/
+void benchmark_constants_gamma(int n)
+{
+    static const int precs[] = {53, 333, 1000, 3333, 10000, 33333, 100000};
+    static const char *names[] = {"pi", "log2", "euler"};
+    mpz_t y;
+    mpfr_t ref;
+    const_bench_arg arg;
+    bench_result res;
+    double t1, t2, t3, first;
+    int i, j, c, prec, last, recomputed, cprec, acc_c;
+
+    mpz_init(y);
+    mpfr_init(ref);
+
+    printf("   prec  const    acc  cached  acc_c    first_us  repeat_ns     mpfr_us   direct_us\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+
+        for (c=0; c<CONST_COUNT; c++)
         {
+            clear_constants();
             t1 = timing();
-            for (k=0; k<REPS; k++)
+            ffl_const(y, c, prec);
+            t2 = timing();
+
+            arg.y = y;
+            arg.c = c;
+            arg.prec = prec;
+            bench_run(&res, const_bench_call, &arg, BENCH_SAMPLES, BENCH_SAMPLE_NS);
+
+            cprec = const_cached_prec(c);
+            mpfr_set_prec(ref, cprec + 10);
+            const_bench_ref(ref, c);
+            ffl_const(y, c, cprec);
+            acc_c = fix_accuracy(y, cprec, ref);
+            ffl_const(y, c, prec);
+
+            mpfr_set_prec(ref, prec + 10);
+            mpfr_free_cache();
+            t3 = timing();
+            const_bench_ref(ref, c);
+            t3 = timing() - t3;
+
+            printf("%7d %6s %6d %7d %6d %11.1f %10.1f %11.1f", prec, names[c],
+                fix_accuracy(y, prec, ref), cprec, acc_c, t2-t1, res.median, t3);
+
+            /* the term by term sum is O(prec^2) */
+            if (c == CONST_EULER && prec <= 33333)
             {
-                expt = gamma_taylor(y, x, prec);
+                t1 = timing();
+                const_euler_direct(y, prec);
+                printf(" %11.1f\n", timing() - t1);
             }
-            t2 = timing();
-            elapsed = (t2-t1)/REPS;
-            if (elapsed < best_time)
-                best_time = elapsed;
+            else
+                printf(" %11s\n", "-");
         }
+    }
 
-        mpfr_set_z(mx, y, GMP_RNDN);
-        mpfr_mul_2ui(mx, mx, expt, GMP_RNDN);
-        mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
-
-        mpfr_sub(mx, mx, my, GMP_RNDN);
-        mpfr_div(mx, mx, my, GMP_RNDN);
-        mpfr_abs(mx, mx, GMP_RNDN);
+    printf("\n%d calls at rising precision up to 100000 bits\n", n);
+    printf(" const  recomputed    total_ms     mean_us  first_us(100000)\n");
 
-        if (!mpfr_zero_p(mx))
+    for (c=0; c<CONST_COUNT; c++)
+    {
+        clear_constants();
+        recomputed = 0;
+        last = 0;
+        t1 = timing();
+        for (i=0; i<n; i++)
         {
-            accuracy = -(int)mpfr_get_exp(mx)+1;
-            if (accuracy < min_accuracy)
+            prec = (int) (53 * pow(100000 / 53.0, (double) i / (n - 1)));
+            ffl_const(y, c, prec);
+            if (const_cached_prec(c) != last)
             {
-                min_accuracy = accuracy;
+                recomputed++;
+                last = const_cached_prec(c);
             }
         }
+        t2 = timing();
 
-        mpfr_time *= 1000;
-        best_time *= 1000;
-        printf("%5d %5d %10ld %10d   %.3f\n", prec, min_accuracy,
-            (long)mpfr_time, (int)best_time, mpfr_time/best_time);
+        clear_constants();
+        first = timing();
+        ffl_const(y, c, 100000);
+        first = timing() - first;
 
+        printf("%6s %11d %11.1f %11.2f %17.1f\n", names[c], recomputed,
+            (t2-t1)/1000, (t2-t1)/n, first);
     }
 
-    mpfr_clear(mx);
-    mpfr_clear(my);
-
-    mpz_clear(x);
+    clear_constants();
     mpz_clear(y);
-    mpz_clear(dummy);
-
+    mpfr_clear(ref);
 }
 
+/*
+ffl_mpfr_gamma against mpfr_gamma on n random arguments per precision
+(fewer above 1000 bits), log-uniform in [GAMMA_SWEEP_LO,
+GAMMA_SWEEP_HI) ("all") and in each of the ranges below, which
+separate the Taylor and Stirling paths of ffl_gamma, in all rounding
+modes (see bench_mpfr_compare). Counts the results that differ from
+MPFR, which should be none, and times both end to end, conversions
+included, in nanoseconds. The warm-up pass computes the Taylor
+coefficients and the Stirling tables, so the times are those of the
+steady state; the first call at a new precision costs more.
+*/
+void benchmark_mpfr_gamma(int n)
+{
+    static const int precs[] = {24, 53, 113, 333, 1000, 3333};
+    static const double lo[] = {GAMMA_SWEEP_LO, 0.5, 2, 20, 200, 2000};
+    static const double hi[] = {GAMMA_SWEEP_HI, 2, 20, 200, 2000, GAMMA_SWEEP_HI};
+    char range[32];
+    gmp_randstate_t state;
+    bench_mpfr_result res;
+    int i, j, prec, count;
+
+    gmp_randinit_default(state);
+
+    printf(" prec  range               n  wrong  ternary       ffl_ns      mpfr_ns  mpfr/ffl\n");
 
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
 
-int main()
+        for (i=0; i<(int)(sizeof(lo)/sizeof(lo[0])); i++)
+        {
+            if (i == 0)
+                strcpy(range, "all");
+            else
+                snprintf(range, sizeof(range), "[%g, %g)", lo[i], hi[i]);
+
+            bench_mpfr_compare(&res, ffl_mpfr_gamma, mpfr_gamma, lo[i], hi[i], 1, 0, count, prec, state);
+            printf("%5d  %-14s %6d %6d %8d %12.0f %12.0f %9.2f\n", prec, range, res.n, res.wrong,
+                res.wrong_ternary, res.ns, res.ref_ns, res.ref_ns / res.ns);
+            fflush(stdout);
+        }
+    }
+
+    gmp_randclear(state);
+    ffl_mpfr_clear();
+}
+
+int main(int argc, char *argv[])
 {
-    ffl_init();
-    load_gamma_coefficients();
-    benchmark_gamma();
-    ffl_clear();
+    ffl_ctx_t ctx;
+
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+    {
+        /* gammatest bench [text|csv|json] [cpu] */
+        int format = argc > 2 ? bench_parse_format(argv[2]) : BENCH_TEXT;
+        if (format < 0)
+        {
+            printf("usage: gammatest bench [text|csv|json] [cpu]\n");
+            return 1;
+        }
+        benchmark_suite_gamma(format, argc > 3 ? atoi(argv[3]) : -1);
+        gamma_clear_coefficients();
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "threads"))
+    {
+        benchmark_threads_gamma(argc > 2 ? atoi(argv[2]) : 0);
+    }
+    else if (argc > 1 && !strcmp(argv[1], "coeff"))
+    {
+        benchmark_coefficients_gamma();
+    }
+    else if (argc > 1 && !strcmp(argv[1], "save"))
+    {
+        /* gammatest save [prec [file]] */
+        if (save_gamma_coefficients(argc > 3 ? argv[3] : GAMMA_COEFF_FILE,
+                (argc > 2 ? atoi(argv[2]) : 10000) + 15) == 0)
+            printf("wrote %s\n", argc > 3 ? argv[3] : GAMMA_COEFF_FILE);
+        else
+            printf("could not write %s\n", argc > 3 ? argv[3] : GAMMA_COEFF_FILE);
+    }
+    else if (argc > 2 && !strcmp(argv[1], "convert"))
+    {
+        /* gammatest convert gamma_data.txt [file] */
+        if (load_gamma_coefficients_text(argv[2]) < 0)
+            printf("could not read %s\n", argv[2]);
+        else if (save_gamma_coefficients(argc > 3 ? argv[3] : GAMMA_COEFF_FILE, 0) == 0)
+            printf("wrote %s\n", argc > 3 ? argv[3] : GAMMA_COEFF_FILE);
+        else
+            printf("could not write %s\n", argc > 3 ? argv[3] : GAMMA_COEFF_FILE);
+    }
+    else if (argc > 1 && !strcmp(argv[1], "startup"))
+    {
+        benchmark_startup_gamma(argc > 2 ? atoi(argv[2]) : 3000);
+    }
+    else if (argc > 1 && !strcmp(argv[1], "stirling"))
+    {
+        benchmark_stirling_gamma();
+    }
+    else if (argc > 1 && !strcmp(argv[1], "sweep"))
+    {
+        benchmark_sweep_gamma(argc > 2 ? atoi(argv[2]) : 2000);
+    }
+    else if (argc > 1 && !strcmp(argv[1], "constants"))
+    {
+        benchmark_constants_gamma(argc > 2 ? atoi(argv[2]) : 10000);
+    }
+    else if (argc > 1 && !strcmp(argv[1], "mpfr"))
+    {
+        benchmark_mpfr_gamma(argc > 2 ? atoi(argv[2]) : 500);
+    }
+    else
+    {
+        ffl_init(ctx);
+        /* Keep the coefficient generation out of the timings */
+        if (load_gamma_coefficients(GAMMA_COEFF_FILE) < 0)
+            printf("%s not found, computing the coefficients\n", GAMMA_COEFF_FILE);
+        gamma_init_coefficients(ctx, 10000);
+        benchmark_gamma(ctx);
+        ffl_clear(ctx);
+    }
+
+    gamma_clear_coefficients();
 }
 
 
@@ -2,161 +2,10 @@
 #include <stdio.h>
 #include <gmp.h>
 #include <mpfr.h>
-#include <sys/time.h>
 
-#define MAX_SERIES_STEPS 10
+#include "fastfun.h"
 
-mpz_t _log_x;
-mpz_t _log_t;
-mpz_t _log_one;
-mpz_t _log_a;
-mpz_t _log_s0;
-mpz_t _log_s1;
-mpz_t _log_x2;
-
-mpz_t _log_pows[MAX_SERIES_STEPS];
-mpz_t _log_sums[MAX_SERIES_STEPS];
-
-double timing()
-{
-    double v;
-    struct timeval t;
-    gettimeofday(&t, NULL);
-    v = (double) t.tv_usec;
-    v = v + 1e6 * (double) t.tv_sec;
-    return v;
-}
-
-void fix_init_data()
-{
-    int i;
-    mpz_init(_log_x);
-    mpz_init(_log_x2);
-    mpz_init(_log_one);
-    mpz_init(_log_t);
-    mpz_init(_log_a);
-    mpz_init(_log_s0);
-    mpz_init(_log_s1);
-    for (i=0; i<MAX_SERIES_STEPS; i++)
-    {
-        mpz_init(_log_pows[i]);
-        mpz_init(_log_sums[i]);
-    }
-}
-
-void fix_clear_data()
-{
-    int i;
-    mpz_clear(_log_x);
-    mpz_clear(_log_x2);
-    mpz_clear(_log_one);
-    mpz_clear(_log_t);
-    mpz_clear(_log_a);
-    mpz_clear(_log_s0);
-    mpz_clear(_log_s1);
-    for (i=0; i<MAX_SERIES_STEPS; i++)
-    {
-        mpz_clear(_log_pows[i]);
-        mpz_clear(_log_sums[i]);
-    }
-}
-
-void mpz_fixed_one(mpz_t x, int prec)
-{
-    //mpz_set_ui(x, 1);
-    //mpz_mul_2exp(x, x, prec);
-    mpz_set_ui(x, 0);
-    mpz_setbit(x, prec);
-}
-
-void log_series(mpz_t y, mpz_t x, int prec, int r, int J)
-{
-    int i, k, wp;
-
-    wp = prec + r + 10;
-
-    mpz_fixed_one(_log_one, wp);
-    mpz_mul_2exp(_log_x, x, wp-prec);
-
-    for (i=0; i<r; i++)
-    {
-        mpz_mul_2exp(_log_x, _log_x, wp);
-        mpz_sqrt(_log_x, _log_x);
-    }
-
-    // x = (x-1)/(x+1)
-    mpz_add(_log_t, _log_x, _log_one);
-    mpz_sub(_log_x, _log_x, _log_one);
-    mpz_mul_2exp(_log_x, _log_x, wp);
-    mpz_tdiv_q(_log_x, _log_x, _log_t);
-
-    if (J < 1)
-        J = 1;
-
-    for (i=0; i<J; i++)
-    {
-        if (i == 0)
-        {
-            mpz_set(_log_pows[i], _log_one);
-        }
-        else if (i == 1)
-        {
-            mpz_mul(_log_pows[i], _log_x, _log_x);
-            mpz_tdiv_q_2exp(_log_pows[i], _log_pows[i], wp);
-        }
-        else
-        {
-            mpz_mul(_log_pows[i], _log_pows[i-1], _log_pows[1]);
-            mpz_tdiv_q_2exp(_log_pows[i], _log_pows[i], wp);
-        }
-        mpz_set_ui(_log_sums[i], 0);
-    }
-
-    // Set a = x, _log_x = x^2
-    if (J == 1)
-    {
-        mpz_set(_log_a, _log_x);
-        mpz_mul(_log_x, _log_x, _log_x);
-        mpz_tdiv_q_2exp(_log_x, _log_x, wp);
-    }
-    // Set a = x, _log_x = x^(2*J)
-    else
-    {
-        mpz_set(_log_a, _log_x);
-        mpz_mul(_log_x, _log_pows[J-1], _log_pows[1]);
-        mpz_tdiv_q_2exp(_log_x, _log_x, wp);
-    }
-
-    // Main Taylor series loop
-    k = 1;
-    while (mpz_sgn(_log_a) != 0)
-    {
-        for (i=0; i<J; i++)
-        {
-            mpz_tdiv_q_ui(_log_t, _log_a, k);
-            mpz_add(_log_sums[i], _log_sums[i], _log_t);
-            k += 2;
-        }
-        mpz_mul(_log_a, _log_a, _log_x);
-        mpz_tdiv_q_2exp(_log_a, _log_a, wp);
-    }
-
-    for (i=1; i<J; i++)
-    {
-        mpz_mul(_log_sums[i], _log_sums[i], _log_pows[i]);
-        mpz_tdiv_q_2exp(_log_sums[i], _log_sums[i], wp);
-    }
-
-    mpz_set_ui(y, 0);
-    for (i=0; i<J; i++)
-    {
-        mpz_add(y, y, _log_sums[i]);
-    }
-
-    mpz_tdiv_q_2exp(y, y, wp-prec-r-1);
-}
-
-void benchmark_optimize_log()
+void benchmark_optimize_log(ffl_ctx_t ctx)
 {
     int REPS;
     int prec;
@@ -225,7 +74,7 @@ void benchmark_optimize_log()
                     t1 = timing();
                     for (k=0; k<REPS; k++)
                     {
-                        log_series(y, x, prec, r, J);
+                        log_series(ctx, y, x, prec, r, J, 0);
                     }
                     t2 = timing();
                     elapsed = (t2-t1) / REPS;
@@ -275,10 +124,12 @@ void benchmark_optimize_log()
 
 int main()
 {
-    fix_init_data();
+    ffl_ctx_t ctx;
+
+    ffl_init(ctx);
 
-    benchmark_optimize_log();
+    benchmark_optimize_log(ctx);
 
-    fix_clear_data();
+    ffl_clear(ctx);
 }
 
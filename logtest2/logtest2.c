@@ -1,230 +1,74 @@
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 #include <mpfr.h>
-#include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <math.h>
 
-#define MAX_SERIES_STEPS 10
+#include "fastfun.h"
 
-mpz_t _log_x;
-mpz_t _log_t;
-mpz_t _log_one;
-mpz_t _log_a;
-mpz_t _log_s0;
-mpz_t _log_s1;
-mpz_t _log_x2;
-
-mpz_t _log_pows[MAX_SERIES_STEPS];
-mpz_t _log_sums[MAX_SERIES_STEPS];
-
-#define LOG_LUT_STEP 9
-#define LOG_LUT_SIZE (1<<(LOG_LUT_STEP+1))
-#define LOG_LUT_PREC 4096
-
-mpz_t _log_lut[LOG_LUT_SIZE];
-
-double timing()
-{
-    double v;
-    struct timeval t;
-    gettimeofday(&t, NULL);
-    v = (double) t.tv_usec;
-    v = v + 1e6 * (double) t.tv_sec;
-    return v;
-}
-
-void fix_init_data()
-{
-    int i;
-    mpz_init(_log_x);
-    mpz_init(_log_x2);
-    mpz_init(_log_one);
-    mpz_init(_log_t);
-    mpz_init(_log_a);
-    mpz_init(_log_s0);
-    mpz_init(_log_s1);
-    for (i=0; i<MAX_SERIES_STEPS; i++)
-    {
-        mpz_init(_log_pows[i]);
-        mpz_init(_log_sums[i]);
-    }
-    for (i=0; i<LOG_LUT_SIZE; i++)
-    {
-        mpz_init(_log_lut[i]);
-    }
-}
-
-void fix_clear_data()
+/* ffl_log as a bench_sweep kernel */
+static int log_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    int i;
-    mpz_clear(_log_x);
-    mpz_clear(_log_x2);
-    mpz_clear(_log_one);
-    mpz_clear(_log_t);
-    mpz_clear(_log_a);
-    mpz_clear(_log_s0);
-    mpz_clear(_log_s1);
-    for (i=0; i<MAX_SERIES_STEPS; i++)
-    {
-        mpz_clear(_log_pows[i]);
-        mpz_clear(_log_sums[i]);
-    }
-    for (i=0; i<LOG_LUT_SIZE; i++)
-    {
-        mpz_clear(_log_lut[i]);
-    }
+    (void) param;
+    ffl_log(ctx, y, x, prec);
+    return 0;
 }
 
-void mpz_fixed_one(mpz_t x, int prec)
+/* log_series_mpn with the (r, J, lut) in param[0..2] as a bench_sweep kernel */
+static int log_series_mpn_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    //mpz_set_ui(x, 1);
-    //mpz_mul_2exp(x, x, prec);
-    mpz_set_ui(x, 0);
-    mpz_setbit(x, prec);
+    int *rJL = (int *) param;
+    log_series_mpn(ctx, y, x, prec, rJL[0], rJL[1], rJL[2]);
+    return 0;
 }
 
-void printx(char *s, mpz_t x, int prec)
+#ifdef FFL_FAST128
+/* log_fast128 as a bench_sweep kernel */
+static int log_fast128_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    mpfr_t y;
-    mpfr_init2(y, 53);
-    mpfr_set_z(y, x, GMP_RNDN);
-    mpfr_div_2ui(y, y, prec, GMP_RNDN);
-    mpfr_printf("%s: %Rf\n", s, y);
-    mpfr_clear(y);
+    (void) param;
+    log_fast128(ctx, y, x, prec);
+    return 0;
 }
+#endif
 
-void log_series(mpz_t y, mpz_t x, int prec, int r, int J, int _use_lut)
+/* log_series with the (r, J, lut) in param[0..2] as a bench_sweep kernel */
+static int log_series_sweep_kernel(ffl_ctx_struct *ctx, mpz_t y, mpz_t x, int prec, void *param)
 {
-    int i, k, wp;
-    int lut_index;
-
-    wp = prec + r + 10;
-
-    mpz_fixed_one(_log_one, wp);
-    mpz_mul_2exp(_log_x, x, wp-prec);
-
-    _use_lut = _use_lut && (wp <= LOG_LUT_PREC);
-
-    // XXX: cleanup the following
-    if (_use_lut)
-    {
-        // write x = t + k/2^n, log(k/2^n) cached,
-        // so that log(x) = log(k/2^n) + log(1 + (x-t)/t)
-        mpz_tdiv_q_2exp(_log_t, _log_x, wp-LOG_LUT_STEP);
-        lut_index = mpz_get_ui(_log_t);
-        if (lut_index != 0 && mpz_sgn(_log_lut[lut_index]) == 0)
-        {
-            // Note: need to restore overwritten variables
-            mpz_set_ui(_log_t, lut_index);
-            mpz_mul_2exp(_log_t, _log_t, LOG_LUT_PREC - LOG_LUT_STEP);
-            log_series(_log_lut[lut_index], _log_t, LOG_LUT_PREC, 8, 8, 0);
-            mpz_fixed_one(_log_one, wp);
-            mpz_mul_2exp(_log_x, x, wp-prec);
-        }
-
-        // t = k/2^n
-        // 1+(x-t)/t = = 1 + (x-t)*(2^n/k) = x*2^n/k
-        mpz_mul_2exp(_log_x, _log_x, LOG_LUT_STEP);
-        mpz_tdiv_q_ui(_log_x, _log_x, lut_index);
-    }
-
-    for (i=0; i<r; i++)
-    {
-        mpz_mul_2exp(_log_x, _log_x, wp);
-        mpz_sqrt(_log_x, _log_x);
-    }
-
-    mpz_add(_log_t, _log_x, _log_one);
-    mpz_sub(_log_x, _log_x, _log_one);
-    mpz_mul_2exp(_log_x, _log_x, wp);
-    mpz_tdiv_q(_log_x, _log_x, _log_t);
-
-    if (J < 1)
-        J = 1;
-
-    for (i=0; i<J; i++)
-    {
-        if (i == 0)
-        {
-            mpz_set(_log_pows[i], _log_one);
-        }
-        else if (i == 1)
-        {
-            mpz_mul(_log_pows[i], _log_x, _log_x);
-            mpz_tdiv_q_2exp(_log_pows[i], _log_pows[i], wp);
-        }
-        else
-        {
-            mpz_mul(_log_pows[i], _log_pows[i-1], _log_pows[1]);
-            mpz_tdiv_q_2exp(_log_pows[i], _log_pows[i], wp);
-        }
-        mpz_set_ui(_log_sums[i], 0);
-    }
-
-    if (J == 1)
-    {
-        mpz_set(_log_a, _log_x);
-        mpz_mul(_log_x, _log_x, _log_x);
-        mpz_tdiv_q_2exp(_log_x, _log_x, wp);
-    }
-    else
-    {
-        mpz_set(_log_a, _log_x);
-        mpz_mul(_log_x, _log_pows[J-1], _log_pows[1]);
-        mpz_tdiv_q_2exp(_log_x, _log_x, wp);
-    }
-
-    // Main Taylor series loop
-    k = 1;
-    while (mpz_sgn(_log_a) != 0)
-    {
-        for (i=0; i<J; i++)
-        {
-            mpz_tdiv_q_ui(_log_t, _log_a, k);
-            mpz_add(_log_sums[i], _log_sums[i], _log_t);
-            k += 2;
-        }
-        mpz_mul(_log_a, _log_a, _log_x);
-        mpz_tdiv_q_2exp(_log_a, _log_a, wp);
-    }
-
-    for (i=1; i<J; i++)
-    {
-        mpz_mul(_log_sums[i], _log_sums[i], _log_pows[i]);
-        mpz_tdiv_q_2exp(_log_sums[i], _log_sums[i], wp);
-    }
-
-    mpz_set_ui(y, 0);
-    for (i=0; i<J; i++)
-    {
-        mpz_add(y, y, _log_sums[i]);
-    }
-
-    if (_use_lut)
-    {
-        mpz_mul_2exp(y, y, r+1);
-        mpz_tdiv_q_2exp(_log_t, _log_lut[lut_index], LOG_LUT_PREC-wp);
-        mpz_add(y, y, _log_t);
-        mpz_tdiv_q_2exp(y, y, wp-prec);
-    }
-    else
-    {
-        mpz_tdiv_q_2exp(y, y, wp-prec-r-1);
-    }
+    int *rJL = (int *) param;
+    log_series(ctx, y, x, prec, rJL[0], rJL[1], rJL[2]);
+    return 0;
 }
 
-void benchmark_optimize_log()
+/*
+The fastest (r, J, lut) for log_series(1.37) per precision, written to
+tune_file. A candidate is only accepted if, on TUNE_SWEEP_N random
+arguments (the same for every candidate), its maximum error is within
+TUNE_MAX_ERR bits of that of the default parameters; err is that
+error for the winner and rej the number of faster candidates
+rejected.
+*/
+void benchmark_optimize_log(ffl_ctx_t ctx, const char *tune_file)
 {
     int REPS;
     int prec;
-    int i, k, r, J, best_r, best_J;
-    double best_time, best_here;
+    int i, k, r, J, lut, best_r, best_J, best_lut, rejected;
+    double best_time, best_here, best_err, ref_err;
     double t1, t2, elapsed;
     double mpfr_time;
     int accuracy, min_accuracy;
+    int tune_prec[TUNE_SIZE], tune_r[TUNE_SIZE], tune_J[TUNE_SIZE], tune_lut[TUNE_SIZE];
+    int ntune = 0;
+    int rJL[3];
 
     mpz_t x, y, dummy;
     mpfr_t mx, my;
+    gmp_randstate_t state;
+    bench_sweep_result sweep;
 
     mpfr_init(mx);
     mpfr_init(my);
@@ -232,10 +76,11 @@ void benchmark_optimize_log()
     mpz_init(x);
     mpz_init(y);
     mpz_init(dummy);
+    gmp_randinit_default(state);
 
-    printf(" prec   acc   J   r     mpfr     this   faster\n");
+    printf(" prec   acc   J   r lut     mpfr     this   faster    err  rej\n");
 
-    for (prec=53; prec<6000; prec+=prec/4)
+    for (prec=53; prec<30000; prec+=prec/4)
     {
         if (prec < 300)
             REPS = 100;
@@ -243,8 +88,10 @@ void benchmark_optimize_log()
             REPS = 50;
         else if (prec < 1200)
             REPS = 10;
-        else
+        else if (prec < 6000)
             REPS = 2;
+        else
+            REPS = 1;
 
         mpz_set_ui(x, 137);
         mpz_mul_2exp(x, x, prec);
@@ -254,6 +101,15 @@ void benchmark_optimize_log()
         best_time = 1e100;
         best_r = 0;
         best_J = 0;
+        best_lut = 0;
+        best_err = 0;
+        rejected = 0;
+
+        log_default_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&sweep, ctx, log_series_sweep_kernel, rJL, mpfr_log,
+            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, TUNE_SWEEP_N, prec, state);
+        ref_err = sweep.max_err;
 
         mpfr_set_prec(mx, prec);
         mpfr_set_prec(my, prec);
@@ -273,39 +129,61 @@ void benchmark_optimize_log()
                 mpfr_time = elapsed;
         }
 
-        for (J=1; J<MAX_SERIES_STEPS; J++)
+        for (lut=0; lut<=LOG_LUT_LEVELS; lut++)
         {
-            for (r=0; r*r<prec+30; r++)
+            for (J=1; J<MAX_SERIES_STEPS; J++)
             {
-                for (i=0; i<3; i++)
+                for (r=0; r*r<prec+30; r+=(prec < 6000) ? 1 : 2)
                 {
-                    t1 = timing();
-                    for (k=0; k<REPS; k++)
+                    best_here = 1e100;
+                    for (i=0; i<3; i++)
                     {
-                        log_series(y, x, prec, r, J, 1);
+                        t1 = timing();
+                        for (k=0; k<REPS; k++)
+                        {
+                            log_series(ctx, y, x, prec, r, J, lut);
+                        }
+                        t2 = timing();
+                        elapsed = (t2-t1) / REPS;
+
+                        if (elapsed < best_here)
+                            best_here = elapsed;
                     }
-                    t2 = timing();
-                    elapsed = (t2-t1) / REPS;
 
-                    if (elapsed < best_time)
+                    if (best_here < best_time)
                     {
-                        best_time = elapsed;
-                        best_r = r;
-                        best_J = J;
+                        rJL[0] = r;
+                        rJL[1] = J;
+                        rJL[2] = lut;
+                        gmp_randseed_ui(state, prec);
+                        bench_sweep(&sweep, ctx, log_series_sweep_kernel, rJL, mpfr_log,
+                            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, TUNE_SWEEP_N, prec, state);
+                        if (sweep.max_err <= ref_err + TUNE_MAX_ERR)
+                        {
+                            best_time = best_here;
+                            best_r = r;
+                            best_J = J;
+                            best_lut = lut;
+                            best_err = sweep.max_err;
+                        }
+                        else
+                        {
+                            rejected++;
+                        }
                     }
-                }
 
-                mpfr_set_z(mx, y, GMP_RNDN);
-                mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
-                //mpfr_printf("Value:  %Rf\n", mx);
-                mpfr_sub(mx, mx, my, GMP_RNDN);
-                mpfr_abs(mx, mx, GMP_RNDN);
-                if (!mpfr_zero_p(mx))
-                {
-                    accuracy = -(int)mpfr_get_exp(mx)+1;
-                    if (accuracy < min_accuracy)
+                    mpfr_set_z(mx, y, GMP_RNDN);
+                    mpfr_div_2ui(mx, mx, prec, GMP_RNDN);
+                    //mpfr_printf("Value:  %Rf\n", mx);
+                    mpfr_sub(mx, mx, my, GMP_RNDN);
+                    mpfr_abs(mx, mx, GMP_RNDN);
+                    if (!mpfr_zero_p(mx))
                     {
-                        min_accuracy = accuracy;
+                        accuracy = -(int)mpfr_get_exp(mx)+1;
+                        if (accuracy < min_accuracy)
+                        {
+                            min_accuracy = accuracy;
+                        }
                     }
                 }
             }
@@ -314,9 +192,22 @@ void benchmark_optimize_log()
         mpfr_time *= 1000;
         best_time *= 1000;
 
-        printf("%5d %5d %3d %3d %8d %8d   %.3f\n", prec, min_accuracy, best_J, best_r,
-            (int)mpfr_time, (int)best_time, mpfr_time/best_time);
+        printf("%5d %5d %3d %3d %3d %8d %8d   %.3f %6.2f %4d\n", prec, min_accuracy, best_J, best_r,
+            best_lut, (int)mpfr_time, (int)best_time, mpfr_time/best_time, best_err, rejected);
+
+        tune_prec[ntune] = prec;
+        tune_r[ntune] = best_r;
+        tune_J[ntune] = best_J;
+        tune_lut[ntune] = best_lut;
+        ntune++;
+    }
 
+    if (tune_file != NULL)
+    {
+        if (save_log_tuning(tune_file, tune_prec, tune_r, tune_J, tune_lut, ntune) == 0)
+            printf("wrote %s\n", tune_file);
+        else
+            printf("could not write %s\n", tune_file);
     }
 
     mpfr_clear(mx);
@@ -325,17 +216,1233 @@ void benchmark_optimize_log()
     mpz_clear(x);
     mpz_clear(y);
     mpz_clear(dummy);
+    gmp_randclear(state);
+}
+
+/*
+ffl_log with the default and with the tuned (r, J, lut), against
+mpfr_log. Times in nanoseconds.
+*/
+void benchmark_tuned_log(ffl_ctx_t ctx)
+{
+    int REPS;
+    int prec, i, k, r, J, lut, dr, dJ, dlut;
+    double t1, t2, elapsed;
+    double mpfr_time, default_time, tuned_time;
+
+    mpz_t x, y;
+    mpfr_t mx, my;
+
+    mpfr_init(mx);
+    mpfr_init(my);
+
+    mpz_init(x);
+    mpz_init(y);
+
+    printf(" prec  dr dJ dL  tr tJ tL     mpfr  default    tuned  default/tuned  mpfr/tuned\n");
+
+    for (prec=53; prec<30000; prec+=prec/4)
+    {
+        REPS = 200000 / (prec + 100);
+        if (REPS < 2)
+            REPS = 2;
+
+        mpz_set_ui(x, 137);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        mpfr_set_prec(mx, prec);
+        mpfr_set_prec(my, prec);
+        mpfr_set_str(mx, "1.37", 10, GMP_RNDN);
+
+        log_default_params(prec, &dr, &dJ, &dlut);
+        log_tuned_params(prec, &r, &J, &lut);
+
+        /* fill the lookup table entry outside the timing */
+        log_series(ctx, y, x, prec, dr, dJ, dlut);
+
+        mpfr_time = default_time = tuned_time = 1e100;
+        for (i=0; i<5; i++)
+        {
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                mpfr_log(my, mx, GMP_RNDN);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < mpfr_time)
+                mpfr_time = elapsed;
+
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                log_series(ctx, y, x, prec, dr, dJ, dlut);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < default_time)
+                default_time = elapsed;
+
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                ffl_log(ctx, y, x, prec);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < tuned_time)
+                tuned_time = elapsed;
+        }
+
+        mpfr_time *= 1000;
+        default_time *= 1000;
+        tuned_time *= 1000;
+
+        printf("%5d %3d %2d %2d %3d %2d %2d %8d %8d %8d %14.3f %11.3f\n", prec,
+            dr, dJ, dlut, r, J, lut, (int)mpfr_time, (int)default_time,
+            (int)tuned_time, default_time/tuned_time, mpfr_time/tuned_time);
+    }
 
+    mpfr_clear(mx);
+    mpfr_clear(my);
+
+    mpz_clear(x);
+    mpz_clear(y);
+}
+
+/*
+Smallest accuracy in bits, against mpfr_log, of ffl_log and of log_agm
+over a few arguments inside and outside the range of the lookup
+tables.
+*/
+static int agm_check_args(ffl_ctx_t ctx, int prec)
+{
+    static const char *args[] = {"0.003", "0.999", "1", "1.37", "12345"};
+    mpz_t x, y;
+    mpfr_t mx, my;
+    int i, acc, worst;
+
+    mpz_init(x);
+    mpz_init(y);
+    mpfr_init2(mx, prec + 64);
+    mpfr_init2(my, prec);
+
+    worst = prec;
+    for (i=0; i<(int)(sizeof(args)/sizeof(args[0])); i++)
+    {
+        mpfr_set_str(mx, args[i], 10, GMP_RNDN);
+        mpfr_mul_2ui(mx, mx, prec, GMP_RNDN);
+        mpfr_get_z(x, mx, GMP_RNDZ);
+        mpfr_set_z_2exp(mx, x, -prec, GMP_RNDN);
+        mpfr_log(my, mx, GMP_RNDN);
+
+        ffl_log(ctx, y, x, prec);
+        acc = fix_accuracy(y, prec, my);
+        if (acc < worst)
+            worst = acc;
+
+        log_agm(ctx, y, x, prec);
+        acc = fix_accuracy(y, prec, my);
+        if (acc < worst)
+            worst = acc;
+    }
+
+    mpfr_clear(mx);
+    mpfr_clear(my);
+    mpz_clear(x);
+    mpz_clear(y);
+
+    return worst;
+}
+
+/*
+Smallest accuracy in bits, against mpfr_log, of ffl_log on x = 3*2^k
+for exponents from 2^30 up to beyond 2^(prec/2), where log_agm alone
+would lose its significant bits, and on a tiny x = 3*2^-(prec/2).
+*/
+static int agm_check_large(ffl_ctx_t ctx, int prec)
+{
+    long ks[] = {30, 60, 100, 1000, prec/2, 2*prec, -(prec/2)};
+    mpz_t x, y;
+    mpfr_t mx, my;
+    int i, acc, worst;
+
+    mpz_init(x);
+    mpz_init(y);
+    mpfr_init2(mx, 2);
+    mpfr_init2(my, prec + 96);
+
+    worst = prec;
+    for (i=0; i<(int)(sizeof(ks)/sizeof(ks[0])); i++)
+    {
+        mpz_set_ui(x, 3);
+        mpz_mul_2exp(x, x, prec + ks[i]);
+        mpfr_set_ui_2exp(mx, 3, ks[i], GMP_RNDN);
+        mpfr_log(my, mx, GMP_RNDN);
+
+        ffl_log(ctx, y, x, prec);
+        acc = fix_accuracy(y, prec, my);
+        if (acc < worst)
+            worst = acc;
+    }
+
+    mpfr_clear(mx);
+    mpfr_clear(my);
+    mpz_clear(x);
+    mpz_clear(y);
+
+    return worst;
+}
+
+/*
+log(1.37) with log_series (default r, J and lut), log_agm and mpfr_log
+from 1000 bits up to 10^5 bits, to locate the crossover LOG_AGM_PREC.
+Lookup table entries and the cached pi and log(2) are computed
+outside the timing. Times in microseconds. acc_x is the accuracy of
+ffl_log and log_agm on the arguments of agm_check_args, and acc_l that
+of ffl_log on the large and tiny arguments of agm_check_large.
+*/
+void benchmark_agm_log(ffl_ctx_t ctx)
+{
+    int REPS;
+    int prec, i, k, r, J, lut;
+    double t1, t2, elapsed;
+    double mpfr_time, series_time, agm_time;
+    int acc_series, acc_agm;
+
+    mpz_t x, y;
+    mpfr_t mx, my;
+
+    mpfr_init(mx);
+    mpfr_init(my);
+
+    mpz_init(x);
+    mpz_init(y);
+
+    printf("    prec  acc_s  acc_a  acc_x  acc_l         mpfr       series          agm  series/agm  mpfr/agm\n");
+
+    for (prec=1000; prec<=130000; prec*=2)
+    {
+        if (prec < 10000)
+            REPS = 20;
+        else if (prec < 100000)
+            REPS = 3;
+        else
+            REPS = 1;
+
+        mpz_set_ui(x, 137);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        mpfr_set_prec(mx, prec);
+        mpfr_set_prec(my, prec);
+        mpfr_set_str(mx, "1.37", 10, GMP_RNDN);
+
+        log_default_params(prec, &r, &J, &lut);
+
+        log_series(ctx, y, x, prec, r, J, lut);
+        log_agm(ctx, y, x, prec);
+
+        mpfr_time = series_time = agm_time = 1e100;
+        for (i=0; i<3; i++)
+        {
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                mpfr_log(my, mx, GMP_RNDN);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < mpfr_time)
+                mpfr_time = elapsed;
+
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                log_series(ctx, y, x, prec, r, J, lut);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < series_time)
+                series_time = elapsed;
+        }
+        acc_series = fix_accuracy(y, prec, my);
+
+        for (i=0; i<3; i++)
+        {
+            t1 = timing();
+            for (k=0; k<REPS; k++)
+                log_agm(ctx, y, x, prec);
+            t2 = timing();
+            elapsed = (t2-t1)/REPS;
+            if (elapsed < agm_time)
+                agm_time = elapsed;
+        }
+        acc_agm = fix_accuracy(y, prec, my);
+
+        printf("%8d %6d %6d %6d %6d %12.0f %12.0f %12.0f  %10.3f %9.3f\n", prec,
+            acc_series, acc_agm, agm_check_args(ctx, prec), agm_check_large(ctx, prec),
+            mpfr_time, series_time, agm_time,
+            series_time/agm_time, mpfr_time/agm_time);
+        fflush(stdout);
+    }
+
+    mpfr_clear(mx);
+    mpfr_clear(my);
+
+    mpz_clear(x);
+    mpz_clear(y);
 }
 
+/*
+Each thread owns its context and output variables and evaluates the
+same argument REPS times. Only x is shared, and it is read-only.
+*/
+typedef struct
+{
+    mpz_srcptr x;
+    mpz_srcptr ref;
+    int prec;
+    int r;
+    int J;
+    int reps;
+    int mismatch;
+} log_thread_arg;
+
+void *log_thread_worker(void *arg)
+{
+    log_thread_arg *a = (log_thread_arg *) arg;
+    ffl_ctx_t ctx;
+    mpz_t y;
+    int k;
+
+    ffl_init(ctx);
+    mpz_init(y);
+
+    for (k=0; k<a->reps; k++)
+    {
+        log_series(ctx, y, (mpz_ptr) a->x, a->prec, a->r, a->J, 1);
+    }
 
+    a->mismatch = (mpz_cmp(y, a->ref) != 0);
+
+    mpz_clear(y);
+    ffl_clear(ctx);
+    return NULL;
+}
 
-int main()
+/*
+Throughput of log_series with 1..N threads, N = number of online cores
+unless given explicitly. Every thread does the same amount of work, so
+with perfect scaling the wall time stays constant and evals/s grows
+linearly.
+*/
+void benchmark_threads_log(int ncpu)
 {
-    fix_init_data();
+    static const int precs[] = {53, 333, 1000, 3333};
+    log_thread_arg args[64];
+    pthread_t threads[64];
+    ffl_ctx_t ctx;
+    mpz_t x, ref;
+    int nthreads, i, j, prec, r, J, REPS, mismatch;
+    double t1, t2, rate, base_rate;
+
+    if (ncpu < 1)
+        ncpu = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1)
+        ncpu = 1;
+    if (ncpu > 64)
+        ncpu = 64;
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(ref);
+
+    printf(" prec threads     evals/s  speedup  efficiency  ok\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        r = 1;
+        while (r*r < prec/4)
+            r++;
+        J = 4;
+        REPS = 1000000 / (prec + 100);
+        if (REPS < 4)
+            REPS = 4;
+
+        mpz_set_ui(x, 137);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        log_series(ctx, ref, x, prec, r, J, 1);
+
+        base_rate = 0;
+        for (nthreads=1; nthreads<=ncpu; nthreads++)
+        {
+            t1 = timing();
+            for (i=0; i<nthreads; i++)
+            {
+                args[i].x = x;
+                args[i].ref = ref;
+                args[i].prec = prec;
+                args[i].r = r;
+                args[i].J = J;
+                args[i].reps = REPS;
+                pthread_create(&threads[i], NULL, log_thread_worker, &args[i]);
+            }
+            mismatch = 0;
+            for (i=0; i<nthreads; i++)
+            {
+                pthread_join(threads[i], NULL);
+                mismatch |= args[i].mismatch;
+            }
+            t2 = timing();
+
+            rate = 1e6 * nthreads * REPS / (t2-t1);
+            if (nthreads == 1)
+                base_rate = rate;
+
+            printf("%5d %7d %11.0f %8.2f %11.2f  %s\n", prec, nthreads, rate,
+                rate/base_rate, rate/base_rate/nthreads, mismatch ? "NO" : "yes");
+        }
+    }
+
+    mpz_clear(x);
+    mpz_clear(ref);
+    ffl_clear(ctx);
+}
+
+/*
+Per-element cost of a batch of N arguments in [1, 2): a loop of single
+log_series calls against log_series_batch and, if more than one thread
+is requested, log_series_batch_mt. The contexts are warmed up first so
+that lookup table fills are not counted.
+*/
+void benchmark_batch_log(int nthreads)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333};
+    const int N = 1000;
+    ffl_ctx_t *ctxs;
+    mpz_t *in, *out, *ref;
+    int i, j, k, prec, r, J, REPS, mismatch;
+    double t1, t2, single_time, batch_time, mt_time;
+
+    if (nthreads < 1)
+        nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+
+    ctxs = malloc(nthreads * sizeof(ffl_ctx_t));
+    for (i=0; i<nthreads; i++)
+    {
+        ffl_init(ctxs[i]);
+    }
+
+    in = malloc(N * sizeof(mpz_t));
+    out = malloc(N * sizeof(mpz_t));
+    ref = malloc(N * sizeof(mpz_t));
+    for (i=0; i<N; i++)
+    {
+        mpz_init(in[i]);
+        mpz_init(out[i]);
+        mpz_init(ref[i]);
+    }
+
+    printf("batch of %d, %d thread(s), times in ns per element\n", N, nthreads);
+    printf(" prec      single       batch    batch_mt   speedup  mt_speedup  ok\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        r = 1;
+        while (r*r < prec/4)
+            r++;
+        J = 4;
+        REPS = 20000 / (prec + 100);
+        if (REPS < 1)
+            REPS = 1;
+
+        for (i=0; i<N; i++)
+        {
+            mpz_set_ui(in[i], N + i);
+            mpz_mul_2exp(in[i], in[i], prec);
+            mpz_div_ui(in[i], in[i], N);
+        }
+
+        single_time = batch_time = mt_time = 1e100;
+        log_series_batch_mt(ctxs, out, in, N, prec, r, J, 1, nthreads);
+        log_series_batch(ctxs[0], out, in, N, prec, r, J, 1);
+        for (k=0; k<3; k++)
+        {
+            t1 = timing();
+            for (i=0; i<N*REPS; i++)
+            {
+                log_series(ctxs[0], ref[i%N], in[i%N], prec, r, J, 1);
+            }
+            t2 = timing();
+            if (t2-t1 < single_time)
+                single_time = t2-t1;
+
+            t1 = timing();
+            for (i=0; i<REPS; i++)
+            {
+                log_series_batch(ctxs[0], out, in, N, prec, r, J, 1);
+            }
+            t2 = timing();
+            if (t2-t1 < batch_time)
+                batch_time = t2-t1;
+
+            t1 = timing();
+            for (i=0; i<REPS; i++)
+            {
+                log_series_batch_mt(ctxs, out, in, N, prec, r, J, 1, nthreads);
+            }
+            t2 = timing();
+            if (t2-t1 < mt_time)
+                mt_time = t2-t1;
+        }
+
+        mismatch = 0;
+        for (i=0; i<N; i++)
+        {
+            mismatch |= (mpz_cmp(out[i], ref[i]) != 0);
+        }
+
+        single_time *= 1000.0 / (N*REPS);
+        batch_time *= 1000.0 / (N*REPS);
+        mt_time *= 1000.0 / (N*REPS);
+
+        printf("%5d %11.0f %11.0f %11.0f %9.3f %11.3f  %s\n", prec, single_time,
+            batch_time, mt_time, single_time/batch_time, single_time/mt_time,
+            mismatch ? "NO" : "yes");
+    }
+
+    for (i=0; i<N; i++)
+    {
+        mpz_clear(in[i]);
+        mpz_clear(out[i]);
+        mpz_clear(ref[i]);
+    }
+    for (i=0; i<nthreads; i++)
+    {
+        ffl_clear(ctxs[i]);
+    }
+    free(ctxs);
+    free(in);
+    free(out);
+    free(ref);
+}
+
+int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+Latency of the first N log_series calls as seen by a newly started
+process (fresh context, empty lazy lookup table): with the lazily
+filled table, and with the precomputed table from lut_file mapped by
+load_log_lut (the mapping time is reported separately). Arguments are
+random in [1/4, 2), so most calls in the lazy case hit an unfilled
+entry. Each mode is repeated TRIALS times from scratch; per-call
+percentiles are over all trials, in microseconds.
+*/
+void benchmark_coldstart_log(const char *lut_file)
+{
+    static const int precs[] = {53, 333, 1000, 3333};
+    const int N = 200;
+    const int TRIALS = 5;
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    mpz_t *in;
+    mpz_t y;
+    double *lat;
+    double t1, t2, load_time, total;
+    int i, j, mode, trial, prec, r, J, lut;
+
+    unload_log_lut();
+    t1 = timing();
+    if (load_log_lut(lut_file) != 0)
+    {
+        printf("could not map %s, write it with 'logtest2 lut'\n", lut_file);
+        return;
+    }
+    t2 = timing();
+    load_time = t2-t1;
+    unload_log_lut();
+
+    gmp_randinit_default(state);
+    in = malloc(N * sizeof(mpz_t));
+    lat = malloc(N * TRIALS * sizeof(double));
+    for (i=0; i<N; i++)
+    {
+        mpz_init(in[i]);
+    }
+    mpz_init(y);
+
+    printf("first %d calls in a fresh context, %d trials, mapping %s took %.0f us\n",
+        N, TRIALS, lut_file, load_time);
+    printf(" prec  table   total_us    min_us    p50_us    p90_us    p99_us    max_us\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        log_default_params(prec, &r, &J, &lut);
+
+        for (i=0; i<N; i++)
+        {
+            mpz_set_ui(y, 7);
+            mpz_mul_2exp(y, y, prec-2);
+            mpz_urandomm(in[i], state, y);
+            mpz_set_ui(y, 1);
+            mpz_mul_2exp(y, y, prec-2);
+            mpz_add(in[i], in[i], y);
+        }
+
+        for (mode=0; mode<2; mode++)
+        {
+            if (mode == 1)
+                load_log_lut(lut_file);
+
+            total = 0;
+            for (trial=0; trial<TRIALS; trial++)
+            {
+                clear_log_lut();
+                ffl_init(ctx);
+                for (i=0; i<N; i++)
+                {
+                    t1 = timing();
+                    log_series(ctx, y, in[i], prec, r, J, 1);
+                    t2 = timing();
+                    lat[trial*N+i] = t2-t1;
+                    total += t2-t1;
+                }
+                ffl_clear(ctx);
+            }
+
+            unload_log_lut();
+
+            qsort(lat, N*TRIALS, sizeof(double), cmp_double);
+            printf("%5d %6s %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n", prec,
+                mode ? "mapped" : "lazy", total/TRIALS, lat[0], lat[N*TRIALS/2],
+                lat[N*TRIALS*9/10], lat[N*TRIALS*99/100], lat[N*TRIALS-1]);
+        }
+    }
+
+    for (i=0; i<N; i++)
+    {
+        mpz_clear(in[i]);
+    }
+    mpz_clear(y);
+    free(in);
+    free(lat);
+    gmp_randclear(state);
+}
+
+/*
+Every stress thread evaluates its own random arguments in [1/4, 2)
+with its own context, all filling the shared lazy lookup table at the
+same time.
+*/
+typedef struct
+{
+    mpz_t *in;
+    mpz_t *out;
+    int n;
+    int prec;
+    int r;
+    int J;
+} log_stress_arg;
+
+void *log_stress_worker(void *arg)
+{
+    log_stress_arg *a = (log_stress_arg *) arg;
+    ffl_ctx_t ctx;
+    int i;
+
+    ffl_init(ctx);
+    for (i=0; i<a->n; i++)
+    {
+        log_series(ctx, a->out[i], a->in[i], a->prec, a->r, a->J, 1);
+    }
+    ffl_clear(ctx);
+    return NULL;
+}
+
+/*
+Starts nthreads threads on an empty lazy lookup table, each hammering
+random lut_index values, ROUNDS times per precision. Reports the wall
+time of the cold round (table filled concurrently) and of a warm round
+(table already full), and checks every result against a
+single-threaded evaluation afterwards.
+*/
+void benchmark_stress_lut_log(int nthreads)
+{
+    static const int precs[] = {53, 333, 1000, 3333};
+    const int N = 2000;
+    const int ROUNDS = 5;
+    log_stress_arg args[64];
+    pthread_t threads[64];
+    gmp_randstate_t state;
+    ffl_ctx_t ctx;
+    mpz_t *in, *out;
+    mpz_t y, t;
+    int i, j, k, round, prec, r, J, lut, mismatch;
+    double t1, t2, cold_time, warm_time;
+
+    if (nthreads < 1)
+        nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads < 1)
+        nthreads = 1;
+    if (nthreads > 64)
+        nthreads = 64;
+
+    gmp_randinit_default(state);
+    ffl_init(ctx);
+    mpz_init(y);
+    mpz_init(t);
+    in = malloc(nthreads * N * sizeof(mpz_t));
+    out = malloc(nthreads * N * sizeof(mpz_t));
+    for (i=0; i<nthreads*N; i++)
+    {
+        mpz_init(in[i]);
+        mpz_init(out[i]);
+    }
+
+    unload_log_lut();
+
+    printf("%d threads, %d evaluations each, %d rounds, times in ms\n", nthreads, N, ROUNDS);
+    printf(" prec      cold      warm  ok\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        log_default_params(prec, &r, &J, &lut);
+
+        mpz_set_ui(t, 1);
+        mpz_mul_2exp(t, t, prec-2);
+        for (i=0; i<nthreads*N; i++)
+        {
+            mpz_mul_ui(y, t, 7);
+            mpz_urandomm(in[i], state, y);
+            mpz_add(in[i], in[i], t);
+        }
+
+        cold_time = warm_time = 1e100;
+        mismatch = 0;
+        for (round=0; round<ROUNDS; round++)
+        {
+            clear_log_lut();
+
+            for (i=0; i<2; i++)
+            {
+                t1 = timing();
+                for (k=0; k<nthreads; k++)
+                {
+                    args[k].in = in + k*N;
+                    args[k].out = out + k*N;
+                    args[k].n = N;
+                    args[k].prec = prec;
+                    args[k].r = r;
+                    args[k].J = J;
+                    pthread_create(&threads[k], NULL, log_stress_worker, &args[k]);
+                }
+                for (k=0; k<nthreads; k++)
+                {
+                    pthread_join(threads[k], NULL);
+                }
+                t2 = timing();
+
+                if (i == 0 && t2-t1 < cold_time)
+                    cold_time = t2-t1;
+                if (i == 1 && t2-t1 < warm_time)
+                    warm_time = t2-t1;
+            }
+
+            for (i=0; i<nthreads*N; i++)
+            {
+                log_series(ctx, y, in[i], prec, r, J, 1);
+                mismatch |= (mpz_cmp(y, out[i]) != 0);
+            }
+        }
+
+        printf("%5d %9.1f %9.1f  %s\n", prec, cold_time/1000, warm_time/1000,
+            mismatch ? "NO" : "yes");
+    }
+
+    for (i=0; i<nthreads*N; i++)
+    {
+        mpz_clear(in[i]);
+        mpz_clear(out[i]);
+    }
+    free(in);
+    free(out);
+    mpz_clear(y);
+    mpz_clear(t);
+    ffl_clear(ctx);
+    gmp_randclear(state);
+}
+
+typedef struct
+{
+    ffl_ctx_struct *ctx;
+    mpz_ptr y;
+    mpz_ptr x;
+    int prec;
+    int r;
+    int J;
+    int lut;
+} log_bench_arg;
+
+static void log_bench_call(void *arg)
+{
+    log_bench_arg *a = (log_bench_arg *) arg;
+    log_series(a->ctx, a->y, a->x, a->prec, a->r, a->J, a->lut);
+}
+
+/*
+log(1.37) through the benchmark harness: log_series without the lookup
+table ("log", r = sqrt(prec/4)) and with the default r, J and lut
+("log_lut"), one line per precision in the given format, with the
+hardware and operation counts per call. The warmup fills the lookup
+table entries. Runs on cpu if cpu >= 0. Times in nanoseconds.
+*/
+void benchmark_suite_log(int format, int cpu)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333, 10000, 33333};
+    ffl_ctx_t ctx;
+    mpz_t x, y;
+    log_bench_arg arg;
+    bench_result res;
+    char params[64];
+    int j, prec, r, J, lut;
+
+    if (bench_pin_cpu(cpu) != 0)
+        fprintf(stderr, "could not pin to cpu %d\n", cpu);
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+
+    bench_report_header(format, 1);
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+
+        mpz_set_ui(x, 137);
+        mpz_mul_2exp(x, x, prec);
+        mpz_div_ui(x, x, 100);
+
+        arg.ctx = ctx;
+        arg.y = y;
+        arg.x = x;
+        arg.prec = prec;
+
+        log_default_params(prec, &r, &J, &lut);
+
+        arg.r = (int) sqrt(prec / 4.0);
+        arg.J = J;
+        arg.lut = 0;
+        snprintf(params, sizeof(params), "x=1.37 r=%d J=%d", arg.r, arg.J);
+        bench_run(&res, log_bench_call, &arg, BENCH_SAMPLES, BENCH_SAMPLE_NS);
+        bench_count(&res, log_bench_call, &arg, ctx);
+        bench_report(format, "log", prec, params, &res);
+
+        arg.r = r;
+        arg.lut = lut;
+        snprintf(params, sizeof(params), "x=1.37 r=%d J=%d lut=%d", r, J, lut);
+        bench_run(&res, log_bench_call, &arg, BENCH_SAMPLES, BENCH_SAMPLE_NS);
+        bench_count(&res, log_bench_call, &arg, ctx);
+        bench_report(format, "log_lut", prec, params, &res);
+    }
+
+    mpz_clear(x);
+    mpz_clear(y);
+    ffl_clear(ctx);
+}
+
+/*
+log_series(1.37) at prec bits with the default lookup table levels
+over a grid of (r, J), with the counts per call, to show why the
+fastest pair wins: each square root (r) saves series terms, and J
+trades full multiplications in the series for powers. The operation
+counts need a library built with STATS=1. Times in nanoseconds.
+*/
+void benchmark_counters_log(int prec, int format)
+{
+    ffl_ctx_t ctx;
+    mpz_t x, y;
+    log_bench_arg arg;
+    bench_result res;
+    char params[64];
+    int r, J, dr, dJ, lut, rstep, best_r, best_J;
+    double best_time;
+
+    ffl_init(ctx);
+    mpz_init(x);
+    mpz_init(y);
+
+    mpz_set_ui(x, 137);
+    mpz_mul_2exp(x, x, prec);
+    mpz_div_ui(x, x, 100);
+
+    log_default_params(prec, &dr, &dJ, &lut);
+
+    rstep = (int) sqrt(prec + 30.0) / 12;
+    if (rstep < 1)
+        rstep = 1;
+
+    best_time = 1e100;
+    best_r = best_J = 0;
+
+    bench_report_header(format, 1);
+
+    for (J=1; J<MAX_SERIES_STEPS; J++)
+    {
+        for (r=0; r*r<prec+30; r+=rstep)
+        {
+            arg.ctx = ctx;
+            arg.y = y;
+            arg.x = x;
+            arg.prec = prec;
+            arg.r = r;
+            arg.J = J;
+            arg.lut = lut;
+            bench_run(&res, log_bench_call, &arg, 5, BENCH_SAMPLE_NS / 2);
+            bench_count(&res, log_bench_call, &arg, ctx);
+            snprintf(params, sizeof(params), "r=%d J=%d lut=%d", r, J, lut);
+            bench_report(format, "log_series", prec, params, &res);
+
+            if (res.median < best_time)
+            {
+                best_time = res.median;
+                best_r = r;
+                best_J = J;
+            }
+        }
+    }
+
+    if (format == BENCH_TEXT)
+        printf("fastest: r=%d J=%d, %.0f ns\n", best_r, best_J, best_time);
+
+    mpz_clear(x);
+    mpz_clear(y);
+    ffl_clear(ctx);
+}
+
+/*
+ffl_log, and log_series without the lookup table ("log") and with the
+default r, J and lut ("log_lut"), on n random arguments in
+[LOG_SWEEP_LO, LOG_SWEEP_HI) per precision (fewer above 1000 bits),
+and ffl_log on arguments log-uniform in [LOG_SWEEP_WIDE_LO,
+LOG_SWEEP_WIDE_HI) ("ffl_log wide", which needs the reduction by
+powers of 2), against mpfr_log. Errors in bits (log2 of the error in
+ulps), times in nanoseconds; they include filling the lookup table
+entries that the arguments hit.
+*/
+void benchmark_sweep_log(int n)
+{
+    static const int precs[] = {53, 113, 333, 1000, 3333, 10000};
+    static const char *names[] = {"ffl_log", "log", "log_lut", "ffl_log wide"};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result res;
+    int i, j, prec, count, rJL[3];
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    printf(" prec  kernel          r  J lut      n  max_err  mean_err          worst_x      ns/call\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        for (i=0; i<4; i++)
+        {
+            if (i == 0)
+            {
+                log_tuned_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+                bench_sweep(&res, ctx, log_sweep_kernel, NULL, mpfr_log,
+                    LOG_SWEEP_LO, LOG_SWEEP_HI, 0, count, prec, state);
+            }
+            else if (i == 3)
+            {
+                log_tuned_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+                bench_sweep(&res, ctx, log_sweep_kernel, NULL, mpfr_log,
+                    LOG_SWEEP_WIDE_LO, LOG_SWEEP_WIDE_HI, 1, count, prec, state);
+            }
+            else
+            {
+                log_default_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+                if (i == 1)
+                {
+                    rJL[0] = (int) sqrt(prec / 4.0);
+                    rJL[2] = 0;
+                }
+                bench_sweep(&res, ctx, log_series_sweep_kernel, rJL, mpfr_log,
+                    LOG_SWEEP_LO, LOG_SWEEP_HI, 0, count, prec, state);
+            }
+            printf("%5d  %-12s %3d %2d %3d %6d %8.2f %9.3f %16.12f %12.0f\n", prec, names[i],
+                rJL[0], rJL[1], rJL[2], res.n, res.max_err, res.mean_err, res.worst_x, res.ns);
+            fflush(stdout);
+        }
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+
+/*
+ffl_mpfr_log against mpfr_log on n random arguments per precision
+(fewer above 1000 bits) in [LOG_SWEEP_LO, LOG_SWEEP_HI) and log-uniform
+in [LOG_SWEEP_WIDE_LO, LOG_SWEEP_WIDE_HI), in all rounding modes (see
+bench_mpfr_compare). Counts the results that differ from MPFR, which
+should be none, and times both end to end, conversions included, in
+nanoseconds.
+*/
+void benchmark_mpfr_log(int n)
+{
+    static const int precs[] = {24, 53, 113, 333, 1000, 3333, 10000};
+    gmp_randstate_t state;
+    bench_mpfr_result res;
+    int j, prec, count;
+
+    gmp_randinit_default(state);
+
+    printf(" prec  range           n  wrong  ternary       ffl_ns      mpfr_ns  mpfr/ffl\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        bench_mpfr_compare(&res, ffl_mpfr_log, mpfr_log, LOG_SWEEP_LO, LOG_SWEEP_HI, 0, 0, count, prec, state);
+        printf("%5d  %-9s %6d %6d %8d %12.0f %12.0f %9.2f\n", prec, "narrow", res.n, res.wrong,
+            res.wrong_ternary, res.ns, res.ref_ns, res.ref_ns / res.ns);
+
+        bench_mpfr_compare(&res, ffl_mpfr_log, mpfr_log, LOG_SWEEP_WIDE_LO, LOG_SWEEP_WIDE_HI, 1, 0, count, prec, state);
+        printf("%5d  %-9s %6d %6d %8d %12.0f %12.0f %9.2f\n", prec, "wide", res.n, res.wrong,
+            res.wrong_ternary, res.ns, res.ref_ns, res.ref_ns / res.ns);
+        fflush(stdout);
+    }
+
+    gmp_randclear(state);
+    ffl_mpfr_clear();
+}
+
+/*
+log_series_mpn against log_series, the mpz_t kernel, with the tuned
+(r, J, lut) on n random arguments per precision (fewer above 1000
+bits) in [LOG_SWEEP_LO, LOG_SWEEP_HI), against mpfr_log. Both see the
+same arguments, after an untimed pass that fills the lookup table
+entries they hit. Errors in bits, times in nanoseconds.
+*/
+void benchmark_mpn_log(int n)
+{
+    static const int precs[] = {192, 333, 500, 1000, 2000, 3333, 4000, 8000};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result mpn, ser;
+    int j, prec, count, rJL[3];
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    printf(" prec    r  J lut limbs      n   mpn_err  mpz_err       mpn_ns       mpz_ns  mpz/mpn\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        count = (prec <= 1000) ? n : (int) ((double) n * 1000 / prec);
+        if (count < 20)
+            count = 20;
+
+        log_tuned_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&mpn, ctx, log_series_mpn_sweep_kernel, rJL, mpfr_log,
+            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, count, prec, state);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&mpn, ctx, log_series_mpn_sweep_kernel, rJL, mpfr_log,
+            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, count, prec, state);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&ser, ctx, log_series_sweep_kernel, rJL, mpfr_log,
+            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, count, prec, state);
+
+        printf("%5d %4d %2d %3d %5d %6d %9.2f %8.2f %12.0f %12.0f %8.2f\n", prec,
+            rJL[0], rJL[1], rJL[2], series_mpn_limbs(prec + rJL[0] + 10), count,
+            mpn.max_err, ser.max_err, mpn.ns, ser.ns, ser.ns / mpn.ns);
+        fflush(stdout);
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+
+#ifdef FFL_FAST128
+/*
+log_fast128 against log_series with the tuned (r, J, lut) on n random
+arguments per precision in [LOG_SWEEP_LO, LOG_SWEEP_HI), the range
+log_fast128 takes, against mpfr_log. Both see the same arguments,
+after an untimed pass that fills the lookup table entries they hit.
+Errors in bits, times in nanoseconds.
+*/
+void benchmark_fast128_log(int n)
+{
+    static const int precs[] = {24, 53, 64, 80, 100, 113, FAST128_PREC};
+    ffl_ctx_t ctx;
+    gmp_randstate_t state;
+    bench_sweep_result fast, ser;
+    int j, prec, rJL[3];
+
+    ffl_init(ctx);
+    gmp_randinit_default(state);
+
+    printf(" prec      n  fast_err  series_err      fast_ns    series_ns  series/fast\n");
+
+    for (j=0; j<(int)(sizeof(precs)/sizeof(precs[0])); j++)
+    {
+        prec = precs[j];
+        log_tuned_params(prec, &rJL[0], &rJL[1], &rJL[2]);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&fast, ctx, log_fast128_sweep_kernel, NULL, mpfr_log,
+            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, n, prec, state);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&fast, ctx, log_fast128_sweep_kernel, NULL, mpfr_log,
+            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, n, prec, state);
+
+        gmp_randseed_ui(state, prec);
+        bench_sweep(&ser, ctx, log_series_sweep_kernel, rJL, mpfr_log,
+            LOG_SWEEP_LO, LOG_SWEEP_HI, 0, n, prec, state);
+
+        printf("%5d %6d %9.2f %11.2f %12.0f %12.0f %12.2f\n", prec, n, fast.max_err,
+            ser.max_err, fast.ns, ser.ns, ser.ns / fast.ns);
+        fflush(stdout);
+    }
+
+    gmp_randclear(state);
+    ffl_clear(ctx);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    ffl_ctx_t ctx;
+
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+    {
+        /* logtest2 bench [text|csv|json] [cpu] */
+        int format = argc > 2 ? bench_parse_format(argv[2]) : BENCH_TEXT;
+        if (format < 0)
+        {
+            printf("usage: logtest2 bench [text|csv|json] [cpu]\n");
+            return 1;
+        }
+        benchmark_suite_log(format, argc > 3 ? atoi(argv[3]) : -1);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "counters"))
+    {
+        /* logtest2 counters [prec [text|csv|json]] */
+        int format = argc > 3 ? bench_parse_format(argv[3]) : BENCH_TEXT;
+        if (format < 0)
+        {
+            printf("usage: logtest2 counters [prec [text|csv|json]]\n");
+            return 1;
+        }
+        benchmark_counters_log(argc > 2 ? atoi(argv[2]) : 1000, format);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "sweep"))
+    {
+        benchmark_sweep_log(argc > 2 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "mpfr"))
+    {
+        benchmark_mpfr_log(argc > 2 ? atoi(argv[2]) : 2000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "mpn"))
+    {
+        benchmark_mpn_log(argc > 2 ? atoi(argv[2]) : 1000);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "fast128"))
+    {
+#ifdef FFL_FAST128
+        benchmark_fast128_log(argc > 2 ? atoi(argv[2]) : 2000);
+#else
+        printf("built without FFL_FAST128\n");
+#endif
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "threads"))
+    {
+        benchmark_threads_log(argc > 2 ? atoi(argv[2]) : 0);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "batch"))
+    {
+        benchmark_batch_log(argc > 2 ? atoi(argv[2]) : 0);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "agm"))
+    {
+        ffl_init(ctx);
+        benchmark_agm_log(ctx);
+        ffl_clear(ctx);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "stress"))
+    {
+        benchmark_stress_lut_log(argc > 2 ? atoi(argv[2]) : 0);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "lut"))
+    {
+        if (save_log_lut(argc > 2 ? argv[2] : LOG_LUT_FILE) == 0)
+            printf("wrote %s\n", argc > 2 ? argv[2] : LOG_LUT_FILE);
+        else
+            printf("could not write %s\n", argc > 2 ? argv[2] : LOG_LUT_FILE);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "coldstart"))
+    {
+        benchmark_coldstart_log(argc > 2 ? argv[2] : LOG_LUT_FILE);
+        return 0;
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "tuned"))
+    {
+        if (load_log_tuning(argc > 2 ? argv[2] : LOG_TUNE_FILE) <= 0)
+            printf("no tuning data, using defaults\n");
+        ffl_init(ctx);
+        benchmark_tuned_log(ctx);
+        ffl_clear(ctx);
+        return 0;
+    }
+
+    ffl_init(ctx);
 
-    benchmark_optimize_log();
+    benchmark_optimize_log(ctx, argc > 1 ? argv[1] : LOG_TUNE_FILE);
 
-    fix_clear_data();
+    ffl_clear(ctx);
 }
 